@@ -1,5 +1,5 @@
 /*******************************************************************************
-* Copyright  2022 Kerry S. Martin, martin@wild-wood.net
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
 * Free for usage without warranty, expressed or implied; attribution required
 *
 * Filename   : Relay.cpp
@@ -7,7 +7,7 @@
 *   Command line utility to control USB HID relays (usb_relay_device.dll).
 *
 * Created    : 01/11/2022
-* Modified   : 04/24/2022
+* Modified   : 10/18/2026
 * Author     : Kerry S. Martin, martin@wild-wood.net
 *******************************************************************************/
 
@@ -15,64 +15,68 @@
 #include <algorithm>
 #include <regex>
 #include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <set>
+#include <iomanip>
+#include <utility>
+#include <ctime>
 using namespace std;
 
 #include "EasyRegistry.h"
+#include "Relay.h"
+#include "RelayServer.h"
+#include "RelayRecorder.h"
+#include "RelayContext.h"
+#include "RelayHistory.h"
+#include "RelayTune.h"
+#include "RelayInventory.h"
+#include "RelaySequence.h"
+#include "RelaySteps.h"
 
 // USB HID relay interface (usb_relay_device.dll)
 #include "usb_relay_device.h"
 #pragma comment(lib, "x64/usb_relay_device.lib")
 
 // version information
-constexpr char APP_VERSION[] = "1.1";
+constexpr char APP_VERSION[] = "1.2";
+
+// WAIT polling interval (doubles after each poll that does not match)
+constexpr int WAIT_POLL_MIN_MS = 10;
+constexpr int WAIT_POLL_MAX_MS = 500;
+
+// RESTORE polling interval while watching for modules to appear
+constexpr int RESTORE_POLL_MS = 250;
 
 // registry key
 constexpr char REG_KEY_RELAY_ALIAS[] = "SOFTWARE\\WWES\\Relay";
 constexpr char REG_SETTING_ALIASES[] = "Aliases";
 
-// map to hold set states for relays
-enum class LOGIC { H, L, X };
-typedef char relay_idx_t;
-constexpr relay_idx_t RELAY_IDX_ALL = '0';
-constexpr relay_idx_t RELAY_IDX_MIN = '1';
-constexpr relay_idx_t RELAY_IDX_MAX = '8';
-typedef map<relay_idx_t, LOGIC> MODULE;
-typedef map<string, MODULE> MODULE_SET;
-
-// map to hold sernums and channels
-struct channels_t { string sn = ""; int channels = 0; };
-typedef vector<channels_t> MODULE_CHANNELS;
-
-// vector to hold query lists for relays
-struct queries_t { string sn = ""; string q = ""; };
-typedef vector<queries_t> MODULE_QUERIES;
-
-// errors
-enum class ERROR_CODES : int { NONE = 0, SYNTAX = -1, NO_DEVICES = -2, BAD_SERNUM = -3, NO_DRIVER_INIT=-4, INVALID_CHANNEL=-5 };
-
 // support function declarations
 void PrintUsage(string strProgName);
 string strip_path(string filename);
 ERROR_CODES Relays_Enumerate();
-ERROR_CODES Relays_Query(const MODULE_QUERIES& queries, const MODULE_CHANNELS& channels);
-ERROR_CODES Relays_Set(const MODULE_SET& modules, const MODULE_CHANNELS& channels);
-bool Relays_Get_Sernums(MODULE_CHANNELS& channels);
-int Relays_Get_NumChannels(string sernum, const MODULE_CHANNELS& channels);
-bool Is_Sernum_Present(string sernum, const MODULE_CHANNELS& channels);
+ERROR_CODES Relays_Inventory();
+string Format_Time(uint64_t time_us);
+ERROR_CODES Relays_Query(Relay_Context& context, const MODULE_QUERIES& queries, const MODULE_CHANNELS& channels, string& error_sernum);
+ERROR_CODES Relays_Query_Module(Relay_Context& context, const string& sernum, string q, int num_channels, string& output);
+ERROR_CODES Relays_Set(Relay_Context& context, const MODULE_SET& modules, const MODULE_CHANNELS& channels, string& error_sernum);
+ERROR_CODES Relays_Set_Module(Relay_Context& context, const string& sernum, const MODULE& module);
+ERROR_CODES Relays_Rmw(Relay_Context& context, const MODULE_RMW& rmws, const MODULE_CHANNELS& channels, string& error_sernum);
+ERROR_CODES Relays_Rmw_Module(Relay_Context& context, const rmw_t& op, int num_channels, string& output);
+ERROR_CODES Relays_Wait(Relay_Context& context, const wait_t& wait, const MODULE_CHANNELS& channels);
+ERROR_CODES Relays_Exec(Relay_Context& context, const exec_t& exec, const MODULE_CHANNELS& channels, string& error_sernum);
+string Query_Bits(unsigned status, string q, int num_channels);
+vector<string> Csv_Fields(const string& line);
+bool Csv_Heading(const vector<string>& fields, const vector<string>& columns);
+ERROR_CODES Relays_Restore(Relay_Context& context, bool watch, int seconds, string& error_sernum);
 LOGIC get_state(string status);
 LOGIC get_state(char status);
-void AssignAlias(string alias, string sernum);
-void RemoveAlias(string alias);
 void ListAlias();
-string GetAliasSernum(string alias_or_sernum);
-
-// string literals for common regex patterns
-// alias_name will match any sernum as well
-#define T_SERNUM "[A-Z0-9]{5}"
-#define T_ALIAS_NAME "[_#~@A-Z0-9][-_#~@A-Z0-9]*"
-#define T_LOGIC_BITS "[0L1HX_.]"
-#define T_LOGICS "ON|1|H|NO|OFF|0|L|NC"
-#define T_CHANNELS "[1-8]"
 
 // regex patterns for common usage
 const regex regex_on_vals("^(?:ON|1|H|NO)$", regex::icase);
@@ -81,6 +85,13 @@ const regex regex_sernum("^(" T_SERNUM ")$", regex::icase);
 const regex regex_alias_name("^(" T_ALIAS_NAME ")$", regex::icase);
 const regex regex_alias_registry("(" T_ALIAS_NAME ")[=:](" T_SERNUM "),?", regex::icase);
 
+// regex patterns for parsing SET command
+const regex regex_sernum_pattern("^(" T_ALIAS_NAME "):(" T_LOGIC_BITS "{1,8})$", regex::icase);
+const regex regex_ch_set("^(" T_CHANNELS ")=(" T_LOGICS ")$", regex::icase);
+
+// regex patterns for parsing QUERY command
+const regex regex_query_chlist("^(" T_ALIAS_NAME ")[@:](" T_CHANNELS "{1,8})$", regex::icase);
+
 
 /*******************************************************************************
 * Function   : main()
@@ -95,16 +106,24 @@ int main(int argc, char* argv[])
     // regex patterns for parsing the command-line arguments
     const regex regex_help("^(?:/|-)?(?:H|Help|\\?)$", regex::icase);
     const regex regex_enumerate("^(?:ENUM|ENUMerate|L|List)$", regex::icase);
+    const regex regex_inventory("^INVentory$", regex::icase);
     const regex regex_set("^SET$", regex::icase);
     const regex regex_query("^(?:Q|Query)$", regex::icase);
+    const regex regex_rmw("^(?:TOGGLE|OR|ANDNOT|XOR|CAS)$", regex::icase);
+    const regex regex_wait("^WAIT$", regex::icase);
+    const regex regex_exec("^EXEC$", regex::icase);
+    const regex regex_sequence("^(?:SEQ|SEQuence)$", regex::icase);
+    const regex regex_steps("^STEPS$", regex::icase);
+    const regex regex_plan("^PLAN$", regex::icase);
     const regex regex_alias("^ALIAS$", regex::icase);
-
-    // regex patterns for parsing SET command
-    const regex regex_sernum_pattern("^(" T_ALIAS_NAME "):(" T_LOGIC_BITS "{1,8})$", regex::icase);
-    const regex regex_ch_set("^(" T_CHANNELS ")=(" T_LOGICS ")$", regex::icase);
-
-    // regex patterns for parsing QUERY command
-    const regex regex_query_chlist("^(" T_ALIAS_NAME ")[@:](" T_CHANNELS "{1,8})$", regex::icase);
+    const regex regex_serve("^SERVE$", regex::icase);
+    const regex regex_port("^[0-9]{1,5}$");
+    const regex regex_recording("^RECORDING$", regex::icase);
+    const regex regex_time("^[0-9]{1,20}$");
+    const regex regex_from("^--?FROM$", regex::icase);
+    const regex regex_tune("^TUNE$", regex::icase);
+    const regex regex_restore("^RESTORE$", regex::icase);
+    const regex regex_seconds("^[0-9]{1,7}$");
 
     // regex patterns for parsing ALIAS command
     const regex regex_alias_assign("^\\+?(" T_ALIAS_NAME ")[=:](" T_SERNUM ")$", regex::icase);
@@ -117,10 +136,30 @@ int main(int argc, char* argv[])
     // command-line parsing flags and variables
     bool is_help = false;
     bool is_enumerate = false;
+    bool is_inventory = false;
     bool is_query = false;
     bool is_set = false;
+    bool is_rmw = false;
+    bool is_wait = false;
+    bool is_exec = false;
+    bool is_sequence = false;
+    bool is_steps = false;
+    bool is_plan = false;
+    bool is_serve = false;
+    bool is_recording = false;
+    bool is_tune = false;
+    bool is_restore = false;
+    int seconds = -1;
+    unsigned short port = RELAY_SERVER_PORT;
+    string filename = "";
+    uint64_t time_us = 0;
     MODULE_SET module;
     MODULE_QUERIES queries;
+    MODULE_RMW rmws;
+    wait_t wait;
+    exec_t exec;
+    SEQUENCE_PROFILE profile;
+    STEP_GRAPH steps;
     MODULE_CHANNELS channels;
 
     if (num_args > 0)
@@ -141,188 +180,205 @@ int main(int argc, char* argv[])
             else
                 error = ERROR_CODES::SYNTAX;
         }
+        else if (regex_match(cmd, regex_inventory))
+        {   // INVENTORY
+            if (num_args == 1)
+                is_inventory = true;
+            else
+                error = ERROR_CODES::SYNTAX;
+        }
+        else if (regex_match(cmd, regex_recording))
+        {   // RECORDING file {time}
+            if (num_args == 2 || (num_args == 3 && regex_match(argv[3], regex_time)))
+            {
+                filename = argv[2];
+                if (num_args == 3)
+                    time_us = stoull(argv[3]);
+                is_recording = true;
+            }
+            else
+            {
+                error = ERROR_CODES::SYNTAX;
+            }
+        }
+        else if (regex_match(cmd, regex_restore))
+        {   // RESTORE {seconds} (modules need not be on the bus yet)
+            if (num_args == 1 || (num_args == 2 && regex_match(argv[2], regex_seconds)))
+            {
+                if (num_args == 2)
+                    seconds = stoi(argv[2]);
+                is_restore = true;
+            }
+            else
+            {
+                error = ERROR_CODES::SYNTAX;
+            }
+        }
         else
-        {
-            if (Relays_Get_Sernums(channels))
+        {   // modules come from the inventory; if one named is not there, it may
+            // have just been plugged in, so the bus is enumerated and it is parsed again
+            const bool live = regex_match(cmd, regex_serve) || regex_match(cmd, regex_tune);
+
+            for (int pass = 0; pass < 2; ++pass)
             {
-                if (regex_match(cmd, regex_alias) && num_args >= 1)
-                {   // process ALIAS parameters
-                    //   ALIAS alias[=:]sernum {...}
-                    //   ALIAS -alias {...}
-                    //   ALIAS
+                error = ERROR_CODES::NONE;
+                error_sernum = "";
+                module = MODULE_SET{};
+                queries = MODULE_QUERIES{};
+                rmws = MODULE_RMW{};
+                wait = wait_t{};
+                exec = exec_t{};
+                profile.clear();
+                steps.clear();
+
+                if (Relays_Get_Sernums(channels, live || pass > 0))
+                {
+                    if (regex_match(cmd, regex_alias) && num_args >= 1)
+                    {   // process ALIAS parameters
+                        //   ALIAS alias[=:]sernum {...}
+                        //   ALIAS -alias {...}
+                        //   ALIAS
 
-                    if (num_args == 1)
-                    {
-                        ListAlias();
-                    }
-                    else
-                    {
-                        for (auto i = num_args; (error == ERROR_CODES::NONE && i >= 2); --i)  // reverse order
+                        if (num_args == 1)
                         {
-                            string arg = argv[i];
-                            smatch smMatch;
-
-                            if (regex_match(arg, smMatch, regex_alias_assign))
-                            {
-                                AssignAlias(smMatch[1], smMatch[2]);
-                            }
-                            else if (regex_match(arg, smMatch, regex_alias_remove))
-                            {
-                                RemoveAlias(smMatch[1]);
-                            }
-                            else
-                            {   // something illegal here
-                                error = ERROR_CODES::SYNTAX;
-                            }
-                        }
-
-                        if (error == ERROR_CODES::NONE)
                             ListAlias();
-                    }
-                }
-                else if (regex_match(cmd, regex_set) && num_args>1)
-                {   // process SET parameters
-                    //   SET sernum:pattern sernum:pattern ...
-                    //   SET sernum ch=state ... sernum ch=state ...
-                    string cur_sn = "";
-                    smatch smMatch;
-
-                    for (auto i = 2; (error == ERROR_CODES::NONE && i <= num_args); ++i)
-                    {
-                        string arg = argv[i];
-
-                        if (regex_match(arg, smMatch, regex_alias_name))  // also matches just sernum
-                        {   // update to the newly specified serial number
-                            cur_sn = GetAliasSernum(smMatch[1]);
-                            if (!Is_Sernum_Present(cur_sn, channels))
-                            {
-                                error = ERROR_CODES::BAD_SERNUM;
-                                error_sernum = cur_sn;
-                            }
                         }
-                        else if (regex_match(arg, smMatch, regex_sernum_pattern))
-                        {   // update to the newly specified serial number, then use the pattern
-                            cur_sn = GetAliasSernum(smMatch[1]);
-                            if (Is_Sernum_Present(cur_sn, channels))
+                        else
+                        {
+                            for (auto i = num_args; (error == ERROR_CODES::NONE && i >= 2); --i)  // reverse order
                             {
-                                int num_channels = Relays_Get_NumChannels(cur_sn, channels);
-                                string pattern = smMatch[2];
-                                if (pattern.length() <= num_channels)
-                                {
-                                    module[cur_sn] = MODULE{};
-                                    for (auto j = 0; j < pattern.length(); ++j)
-                                        module[cur_sn]['1' + j] = get_state(pattern[j]);
-                                }
-                                else
+                                string arg = argv[i];
+                                smatch smMatch;
+
+                                if (regex_match(arg, smMatch, regex_alias_assign))
                                 {
-                                    error = ERROR_CODES::INVALID_CHANNEL;
+                                    AssignAlias(smMatch[1], smMatch[2]);
                                 }
-                            }
-                            else
-                            {
-                                error = ERROR_CODES::BAD_SERNUM;
-                                error_sernum = cur_sn;
-                            }
-                        }
-                        else if (regex_match(arg, smMatch, regex_ch_set))
-                        {
-                            if (!cur_sn.empty())
-                            {   
-                                int num_channels = Relays_Get_NumChannels(cur_sn, channels);
-                                if (!module.contains(cur_sn))
-                                    module[cur_sn] = MODULE{};
-                                string ch = smMatch[1];
-                                int nch = ch[0] - '0';
-                                if (nch <= num_channels)
+                                else if (regex_match(arg, smMatch, regex_alias_remove))
                                 {
-                                    string p = smMatch[2];
-                                    module[cur_sn][ch[0]] = get_state(p);
+                                    RemoveAlias(smMatch[1]);
                                 }
                                 else
-                                {
-                                    error = ERROR_CODES::INVALID_CHANNEL;
+                                {   // something illegal here
+                                    error = ERROR_CODES::SYNTAX;
                                 }
                             }
-                            else
-                            {   // sernum has not been set
-                                error = ERROR_CODES::SYNTAX;
-                            }
-                        }
-                        else
-                        {   // something illegal here
-                            error = ERROR_CODES::SYNTAX;
+
+                            if (error == ERROR_CODES::NONE)
+                                ListAlias();
                         }
                     }
+                    else if (regex_match(cmd, regex_set) && num_args == 3 && regex_match(argv[2], regex_from))
+                    {   // process SET --from table.csv (rows of name,channel,state)
+                        error = Parse_Set_File(argv[3], channels, module, error_sernum);
 
-                    if (error == ERROR_CODES::NONE)
-                        is_set = true;
-                }
-                else if (regex_match(cmd, regex_query))
-                {   // process QUERY parameters
-                    //   QUERY sernum sernum sernum
-                    //   QUERY sernum@chlist sernum@chlist ...
+                        if (error == ERROR_CODES::NONE)
+                            is_set = true;
+                    }
+                    else if (regex_match(cmd, regex_set) && num_args>1)
+                    {   // process SET parameters
+                        //   SET sernum:pattern sernum:pattern ...
+                        //   SET sernum ch=state ... sernum ch=state ...
+                        error = Parse_Set(vector<string>(argv + 2, argv + argc), channels, module, error_sernum);
 
-                    smatch smMatch;
+                        if (error == ERROR_CODES::NONE)
+                            is_set = true;
+                    }
+                    else if (regex_match(cmd, regex_query))
+                    {   // process QUERY parameters
+                        //   QUERY sernum sernum sernum
+                        //   QUERY sernum@chlist sernum@chlist ...
+                        error = Parse_Query(vector<string>(argv + 2, argv + argc), channels, queries, error_sernum);
 
-                    for (auto i = 2; (error == ERROR_CODES::NONE && i <= num_args); ++i)
-                    {
-                        string arg = argv[i];
+                        if (error == ERROR_CODES::NONE)
+                            is_query = true;
+                    }
+                    else if (regex_match(cmd, regex_rmw) && num_args > 1)
+                    {   // process read-modify-write parameters
+                        //   TOGGLE sernum{@chlist} ...
+                        //   OR|ANDNOT|XOR (same as SET, channels set to 1 form the mask)
+                        //   CAS sernum expected new
+                        error = Parse_Rmw(cmd, vector<string>(argv + 2, argv + argc), channels, rmws, error_sernum);
+
+                        if (error == ERROR_CODES::NONE)
+                            is_rmw = true;
+                    }
+                    else if (regex_match(cmd, regex_wait) && num_args > 1)
+                    {   // process WAIT parameters
+                        //   WAIT sernum:pattern {timeout}
+                        //   WAIT sernum ch=state {ch=state ...} {timeout}
+                        error = Parse_Wait(vector<string>(argv + 2, argv + argc), channels, wait, error_sernum);
+
+                        if (error == ERROR_CODES::NONE)
+                            is_wait = true;
+                    }
+                    else if (regex_match(cmd, regex_exec) && num_args > 1)
+                    {   // process EXEC clauses
+                        //   EXEC SET ... QUERY ... {SET ...} {QUERY ...}
+                        error = Parse_Exec(vector<string>(argv + 2, argv + argc), channels, exec, error_sernum);
+
+                        if (error == ERROR_CODES::NONE)
+                            is_exec = true;
+                    }
+                    else if (regex_match(cmd, regex_sequence) && (num_args == 2 || (num_args == 3 && regex_match(argv[3], regex_plan))))
+                    {   // process SEQUENCE profile.csv {PLAN} (rows of group,stagger_ms,name,channel)
+                        error = Parse_Sequence_File(argv[2], channels, profile, error_sernum);
+                        is_plan = (num_args == 3);
+
+                        if (error == ERROR_CODES::NONE)
+                            is_sequence = true;
+                    }
+                    else if (regex_match(cmd, regex_steps) && (num_args == 2 || (num_args == 3 && regex_match(argv[3], regex_plan))))
+                    {   // process STEPS graph.csv {PLAN} (rows of step,after,action)
+                        error = Parse_Steps_File(argv[2], channels, steps, error_sernum);
+                        is_plan = (num_args == 3);
 
-                        if (regex_match(arg, smMatch, regex_query_chlist))
+                        if (error == ERROR_CODES::NONE)
+                            is_steps = true;
+                    }
+                    else if (regex_match(cmd, regex_tune) && num_args == 1)
+                    {   // TUNE (measure and save the fan-out width)
+                        is_tune = true;
+                    }
+                    else if (regex_match(cmd, regex_serve) && num_args <= 3)
+                    {   // process SERVE parameters
+                        //   SERVE {port} {recording}
+                        for (auto i = 2; (error == ERROR_CODES::NONE && i <= num_args); ++i)
                         {
-                            queries_t q;
-                            q.sn = GetAliasSernum(smMatch[1]);
-                            int num_channels = Relays_Get_NumChannels(q.sn, channels);
+                            string arg = argv[i];
 
-                            if (Is_Sernum_Present(q.sn, channels))
+                            if (regex_match(arg, regex_port) && i == 2)
                             {
-                                q.q = smMatch[2];
-
-                                if (q.q.length() <= num_channels)
-                                    queries.push_back(q);
+                                if (stoi(arg) > 0 && stoi(arg) <= 65535)
+                                    port = (unsigned short)stoi(arg);
                                 else
-                                    error = ERROR_CODES::INVALID_CHANNEL;
+                                    error = ERROR_CODES::SYNTAX;
                             }
-                            else
+                            else if (filename.empty())
                             {
-                                error = ERROR_CODES::BAD_SERNUM;
-                                error_sernum = q.sn;
-                            }
-                        }
-                        else if (regex_match(arg, smMatch, regex_alias_name))  // also matches sernum
-                        {
-                            queries_t q;
-                            q.sn = GetAliasSernum(smMatch[1]);
-                            int num_channels = Relays_Get_NumChannels(q.sn, channels);
-
-                            if (Is_Sernum_Present(q.sn, channels))
-                            {   // all channels
-                                q.q = "";
-                                queries.push_back(q);
+                                filename = arg;
                             }
                             else
                             {
-                                error = ERROR_CODES::BAD_SERNUM;
-                                error_sernum = q.sn;
+                                error = ERROR_CODES::SYNTAX;
                             }
                         }
-                        else
-                        {   // something illegal here
-                            error = ERROR_CODES::SYNTAX;
-                        }
-                    }
 
-                    if (error == ERROR_CODES::NONE)
-                        is_query = true;
+                        if (error == ERROR_CODES::NONE)
+                            is_serve = true;
+                    }
+                    else
+                    {   // something we don't recognize - syntax error
+                        error = ERROR_CODES::SYNTAX;
+                    }
                 }
                 else
-                {   // something we don't recognize - syntax error
-                    error = ERROR_CODES::SYNTAX;
+                {   // DLL call returned no devices or otherwise failed
+                    error = ERROR_CODES::NO_DEVICES;
                 }
-            }
-            else
-            {   // DLL call returned no devices or otherwise failed
-                error = ERROR_CODES::NO_DEVICES;
+
+                if (live || (error != ERROR_CODES::BAD_SERNUM && error != ERROR_CODES::NO_DEVICES))
+                    break;
             }
         }
     }
@@ -341,165 +397,1324 @@ int main(int argc, char* argv[])
         {
             error = Relays_Enumerate();
         }
-        else if (is_set)
+        else if (is_inventory)
+        {
+            error = Relays_Inventory();
+        }
+        else if (is_set || is_query || is_rmw || is_wait || is_exec || is_sequence || is_steps || is_tune || is_restore)
+        {   // the modules' threads share one context (driver and open modules)
+            Relay_Context context;
+
+            if (!context.Is_Initialized())
+            {
+                error = ERROR_CODES::NO_DRIVER_INIT;
+            }
+            else if (is_set)
+            {
+                error = Relays_Set(context, module, channels, error_sernum);
+            }
+            else if (is_query)
+            {
+                error = Relays_Query(context, queries, channels, error_sernum);
+            }
+            else if (is_rmw)
+            {
+                error = Relays_Rmw(context, rmws, channels, error_sernum);
+            }
+            else if (is_wait)
+            {
+                error = Relays_Wait(context, wait, channels);
+                error_sernum = wait.sn;
+            }
+            else if (is_exec)
+            {
+                error = Relays_Exec(context, exec, channels, error_sernum);
+            }
+            else if (is_sequence)
+            {
+                error = Relays_Sequence(context, profile, channels, is_plan, error_sernum);
+            }
+            else if (is_steps)
+            {
+                error = Relays_Steps(context, steps, channels, is_plan, error_sernum);
+            }
+            else if (is_tune)
+            {
+                int width = 0;
+                error = Relays_Tune(context, channels, true, width);
+            }
+            else if (is_restore)
+            {
+                error = Relays_Restore(context, seconds >= 0, seconds, error_sernum);
+            }
+        }
+        else if (is_recording)
+        {
+            error = Relays_Recording(filename, num_args == 3, time_us);
+        }
+        else if (is_serve)
+        {
+            error = Relays_Serve(port, channels, filename);
+        }
+    }
+
+    if (error != ERROR_CODES::NONE)
+        std::cerr << Error_Message(error, error_sernum);
+
+    return int(error);
+}
+
+
+/*******************************************************************************
+* Function   : PrintUsage
+* Arguments  : strProgName  = name of the program (*.exe)
+* Returns    : none
+* Description:
+*   This function simply prints the command-line usage to std::cout
+*/
+void PrintUsage(std::string strProgName)
+{
+    std::cout << "USB HID Relay utility v" << APP_VERSION << "\n";
+    std::cout << "Kerry S. Martin, martin@wild-wood.net\n";
+    std::cout << "Usage:\n";
+    std::cout << "  " << strProgName << " ENUMerate|list                              # list all devices by sn(#channels)\n";
+    std::cout << "  " << strProgName << " INVentory                                   # every device ever seen, with details\n";
+    std::cout << "  " << strProgName << " Query sernum {sernum ...}                   # query all channels for specific SNs\n";
+    std::cout << "  " << strProgName << " Query sernum@chlist {sernum@chlist ...}     # query given channels for specifc SNs\n";
+    std::cout << "  " << strProgName << " SET sernum:pattern {sernum:pattern ...}     # set given patterns on specific SNs\n";
+    std::cout << "  " << strProgName << " SET sernum ch=state {ch=state ...}          # set given channels on specific SNs\n";
+    std::cout << "  " << strProgName << " SET --from table.csv                        # set channels from rows of sernum,ch,state\n";
+    std::cout << "  " << strProgName << " TOGGLE sernum{@chlist} {...}                # invert channels, show new states\n";
+    std::cout << "  " << strProgName << " OR|ANDNOT|XOR sernum:pattern {...}          # 1s in pattern turn on|off|invert\n";
+    std::cout << "  " << strProgName << " CAS sernum expected new                     # set new only if state matches expected\n";
+    std::cout << "  " << strProgName << " WAIT sernum:pattern {timeout}               # wait for pattern, show time and state\n";
+    std::cout << "  " << strProgName << " EXEC SET ... QUERY ...                      # sets, then queries, each module opened once\n";
+    std::cout << "  " << strProgName << " SEQuence profile.csv {PLAN}                 # staggered turn-on from rows of group,stagger_ms,sernum,ch\n";
+    std::cout << "  " << strProgName << " STEPS graph.csv {PLAN}                      # run dependent steps from rows of step,after,action\n";
+    std::cout << "  " << strProgName << " ALIAS                                       # list sernum aliases\n";
+    std::cout << "  " << strProgName << " ALIAS alias=sernum                          # create new alias\n";
+    std::cout << "  " << strProgName << " ALIAS -alias                                # delete alias\n";
+    std::cout << "  " << strProgName << " TUNE                                        # measure and save modules handled at once\n";
+    std::cout << "  " << strProgName << " RESTORE {seconds}                           # write the last saved states (keep watching)\n";
+    std::cout << "  " << strProgName << " SERVE {port} {recording}                    # long-running server on localhost\n";
+    std::cout << "  " << strProgName << " RECORDING recording {time}                  # summary, or all states at time\n\n";
+    std::cout << "    sernum = 5-character serial number\n";
+    std::cout << "    state = 0|1|OFF|ON|L|H|NO|NC\n";
+    std::cout << "    pattern = qq...    where q = 0|1|L|H|X\n";
+    std::cout << "    alias = starts with alphanum and -_#@~ (does not begin with -)\n";
+    std::cout << "    alias may replace any serial number\n";
+    std::cout << "    time = microseconds since 1970-01-01 UTC\n";
+    std::cout << "    timeout = milliseconds (default is to wait forever)\n";
+    std::cout << "    seconds = keep restoring modules as they appear (0 = until stopped)\n";
+    std::cout << "    quirks = S (reports extra status bits), T (timed out), E (I/O errors)\n";
+}
+
+
+/*******************************************************************************
+* Function   : strip_path()
+* Arguments  : filename = full filename to the file
+* Returns    : just the base filename, without the path
+* Description:
+*   This function strips the pathname from a filename.
+*   ex/ C:\Projects\MyProject\Release\MyProject.exe => MyProject.exe
+*/
+string strip_path(string filename)
+{
+    const regex re("^(?:.*)(?:\\/|\\\\)(.+?)$");
+    smatch smMatch;
+
+    if (regex_match(filename, smMatch, re))
+        return smMatch[1];
+    else
+        return filename;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Set
+* Arguments  : args          = SET arguments (command line or server request)
+*              channels      = structure of enumerated channels
+*              modules       = receives the modules/channels to set
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function parses the SET arguments into a structure of modules/channels
+*     sernum:pattern sernum:pattern ...
+*     sernum ch=state ... sernum ch=state ...
+*/
+ERROR_CODES Parse_Set(const vector<string>& args, const MODULE_CHANNELS& channels, MODULE_SET& modules, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    string cur_sn = "";
+    smatch smMatch;
+
+    for (auto i = 0; (error == ERROR_CODES::NONE && i < args.size()); ++i)
+    {
+        string arg = args[i];
+
+        if (regex_match(arg, smMatch, regex_alias_name))  // also matches just sernum
+        {   // update to the newly specified serial number
+            cur_sn = GetAliasSernum(smMatch[1]);
+            if (!Is_Sernum_Present(cur_sn, channels))
+            {
+                error = ERROR_CODES::BAD_SERNUM;
+                error_sernum = cur_sn;
+            }
+        }
+        else if (regex_match(arg, smMatch, regex_sernum_pattern))
+        {   // update to the newly specified serial number, then use the pattern
+            cur_sn = GetAliasSernum(smMatch[1]);
+            if (Is_Sernum_Present(cur_sn, channels))
+            {
+                int num_channels = Relays_Get_NumChannels(cur_sn, channels);
+                string pattern = smMatch[2];
+                if (pattern.length() <= num_channels)
+                {
+                    modules[cur_sn] = MODULE{};
+                    for (auto j = 0; j < pattern.length(); ++j)
+                        modules[cur_sn]['1' + j] = get_state(pattern[j]);
+                }
+                else
+                {
+                    error = ERROR_CODES::INVALID_CHANNEL;
+                }
+            }
+            else
+            {
+                error = ERROR_CODES::BAD_SERNUM;
+                error_sernum = cur_sn;
+            }
+        }
+        else if (regex_match(arg, smMatch, regex_ch_set))
+        {
+            if (!cur_sn.empty())
+            {
+                int num_channels = Relays_Get_NumChannels(cur_sn, channels);
+                if (!modules.contains(cur_sn))
+                    modules[cur_sn] = MODULE{};
+                string ch = smMatch[1];
+                int nch = ch[0] - '0';
+                if (nch <= num_channels)
+                {
+                    string p = smMatch[2];
+                    modules[cur_sn][ch[0]] = get_state(p);
+                }
+                else
+                {
+                    error = ERROR_CODES::INVALID_CHANNEL;
+                }
+            }
+            else
+            {   // sernum has not been set
+                error = ERROR_CODES::SYNTAX;
+            }
+        }
+        else
+        {   // something illegal here
+            error = ERROR_CODES::SYNTAX;
+        }
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Set_File
+* Arguments  : filename      = CSV file, one row per channel: name,channel,state
+*              channels      = structure of enumerated channels
+*              modules       = receives the modules/channels to set
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads the channels to set from a table, one row at a time.
+*   name is an alias or sernum, and is resolved through one index of the
+*   aliases and enumerated modules; state is as in SET (ON|1|H|NO|OFF|0|L|NC).
+*   Fields may be quoted; blank lines, # comments and a first row that is
+*   the heading (name,channel,state) are skipped, and a later row for the
+*   same channel replaces an earlier one. The file and line of a bad row are
+*   written to cerr.
+*/
+ERROR_CODES Parse_Set_File(const string& filename, const MODULE_CHANNELS& channels, MODULE_SET& modules, string& error_sernum)
+{
+    static const map<string, LOGIC> states = {
+        { "ON", LOGIC::H }, { "1", LOGIC::H }, { "H", LOGIC::H }, { "NO", LOGIC::H },
+        { "OFF", LOGIC::L }, { "0", LOGIC::L }, { "L", LOGIC::L }, { "NC", LOGIC::L } };
+
+    ifstream file(filename);
+
+    if (!file)
+        return ERROR_CODES::BAD_FILE;
+
+    const unordered_map<string, string> index = Alias_Index(channels);
+    ERROR_CODES error = ERROR_CODES::NONE;
+    string line;
+    int line_no = 0;
+    bool first_row = true;
+
+    while (error == ERROR_CODES::NONE && getline(file, line))
+    {
+        const vector<string> fields = Csv_Fields(line);
+
+        ++line_no;
+
+        if (fields[0].empty() || fields[0][0] == '#')
+            continue;
+
+        if (exchange(first_row, false) && Csv_Heading(fields, { "NAME", "CHANNEL", "STATE" }))
+            continue;
+
+        const bool is_number = fields.size() >= 2 && !fields[1].empty() && fields[1].find_first_not_of("0123456789") == string::npos;
+        auto state = (fields.size() == 3) ? states.find(fields[2]) : states.end();
+
+        if (!is_number || state == states.end())
+        {
+            error = ERROR_CODES::SYNTAX;
+        }
+        else
+        {
+            auto it = index.find(fields[0]);
+
+            if (it == index.end() || !Is_Sernum_Present(it->second, channels))
+            {
+                error = ERROR_CODES::BAD_SERNUM;
+                error_sernum = (it == index.end()) ? fields[0] : it->second;
+            }
+            else if (fields[1].size() != 1 || fields[1][0] < RELAY_IDX_MIN
+                || fields[1][0] - RELAY_IDX_MIN >= Relays_Get_NumChannels(it->second, channels))
+            {
+                error = ERROR_CODES::INVALID_CHANNEL;
+            }
+            else
+            {
+                modules[it->second][fields[1][0]] = state->second;
+            }
+        }
+    }
+
+    if (error != ERROR_CODES::NONE)
+        std::cerr << filename << "(" << line_no << "): ";
+    else if (modules.empty())
+        error = ERROR_CODES::SYNTAX;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Sequence_File
+* Arguments  : filename      = CSV file, one row per channel: group,stagger_ms,name,channel
+*              channels      = structure of enumerated channels
+*              profile       = receives the groups, in the order first seen
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads a power-sequencing profile. The channels of a group
+*   are turned on in the order of their rows, at least stagger_ms apart;
+*   every row of a group must give the same stagger. name is an alias or
+*   sernum. A channel may appear only once in the whole profile. Fields may
+*   be quoted; blank lines and # comments are skipped, and so is a first row
+*   that is the heading (group,stagger_ms,name,channel, or sernum for name).
+*   The file and line of a bad row are written to cerr.
+*/
+ERROR_CODES Parse_Sequence_File(const string& filename, const MODULE_CHANNELS& channels, SEQUENCE_PROFILE& profile, string& error_sernum)
+{
+    const regex regex_stagger("^[0-9]{1,7}$");
+
+    ifstream file(filename);
+
+    if (!file)
+        return ERROR_CODES::BAD_FILE;
+
+    const unordered_map<string, string> index = Alias_Index(channels);
+    map<string, size_t> groups;             // name -> profile[]
+    map<pair<string, int>, bool> seen;      // channels already in the profile
+    ERROR_CODES error = ERROR_CODES::NONE;
+    string line;
+    int line_no = 0;
+    bool first_row = true;
+
+    while (error == ERROR_CODES::NONE && getline(file, line))
+    {
+        const vector<string> fields = Csv_Fields(line);
+
+        ++line_no;
+
+        if (fields[0].empty() || fields[0][0] == '#')
+            continue;
+
+        if (exchange(first_row, false) && (Csv_Heading(fields, { "GROUP", "STAGGER_MS", "NAME", "CHANNEL" })
+            || Csv_Heading(fields, { "GROUP", "STAGGER_MS", "SERNUM", "CHANNEL" })))
+            continue;
+
+        if (fields.size() != 4 || !regex_match(fields[1], regex_stagger))
+        {
+            error = ERROR_CODES::SYNTAX;
+            continue;
+        }
+
+        auto it = index.find(fields[2]);
+
+        if (it == index.end() || !Is_Sernum_Present(it->second, channels))
+        {
+            error = ERROR_CODES::BAD_SERNUM;
+            error_sernum = (it == index.end()) ? fields[2] : it->second;
+        }
+        else if (fields[3].size() != 1 || fields[3][0] < RELAY_IDX_MIN
+            || fields[3][0] - RELAY_IDX_MIN >= Relays_Get_NumChannels(it->second, channels))
+        {
+            error = ERROR_CODES::INVALID_CHANNEL;
+        }
+        else
+        {
+            const uint32_t stagger_ms = uint32_t(stoul(fields[1]));
+            const pair<string, int> channel(it->second, fields[3][0] - RELAY_IDX_MIN + 1);
+
+            if (!groups.count(fields[0]))
+            {
+                groups[fields[0]] = profile.size();
+                profile.push_back(sequence_group_t{ fields[0], stagger_ms, {} });
+            }
+
+            sequence_group_t& group = profile[groups[fields[0]]];
+
+            if (group.stagger_ms != stagger_ms || seen[channel])
+                error = ERROR_CODES::SYNTAX;
+
+            seen[channel] = true;
+            group.channels.push_back(channel);
+        }
+    }
+
+    if (error != ERROR_CODES::NONE)
+        std::cerr << filename << "(" << line_no << "): ";
+    else if (profile.empty())
+        error = ERROR_CODES::SYNTAX;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Steps_File
+* Arguments  : filename      = CSV file, one row per step: name,after,action
+*              channels      = structure of enumerated channels
+*              steps         = receives the steps, in the order of the file
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads a graph of steps. action sets channels of one module,
+*   as in SET (sernum:pattern or sernum ch=state ...). after lists the steps
+*   this one comes after, separated by spaces, each optionally followed by
+*   +ms, a delay from the end of that step (e.g., "B+50 D+50"); it may be
+*   empty. Steps may come after steps further down the file, but not (even
+*   indirectly) after themselves. Fields may be quoted; blank lines, #
+*   comments and a heading row (step,after,action as the first row) are
+*   skipped. The file and line of a bad row are written to cerr.
+*/
+ERROR_CODES Parse_Steps_File(const string& filename, const MODULE_CHANNELS& channels, STEP_GRAPH& steps, string& error_sernum)
+{
+    const regex regex_step_name("^[-_A-Z0-9]{1,32}$");
+    const regex regex_after("^([-_A-Z0-9]{1,32})(?:\\+([0-9]{1,7}))?$");
+
+    ifstream file(filename);
+
+    if (!file)
+        return ERROR_CODES::BAD_FILE;
+
+    map<string, size_t> names;              // name -> steps[]
+    vector<pair<vector<string>, int>> afters;   // after field of each step, and its line
+    ERROR_CODES error = ERROR_CODES::NONE;
+    string line;
+    int line_no = 0;
+    bool first_row = true;
+
+    while (error == ERROR_CODES::NONE && getline(file, line))
+    {
+        const vector<string> fields = Csv_Fields(line);
+
+        ++line_no;
+
+        if (fields[0].empty() || fields[0][0] == '#')
+            continue;
+
+        if (exchange(first_row, false) && Csv_Heading(fields, { "STEP", "AFTER", "ACTION" }))
+            continue;
+
+        if (fields.size() != 3 || !regex_match(fields[0], regex_step_name) || names.count(fields[0]))
+        {
+            error = ERROR_CODES::SYNTAX;
+            continue;
+        }
+
+        istringstream action(fields[2]);
+        vector<string> args;
+        string arg;
+        MODULE_SET modules;
+
+        while (action >> arg)
+            args.push_back(arg);
+
+        error = args.empty() ? ERROR_CODES::SYNTAX : Parse_Set(args, channels, modules, error_sernum);
+
+        if (error == ERROR_CODES::NONE && modules.size() != 1)
+            error = ERROR_CODES::SYNTAX;
+
+        if (error == ERROR_CODES::NONE)
+        {
+            auto const& [sernum, module] = *modules.begin();
+            const int num_channels = Relays_Get_NumChannels(sernum, channels);
+            step_t step;
+            istringstream after(fields[1]);
+
+            step.name = fields[0];
+            step.sn = sernum;
+            step.set_mask = Module_Mask(module, LOGIC::H, num_channels);
+            step.clear_mask = Module_Mask(module, LOGIC::L, num_channels);
+
+            names[step.name] = steps.size();
+            steps.push_back(step);
+            afters.emplace_back(vector<string>(), line_no);
+
+            while (after >> arg)
+                afters.back().first.push_back(arg);
+        }
+    }
+
+    // resolve the steps each comes after (line_no is that of the bad step)
+    for (size_t i = 0; i < afters.size() && error == ERROR_CODES::NONE; ++i)
+    {
+        line_no = afters[i].second;
+
+        for (string const& a : afters[i].first)
+        {
+            smatch match;
+
+            if (!regex_match(a, match, regex_after) || !names.count(match[1].str()) || names[match[1].str()] == i)
+            {
+                error = ERROR_CODES::SYNTAX;
+                break;
+            }
+
+            steps[i].after.emplace_back(names[match[1].str()], match[2].matched ? uint32_t(stoul(match[2].str())) : 0);
+        }
+    }
+
+    // no cycles: every step can be ordered after the steps it comes after
+    if (error == ERROR_CODES::NONE)
+    {
+        vector<size_t> waiting(steps.size());
+        vector<size_t> ready;
+        size_t ordered = 0;
+
+        for (size_t i = 0; i < steps.size(); ++i)
+        {
+            waiting[i] = steps[i].after.size();
+            if (waiting[i] == 0)
+                ready.push_back(i);
+        }
+
+        while (!ready.empty())
+        {
+            const size_t done = ready.back();
+            ready.pop_back();
+            ++ordered;
+
+            for (size_t i = 0; i < steps.size(); ++i)
+            {
+                for (auto const& [step, delay_ms] : steps[i].after)
+                {
+                    if (step == done && --waiting[i] == 0)
+                        ready.push_back(i);
+                }
+            }
+        }
+
+        if (ordered != steps.size())
+        {
+            error = ERROR_CODES::SYNTAX;
+            line_no = 0;    // a cycle, not one bad row
+        }
+    }
+
+    if (error != ERROR_CODES::NONE && line_no == 0)
+        std::cerr << filename << ": ";
+    else if (error != ERROR_CODES::NONE)
+        std::cerr << filename << "(" << line_no << "): ";
+    else if (steps.empty())
+        error = ERROR_CODES::SYNTAX;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Csv_Fields
+* Arguments  : line  = one line of a CSV file
+* Returns    : its fields, in upper case (at least one)
+* Description:
+*   This function splits a line on commas, dropping spaces, quotes and a
+*   trailing CR around each field
+*/
+vector<string> Csv_Fields(const string& line)
+{
+    vector<string> fields;
+    size_t pos = 0;
+
+    while (pos <= line.size())
+    {
+        size_t end = line.find(',', pos);
+        if (end == string::npos)
+            end = line.size();
+
+        string field = line.substr(pos, end - pos);
+        field.erase(0, field.find_first_not_of(" \t\r\""));
+        field.erase(field.find_last_not_of(" \t\r\"") + 1);
+        std::transform(field.begin(), field.end(), field.begin(), ::toupper);
+        fields.push_back(field);
+
+        pos = end + 1;
+    }
+
+    return fields;
+}
+
+
+/*******************************************************************************
+* Function   : Csv_Heading
+* Arguments  : fields   = fields of a row (see Csv_Fields)
+*              columns  = names of the file's columns, in upper case
+* Returns    : true if the row is a heading
+* Description:
+*   This function recognizes a heading row by its text: the row must name
+*   exactly the file's columns, in order. Any other row is data, so a bad
+*   first row is reported rather than skipped.
+*/
+bool Csv_Heading(const vector<string>& fields, const vector<string>& columns)
+{
+    return fields == columns;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Query
+* Arguments  : args          = QUERY arguments (command line or server request)
+*              channels      = structure of enumerated channels
+*              queries       = receives the modules/channels to query
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function parses the QUERY arguments into a list of modules/channels
+*     sernum sernum sernum
+*     sernum@chlist sernum@chlist ...
+*/
+ERROR_CODES Parse_Query(const vector<string>& args, const MODULE_CHANNELS& channels, MODULE_QUERIES& queries, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    smatch smMatch;
+
+    for (auto i = 0; (error == ERROR_CODES::NONE && i < args.size()); ++i)
+    {
+        string arg = args[i];
+
+        if (regex_match(arg, smMatch, regex_query_chlist))
+        {
+            queries_t q;
+            q.sn = GetAliasSernum(smMatch[1]);
+            int num_channels = Relays_Get_NumChannels(q.sn, channels);
+
+            if (Is_Sernum_Present(q.sn, channels))
+            {
+                q.q = smMatch[2];
+
+                if (q.q.length() <= num_channels)
+                    queries.push_back(q);
+                else
+                    error = ERROR_CODES::INVALID_CHANNEL;
+            }
+            else
+            {
+                error = ERROR_CODES::BAD_SERNUM;
+                error_sernum = q.sn;
+            }
+        }
+        else if (regex_match(arg, smMatch, regex_alias_name))  // also matches sernum
+        {
+            queries_t q;
+            q.sn = GetAliasSernum(smMatch[1]);
+
+            if (Is_Sernum_Present(q.sn, channels))
+            {   // all channels
+                q.q = "";
+                queries.push_back(q);
+            }
+            else
+            {
+                error = ERROR_CODES::BAD_SERNUM;
+                error_sernum = q.sn;
+            }
+        }
+        else
+        {   // something illegal here
+            error = ERROR_CODES::SYNTAX;
+        }
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Exec
+* Arguments  : args          = EXEC arguments: clauses, each SET or QUERY followed
+*                              by the same arguments as the command
+*              channels      = structure of enumerated channels
+*              exec          = receives the sets and queries
+*              error_sernum  = receives the offending sernum
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function parses the clauses of an EXEC command. Each clause is
+*   parsed on its own, so a SET clause must name its modules (a sernum does
+*   not carry over from an earlier clause); the SET clauses are then taken
+*   together as one SET, and the QUERY clauses as one QUERY.
+*/
+ERROR_CODES Parse_Exec(const vector<string>& args, const MODULE_CHANNELS& channels, exec_t& exec, string& error_sernum)
+{
+    const regex regex_set("^SET$", regex::icase);
+    const regex regex_query("^(?:Q|Query)$", regex::icase);
+
+    vector<pair<bool, vector<string>>> clauses;     // is a SET clause, its arguments
+    ERROR_CODES error = ERROR_CODES::NONE;
+
+    for (string const& arg : args)
+    {
+        if (regex_match(arg, regex_set))
+            clauses.emplace_back(true, vector<string>());
+        else if (regex_match(arg, regex_query))
+            clauses.emplace_back(false, vector<string>());
+        else if (!clauses.empty())
+            clauses.back().second.push_back(arg);
+        else
+            return ERROR_CODES::SYNTAX;     // arguments before the first clause
+    }
+
+    if (clauses.empty())
+        return ERROR_CODES::SYNTAX;
+
+    for (auto const& [is_set, clause] : clauses)
+    {
+        if (clause.empty())
+            error = ERROR_CODES::SYNTAX;
+        else if (is_set)
+            error = Parse_Set(clause, channels, exec.sets, error_sernum);
+        else
+            error = Parse_Query(clause, channels, exec.queries, error_sernum);
+
+        if (error != ERROR_CODES::NONE)
+            break;
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Wait
+* Arguments  : args          = WAIT arguments (command line or server request)
+*              channels      = structure of enumerated channels
+*              wait          = receives the module, pattern and timeout
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function parses the WAIT arguments: the pattern of one module in the
+*   same syntax as SET (X = any state), optionally followed by a timeout in
+*   milliseconds
+*     sernum:pattern {timeout}
+*     sernum ch=state ... {timeout}
+*/
+ERROR_CODES Parse_Wait(const vector<string>& args, const MODULE_CHANNELS& channels, wait_t& wait, string& error_sernum)
+{
+    const regex regex_timeout("^[0-9]{1,9}$");
+
+    vector<string> pattern = args;
+    MODULE_SET modules;
+
+    if (pattern.size() > 1 && regex_match(pattern.back(), regex_timeout))
+    {
+        wait.timeout_ms = stoll(pattern.back());
+        pattern.pop_back();
+    }
+
+    ERROR_CODES error = Parse_Set(pattern, channels, modules, error_sernum);
+
+    if (error == ERROR_CODES::NONE && modules.size() != 1)
+        error = ERROR_CODES::SYNTAX;
+
+    if (error == ERROR_CODES::NONE)
+    {
+        auto const& [sernum, module] = *modules.begin();
+        int num_channels = Relays_Get_NumChannels(sernum, channels);
+
+        wait.sn = sernum;
+        wait.expect_mask = Module_Mask(module, LOGIC::H, num_channels);
+        wait.care_mask = wait.expect_mask | Module_Mask(module, LOGIC::L, num_channels);
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Parse_Rmw
+* Arguments  : op            = TOGGLE, OR, ANDNOT, XOR or CAS
+*              args          = arguments of the operation
+*              channels      = structure of enumerated channels
+*              rmws          = receives one operation per module
+*              error_sernum  = receives the offending sernum on BAD_SERNUM
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function parses a read-modify-write operation
+*     TOGGLE sernum{@chlist} ...          # same syntax as QUERY
+*     OR|ANDNOT|XOR ...                   # same syntax as SET, 1s form the mask
+*     CAS sernum expected new             # patterns as in SET (X = any/unchanged)
+*/
+ERROR_CODES Parse_Rmw(const string& op, const vector<string>& args, const MODULE_CHANNELS& channels, MODULE_RMW& rmws, string& error_sernum)
+{
+    const regex regex_toggle("^TOGGLE$", regex::icase);
+    const regex regex_or("^OR$", regex::icase);
+    const regex regex_andnot("^ANDNOT$", regex::icase);
+    const regex regex_cas("^CAS$", regex::icase);
+    const regex regex_pattern("^" T_LOGIC_BITS "{1,8}$", regex::icase);
+
+    ERROR_CODES error = ERROR_CODES::NONE;
+
+    if (regex_match(op, regex_toggle))
+    {
+        MODULE_QUERIES queries;
+        error = Parse_Query(args, channels, queries, error_sernum);
+
+        for (queries_t Q : queries)
+        {
+            rmw_t r;
+            r.sn = Q.sn;
+            r.toggle_mask = Query_Mask(Q.q, Relays_Get_NumChannels(Q.sn, channels));
+            rmws.push_back(r);
+        }
+    }
+    else if (regex_match(op, regex_cas))
+    {
+        MODULE_SET expected, requested;
+
+        if (args.size() == 3 && regex_match(args[1], regex_pattern) && regex_match(args[2], regex_pattern))
+        {
+            error = Parse_Set({ args[0] + ":" + args[1] }, channels, expected, error_sernum);
+            if (error == ERROR_CODES::NONE)
+                error = Parse_Set({ args[0] + ":" + args[2] }, channels, requested, error_sernum);
+        }
+        else
+        {
+            error = ERROR_CODES::SYNTAX;
+        }
+
+        for (auto const& [sernum, module] : expected)
+        {
+            int num_channels = Relays_Get_NumChannels(sernum, channels);
+            rmw_t r;
+            r.sn = sernum;
+            r.expect_mask = Module_Mask(module, LOGIC::H, num_channels);
+            r.care_mask = r.expect_mask | Module_Mask(module, LOGIC::L, num_channels);
+            r.set_mask = Module_Mask(requested[sernum], LOGIC::H, num_channels);
+            r.clear_mask = Module_Mask(requested[sernum], LOGIC::L, num_channels);
+            rmws.push_back(r);
+        }
+    }
+    else
+    {
+        MODULE_SET modules;
+        error = Parse_Set(args, channels, modules, error_sernum);
+
+        for (auto const& [sernum, module] : modules)
+        {
+            rmw_t r;
+            unsigned mask = Module_Mask(module, LOGIC::H, Relays_Get_NumChannels(sernum, channels));
+            r.sn = sernum;
+            if (regex_match(op, regex_or))
+                r.set_mask = mask;
+            else if (regex_match(op, regex_andnot))
+                r.clear_mask = mask;
+            else
+                r.toggle_mask = mask;
+            rmws.push_back(r);
+        }
+    }
+
+    if (error == ERROR_CODES::NONE && rmws.empty())
+        error = ERROR_CODES::SYNTAX;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Module_Mask
+* Arguments  : module        = channels to set for one module
+*              state         = LOGIC::H or LOGIC::L
+*              num_channels  = number of channels on the module
+* Returns    : bitmask of the channels set to 'state' (bit 0 = channel 1)
+* Description:
+*   This function converts the channel map of a module into a bitmask
+*/
+unsigned Module_Mask(const MODULE& module, LOGIC state, int num_channels)
+{
+    const unsigned all = (1u << num_channels) - 1;
+    unsigned mask = 0;
+
+    for (auto const& [ch, st] : module)
+    {
+        if (st == state)
+        {
+            if (ch == RELAY_IDX_ALL)
+                mask = all;
+            else
+                mask |= 1u << (ch - RELAY_IDX_MIN);
+        }
+    }
+
+    return mask & all;
+}
+
+
+/*******************************************************************************
+* Function   : Query_Mask
+* Arguments  : chlist        = list of channels (e.g., "1456"), or empty for all
+*              num_channels  = number of channels on the module
+* Returns    : bitmask of the listed channels (bit 0 = channel 1)
+* Description:
+*   This function converts a channel list into a bitmask
+*/
+unsigned Query_Mask(const string& chlist, int num_channels)
+{
+    const unsigned all = (1u << num_channels) - 1;
+    unsigned mask = 0;
+
+    if (chlist.empty())
+        return all;
+
+    for (char c : chlist)
+    {
+        if (c >= RELAY_IDX_MIN && c <= RELAY_IDX_MAX)
+            mask |= 1u << (c - RELAY_IDX_MIN);
+    }
+
+    return mask & all;
+}
+
+
+/*******************************************************************************
+* Function   : Mask_Bits
+* Arguments  : mask          = channel bitmask (bit 0 = channel 1)
+*              num_channels  = number of channels on the module
+* Returns    : pattern string, channel 1 first (e.g., "01100000")
+* Description:
+*   This function formats a bitmask like the QUERY output
+*/
+string Mask_Bits(unsigned mask, int num_channels)
+{
+    string bits;
+
+    for (int ch = 0; ch < num_channels; ++ch)
+        bits += (mask & (1u << ch)) ? '1' : '0';
+
+    return bits;
+}
+
+
+/*******************************************************************************
+* Function   : Pattern_Bits
+* Arguments  : care          = channels in the pattern
+*              expect        = their state
+*              num_channels  = number of channels on the module
+* Returns    : the pattern (e.g., "1X0X")
+* Description:
+*   This function formats a pattern as SET and WAIT take it
+*/
+string Pattern_Bits(unsigned care, unsigned expect, int num_channels)
+{
+    string bits = "";
+
+    for (int ch = 0; ch < num_channels; ++ch)
+        bits += !(care & (1u << ch)) ? 'X' : (expect & (1u << ch)) ? '1' : '0';
+
+    return bits;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Set
+* Arguments  : context       = open modules
+*              modules       = structure of modules/channels to set
+*              channels      = structure of enumerated channels
+*              error_sernum  = receives the sernums of modules that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function sets individual relays in the modules to open or closed.
+*   The modules are handled in parallel, as many at once as the fan-out
+*   width tuned for this host, so a slow or wedged module does not hold up
+*   the others.
+*/
+ERROR_CODES Relays_Set(Relay_Context& context, const MODULE_SET& modules, const MODULE_CHANNELS& channels, string& error_sernum)
+{
+    ERROR_CODES return_value = ERROR_CODES::NONE;
+    vector<string> sernums;
+    vector<const MODULE*> sets;
+    vector<ERROR_CODES> results(modules.size(), ERROR_CODES::NONE);
+
+    for (auto const& [sernum, module] : modules)
+    {
+        string sn = sernum.empty() ? channels[0].sn : sernum;
+
+        // sernum is exactly 5 characters
+        sn.resize(5);
+        std::transform(sn.begin(), sn.end(), sn.begin(), ::toupper);
+
+        sernums.push_back(sn);
+        sets.push_back(&module);
+    }
+
+    Fan_Out(sernums.size(), (sernums.size() > 1) ? Fan_Out_Width(context, channels) : 1, [&](size_t i) {
+        results[i] = Relays_Set_Module(context, sernums[i], *sets[i]);
+    });
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if (results[i] != ERROR_CODES::NONE)
+        {
+            return_value = results[i];
+            error_sernum += (error_sernum.empty() ? "" : ",") + sernums[i];
+        }
+    }
+
+    return return_value;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Set_Module
+* Arguments  : context  = open modules
+*              sernum   = serial number of the module (5 characters, upper case)
+*              module   = channels to set
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function sets the channels of one module, writing only the channels
+*   that change. Each driver call has a deadline and driver errors are retried.
+*/
+ERROR_CODES Relays_Set_Module(Relay_Context& context, const string& sernum, const MODULE& module)
+{
+    const int num_channels = context.Channels(sernum);
+    rmw_t op;
+
+    op.sn = sernum;
+    op.set_mask = Module_Mask(module, LOGIC::H, num_channels);
+    op.clear_mask = Module_Mask(module, LOGIC::L, num_channels);
+
+    return context.Apply(op);
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Rmw
+* Arguments  : context       = open modules
+*              rmws          = read-modify-write operation for each module
+*              channels      = structure of enumerated channels
+*              error_sernum  = receives the sernums of modules that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function applies a read-modify-write operation to each module and
+*   prints the resulting state of each module (in the order given). The
+*   modules are handled in parallel (see Relays_Set).
+*/
+ERROR_CODES Relays_Rmw(Relay_Context& context, const MODULE_RMW& rmws, const MODULE_CHANNELS& channels, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    vector<string> outputs(rmws.size());
+    vector<ERROR_CODES> results(rmws.size(), ERROR_CODES::NONE);
+
+    Fan_Out(rmws.size(), (rmws.size() > 1) ? Fan_Out_Width(context, channels) : 1, [&](size_t i) {
+        const int num_channels = Relays_Get_NumChannels(rmws[i].sn, channels);
+        results[i] = Relays_Rmw_Module(context, rmws[i], num_channels, outputs[i]);
+    });
+
+    for (size_t i = 0; i < rmws.size(); ++i)
+    {
+        std::cout << outputs[i] << " ";
+
+        if (results[i] != ERROR_CODES::NONE)
+        {
+            error = results[i];
+            error_sernum += (error_sernum.empty() ? "" : ",") + rmws[i].sn;
+        }
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Rmw_Module
+* Arguments  : context       = open modules
+*              op            = read-modify-write operation (names the module)
+*              num_channels  = number of channels on the module
+*              output        = receives the resulting state (e.g., "0110"), or the
+*                              observed state if the expected state did not match
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads the state of one module and writes the changed channels
+*   while holding the module's lock, so that no other process can change it in
+*   between.
+*/
+ERROR_CODES Relays_Rmw_Module(Relay_Context& context, const rmw_t& op, int num_channels, string& output)
+{
+    bool matched = false;
+    unsigned new_mask = 0;
+    ERROR_CODES error = context.Apply(op, &new_mask, nullptr, &matched);
+
+    if (error == ERROR_CODES::NONE)
+    {
+        output = Mask_Bits(new_mask, num_channels);
+        if (!matched)
+            error = ERROR_CODES::MISMATCH;
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Exec
+* Arguments  : context       = open modules
+*              exec          = sets and queries
+*              channels      = structure of enumerated channels
+*              error_sernum  = receives the sernums of modules that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function carries out the sets and queries of an EXEC as one plan:
+*   every module named is handled once, in parallel with the others (see
+*   Relays_Set). A module that is set is written and then read back while
+*   it is still held, so no other process can change it in between, and the
+*   read-back must match what was written (DEVICE_IO otherwise). Every query
+*   of a module is answered from that one read. The queries are then
+*   printed in the order given, as QUERY prints them.
+*/
+ERROR_CODES Relays_Exec(Relay_Context& context, const exec_t& exec, const MODULE_CHANNELS& channels, string& error_sernum)
+{
+    struct plan_t
+    {
+        string sn = "";
+        const MODULE* set = nullptr;    // channels to set, if any
+        bool query = false;             // read only
+        unsigned status = 0;            // state read back
+        ERROR_CODES result = ERROR_CODES::NONE;
+    };
+
+    ERROR_CODES error = ERROR_CODES::NONE;
+    vector<plan_t> plans;
+    map<string, size_t> index;          // sernum -> plans[]
+
+    auto plan_for = [&](string sn) -> plan_t& {
+        // sernum is exactly 5 characters
+        sn.resize(5);
+        std::transform(sn.begin(), sn.end(), sn.begin(), ::toupper);
+
+        auto it = index.find(sn);
+
+        if (it != index.end())
+            return plans[it->second];
+
+        index[sn] = plans.size();
+        plans.push_back(plan_t{ sn });
+        return plans.back();
+    };
+
+    for (auto const& [sernum, module] : exec.sets)
+        plan_for(sernum.empty() ? channels[0].sn : sernum).set = &module;
+
+    for (queries_t const& Q : exec.queries)
+        plan_for(Q.sn).query = true;
+
+    Fan_Out(plans.size(), (plans.size() > 1) ? Fan_Out_Width(context, channels) : 1, [&](size_t i) {
+        plan_t& plan = plans[i];
+
+        if (plan.set)
         {
-            error = Relays_Set(module, channels);
+            const int num_channels = context.Channels(plan.sn);
+            rmw_t op;
+
+            op.sn = plan.sn;
+            op.set_mask = Module_Mask(*plan.set, LOGIC::H, num_channels);
+            op.clear_mask = Module_Mask(*plan.set, LOGIC::L, num_channels);
+
+            plan.result = context.Apply(op, &plan.status, nullptr, nullptr, true);
         }
-        else if (is_query)
+        else
         {
-            error = Relays_Query(queries, channels);
+            plan.result = context.Query(plan.sn, plan.status);
         }
+    });
+
+    for (queries_t const& Q : exec.queries)
+    {
+        plan_t& plan = plan_for(Q.sn);
+
+        if (plan.result == ERROR_CODES::NONE)
+            std::cout << Query_Bits(plan.status, Q.q, context.Channels(plan.sn)) << " ";
     }
 
-    switch (error)
+    for (plan_t const& plan : plans)
     {
-    case ERROR_CODES::SYNTAX:
-        std::cerr << "Syntax error";
-        break;
-    case ERROR_CODES::NO_DEVICES:
-        std::cerr << "No devices found";
-        break;
-    case ERROR_CODES::BAD_SERNUM:
-        std::cerr << "Serial number " << error_sernum << " not found";
-        break;
-    case ERROR_CODES::NO_DRIVER_INIT:
-        std::cerr << "Driver did not initialize";
-        break;
-    case ERROR_CODES::INVALID_CHANNEL:
-        std::cerr << "Invalid channel specified";
-        break;
+        if (plan.result != ERROR_CODES::NONE)
+        {
+            error = plan.result;
+            error_sernum += (error_sernum.empty() ? "" : ",") + plan.sn;
+        }
     }
 
-    return int(error);
+    return error;
 }
 
 
 /*******************************************************************************
-* Function   : PrintUsage
-* Arguments  : strProgName  = name of the program (*.exe)
-* Returns    : none
+* Function   : Relays_Wait
+* Arguments  : context   = open modules
+*              wait      = module, pattern and timeout
+*              channels  = structure of enumerated channels
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
 * Description:
-*   This function simply prints the command-line usage to std::cout
+*   This function polls one module until it matches the pattern, then prints
+*   the time of the matching poll and the state. The polling interval starts
+*   short and backs off, and the module's lock is only held for each read, so
+*   other processes can change the module while we wait.
+*   Prints the last state read on TIMEOUT.
 */
-void PrintUsage(std::string strProgName)
+ERROR_CODES Relays_Wait(Relay_Context& context, const wait_t& wait, const MODULE_CHANNELS& channels)
 {
-    std::cout << "USB HID Relay utility v" << APP_VERSION << "\n";
-    std::cout << "Kerry S. Martin, martin@wild-wood.net\n";
-    std::cout << "Usage:\n";
-    std::cout << "  " << strProgName << " ENUMerate|list                              # list all devices by sn(#channels)\n";
-    std::cout << "  " << strProgName << " Query sernum {sernum ...}                   # query all channels for specific SNs\n";
-    std::cout << "  " << strProgName << " Query sernum@chlist {sernum@chlist ...}     # query given channels for specifc SNs\n";
-    std::cout << "  " << strProgName << " SET sernum:pattern {sernum:pattern ...}     # set given patterns on specific SNs\n";
-    std::cout << "  " << strProgName << " SET sernum ch=state {ch=state ...}          # set given channels on specific SNs\n";
-    std::cout << "  " << strProgName << " ALIAS                                       # list sernum aliases\n";
-    std::cout << "  " << strProgName << " ALIAS alias=sernum                          # create new alias\n";
-    std::cout << "  " << strProgName << " ALIAS -alias                                # delete alias\n\n";
-    std::cout << "    sernum = 5-character serial number\n";
-    std::cout << "    state = 0|1|OFF|ON|L|H|NO|NC\n";
-    std::cout << "    pattern = qq...    where q = 0|1|L|H|X\n";
-    std::cout << "    alias = starts with alphanum and -_#@~ (does not begin with -)\n";
-    std::cout << "    alias may replace any serial number\n";
-}
+    ERROR_CODES error = ERROR_CODES::NONE;
+    const int num_channels = Relays_Get_NumChannels(wait.sn, channels);
+    const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(wait.timeout_ms);
+    int interval_ms = WAIT_POLL_MIN_MS;
 
+    for (;;)
+    {
+        unsigned mask = 0;
 
-/*******************************************************************************
-* Function   : strip_path()
-* Arguments  : filename = full filename to the file
-* Returns    : just the base filename, without the path
-* Description:
-*   This function strips the pathname from a filename.
-*   ex/ C:\Projects\MyProject\Release\MyProject.exe => MyProject.exe
-*/
-string strip_path(string filename)
-{
-    const regex re("^(?:.*)(?:\\/|\\\\)(.+?)$");
-    smatch smMatch;
+        error = context.Query(wait.sn, mask);
 
-    if (regex_match(filename, smMatch, re))
-        return smMatch[1];
-    else
-        return filename;
+        const uint64_t time_us = History_Now();
+
+        if (error != ERROR_CODES::NONE)
+            break;
+
+        if ((mask & wait.care_mask) == wait.expect_mask)
+        {
+            std::cout << time_us << " " << Mask_Bits(mask, num_channels);
+            break;
+        }
+
+        auto wake = chrono::steady_clock::now() + chrono::milliseconds(interval_ms);
+
+        if (wait.timeout_ms >= 0 && wake >= deadline)
+        {
+            if (chrono::steady_clock::now() >= deadline)
+            {
+                std::cout << Mask_Bits(mask, num_channels) << " ";
+                error = ERROR_CODES::TIMEOUT;
+                break;
+            }
+            wake = deadline;    // one last poll at the deadline
+        }
+
+        this_thread::sleep_until(wake);
+        interval_ms = min(interval_ms * 2, WAIT_POLL_MAX_MS);
+    }
+
+    return error;
 }
 
 
 /*******************************************************************************
-* Function   : Relays_Set
-* Arguments  : modules   = structure of modules/channels to set
-*              channels  = structure of enumerated channels
+* Function   : Relays_Restore
+* Arguments  : context       = open modules
+*              watch         = keep watching for modules to appear
+*              seconds       = how long to watch (0 = until the process is stopped)
+*              error_sernum  = receives the sernums of modules that failed
 * Returns    : ERROR_CODES::NONE for success, otherwise failure
 * Description:
-*   This function sets individual relays in the modules to open or closed
+*   This function writes the last saved state to every module on the bus, all
+*   modules at once, and prints the state of each. While watching, the bus is
+*   enumerated every RESTORE_POLL_MS and a module that appears (or comes back
+*   after being unplugged) is restored as soon as it is seen. Only channels
+*   that differ are written, so a module that powered up with every relay off
+*   gets one report per channel that is on (one in all if all are on).
 */
-ERROR_CODES Relays_Set(const MODULE_SET& modules, const MODULE_CHANNELS& channels)
+ERROR_CODES Relays_Restore(Relay_Context& context, bool watch, int seconds, string& error_sernum)
 {
-    ERROR_CODES return_value = ERROR_CODES::NONE;
+    ERROR_CODES error = ERROR_CODES::NONE;
+    map<string, unsigned> saved;
+    set<string> restored;       // on the bus and restored
+    const auto end = chrono::steady_clock::now() + chrono::seconds(seconds);
+
+    if (!context.Saved_State(saved))
+        return ERROR_CODES::BAD_FILE;
 
-    if (usb_relay_init() == 0)
+    for (;;)
     {
-        for (auto const& [sernum, module] : modules)
+        MODULE_CHANNELS channels;
+        set<string> present;
+        vector<channels_t> arrived;
+
+        context.Enumerate(channels);
+
+        for (channels_t const& ch : channels)
         {
-            char szRelaySN[6] = "";
+            present.insert(ch.sn);
+            if (!restored.count(ch.sn) && saved.count(ch.sn))
+                arrived.push_back(ch);
+        }
 
-            if (sernum.empty())
-            {
-                channels_t s = channels[0];
-                string sn = s.sn;
-                for (int i = 0; i < 5; ++i)
-                    szRelaySN[i] = toupper(sn[i]);
-                szRelaySN[5] = '\0';
-            }
-            else
-            {
-                // sernum is exactly 5 characters
-                for (int i = 0; i < 5; ++i)
-                    szRelaySN[i] = toupper(sernum[i]);
-                szRelaySN[5] = '\0';
-            }
+        // a module that goes away is restored again when it comes back
+        for (auto it = restored.begin(); it != restored.end(); )
+            it = present.count(*it) ? next(it) : restored.erase(it);
 
-            intptr_t hHandle = usb_relay_device_open_with_serial_number(szRelaySN, (unsigned int)strlen(szRelaySN));
+        vector<ERROR_CODES> results(arrived.size(), ERROR_CODES::NONE);
 
-            if (hHandle)
-            {
-                for (auto const& [ch, st] : module)
-                {
-                    if (ch == RELAY_IDX_ALL)
-                    {
-                        switch (st)
-                        {
-                        case LOGIC::H:
-                            usb_relay_device_open_all_relay_channel(hHandle);
-                            break;
-                        case LOGIC::L:
-                            usb_relay_device_close_all_relay_channel(hHandle);
-                            break;
-                        }
-                    }
-                    else
-                    {
-                        switch (st)
-                        {
-                        case LOGIC::H:
-                            usb_relay_device_open_one_relay_channel(hHandle, ch - RELAY_IDX_MIN + 1);
-                            break;
-                        case LOGIC::L:
-                            usb_relay_device_close_one_relay_channel(hHandle, ch - RELAY_IDX_MIN + 1);
-                            break;
-                        }
-                    }
-                }
+        Fan_Out(arrived.size(), int(arrived.size()), [&context, &saved, &arrived, &results](size_t i) {
+            const unsigned mask = saved[arrived[i].sn];
+            results[i] = context.Apply(rmw_t{ arrived[i].sn, mask, ~mask, 0, 0, 0 });
+        });
 
-                usb_relay_device_close(hHandle);
+        for (size_t i = 0; i < arrived.size(); ++i)
+        {
+            if (results[i] == ERROR_CODES::NONE)
+            {
+                restored.insert(arrived[i].sn);
+                std::cout << arrived[i].sn << " " << Mask_Bits(saved[arrived[i].sn], arrived[i].channels) << endl;
+            }
+            else
+            {   // tried again at the next poll
+                error = results[i];
+                if (watch)
+                    std::cerr << Error_Message(results[i], arrived[i].sn) << endl;
+                else
+                    error_sernum += (error_sernum.empty() ? "" : ",") + arrived[i].sn;
             }
         }
 
-        usb_relay_exit();
-    }
-    else
-    {
-        return_value = ERROR_CODES::NO_DRIVER_INIT;
+        if (!watch || (seconds > 0 && chrono::steady_clock::now() >= end))
+            break;
+
+        this_thread::sleep_for(chrono::milliseconds(RESTORE_POLL_MS));
     }
 
-    return return_value;
+    return watch ? ERROR_CODES::NONE : error;
 }
 
 
@@ -508,200 +1723,290 @@ ERROR_CODES Relays_Set(const MODULE_SET& modules, const MODULE_CHANNELS& channel
 * Arguments  : none
 * Returns    : ERROR_CODES::NONE for success, otherwise failure
 * Description:
-*   This function enumerates the relays to stdout
+*   This function enumerates the relays to stdout. The bus is enumerated to
+*   reconcile the inventory, and the list is printed from it.
 */
 ERROR_CODES Relays_Enumerate()
 {
-    ERROR_CODES error = ERROR_CODES::NONE;
-
-    if (usb_relay_init() == 0)
-    {
-        pusb_relay_device_info_t pdevice = usb_relay_device_enumerate();
+    if (usb_relay_init() != 0)
+        return ERROR_CODES::NO_DRIVER_INIT;
 
-        if (pdevice)
-        {
-            while (pdevice)
-            {
-                std::cout << pdevice->serial_number << "(";
-                switch (pdevice->type)
-                {
-                case USB_RELAY_DEVICE_ONE_CHANNEL:
-                    std::cout << "1)";
-                    break;
-                case USB_RELAY_DEVICE_TWO_CHANNEL:
-                    std::cout << "2)";
-                    break;
-                case USB_RELAY_DEVICE_FOUR_CHANNEL:
-                    std::cout << "4)";
-                    break;
-                case USB_RELAY_DEVICE_EIGHT_CHANNEL:
-                    std::cout << "8)";
-                    break;
-                default:
-                    std::cout << "?)";
-                    break;
-                }
+    Inventory inventory(Inventory_Path());
+    MODULE_CHANNELS channels;
 
-                if (pdevice->next)
-                    std::cout << ",";
+    inventory.Reconcile();
+    usb_relay_exit();
 
-                pdevice = pdevice->next;
-            }
+    if (!inventory.Present(channels))
+        return ERROR_CODES::NO_DEVICES;
 
-            usb_relay_device_free_enumerate(pdevice);
-        }
-        else
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        std::cout << channels[i].sn << "(";
+        switch (channels[i].channels)
         {
-            error = ERROR_CODES::NO_DEVICES;
+        case USB_RELAY_DEVICE_ONE_CHANNEL:
+        case USB_RELAY_DEVICE_TWO_CHANNEL:
+        case USB_RELAY_DEVICE_FOUR_CHANNEL:
+        case USB_RELAY_DEVICE_EIGHT_CHANNEL:
+            std::cout << channels[i].channels << ")";
+            break;
+        default:
+            std::cout << "?)";
+            break;
         }
 
-        usb_relay_exit();
+        if (i + 1 < channels.size())
+            std::cout << ",";
     }
-    else
+
+    return ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Inventory
+* Arguments  : none
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function prints every module ever seen, one per line: whether it is
+*   on the bus now, when it was first and last seen (local time), its mean
+*   latency, the quirks seen, and the USB port and device path it was last
+*   seen at
+*/
+ERROR_CODES Relays_Inventory()
+{
+    if (usb_relay_init() != 0)
+        return ERROR_CODES::NO_DRIVER_INIT;
+
+    Inventory inventory(Inventory_Path());
+
+    inventory.Reconcile();
+    usb_relay_exit();
+
+    const vector<inventory_t> entries = inventory.Entries();
+
+    if (entries.empty())
+        return ERROR_CODES::NO_DEVICES;
+
+    std::cout << "sernum        ch  bus  first seen           last seen            latency us  quirks  port  device\n";
+
+    for (inventory_t const& e : entries)
     {
-        error = ERROR_CODES::NO_DRIVER_INIT;
+        string quirks = "";
+
+        if (e.quirks & QUIRK_STATUS_BITS)
+            quirks += "S";
+        if (e.quirks & QUIRK_TIMEOUT)
+            quirks += "T";
+        if (e.quirks & QUIRK_IO_ERROR)
+            quirks += "E";
+
+        std::cout << left << setw(12) << e.sn << right
+                  << setw(4) << e.channels << "  " << (e.present ? "yes" : "no ")
+                  << "  " << left << setw(19) << Format_Time(e.first_seen) << "  " << setw(19) << Format_Time(e.last_seen) << right
+                  << setw(12) << e.latency_us << "  " << left << setw(6) << (quirks.empty() ? "-" : quirks)
+                  << "  " << (e.port_path.empty() ? "-" : e.port_path) << "  " << e.device_path << right << endl;
     }
 
-    return error;
+    return ERROR_CODES::NONE;
 }
 
 
-
 /*******************************************************************************
 * Function   : Relays_Query
-* Arguments  : queries   = structure of modules/channels to query
-*              channels  = structure of enumerated channels
+* Arguments  : context       = open modules
+*              queries       = structure of modules/channels to query
+*              channels      = structure of enumerated channels
+*              error_sernum  = receives the sernums of modules that failed
 * Returns    : ERROR_CODES::NONE for success, otherwise failure
 * Description:
 *   This function queries individual relays in the modules for open/closed state
 */
-ERROR_CODES Relays_Query(const MODULE_QUERIES& queries, const MODULE_CHANNELS& channels)
+ERROR_CODES Relays_Query(Relay_Context& context, const MODULE_QUERIES& queries, const MODULE_CHANNELS& channels, string& error_sernum)
 {
     ERROR_CODES error = ERROR_CODES::NONE;
 
-    if (usb_relay_init() == 0)
-    {
-        if (!queries.empty())
+    if (!queries.empty())
+    {   // the modules are read in parallel (see Fan_Out); output is in the order given
+        vector<string> sernums;
+        vector<string> qs;
+        vector<int> nums;
+        vector<string> outputs(queries.size());
+        vector<ERROR_CODES> results(queries.size(), ERROR_CODES::NONE);
+
+        for (queries_t Q : queries)
         {
-            for (queries_t Q : queries)
-            {
-                string sernum = Q.sn;
-                string q = Q.q;
-                int num_channels = 0;
+            string sernum = Q.sn;
+            string q = Q.q;
+            int num_channels = 0;
 
-                char szRelaySN[6] = "";
+            char szRelaySN[6] = "";
 
-                if (!sernum.empty())
-                {
-                    // sernum is exactly 5 characters
-                    for (int i = 0; i < 5; ++i)
-                        szRelaySN[i] = toupper(sernum[i]);
-                    szRelaySN[5] = '\0';
-
-                    // find the sernum in channels to get the # of channels and verify that
-                    // the sernum exists
-                    for (channels_t s : channels)
-                    {
-                        if (s.sn == szRelaySN)
-                        {
-                            num_channels = s.channels;
-                            break;
-                        }
-                    }
+            if (!sernum.empty())
+            {
+                // sernum is exactly 5 characters
+                for (int i = 0; i < 5; ++i)
+                    szRelaySN[i] = toupper(sernum[i]);
+                szRelaySN[5] = '\0';
 
-                    if (num_channels < 1)
+                // find the sernum in channels to get the # of channels and verify that
+                // the sernum exists
+                for (channels_t s : channels)
+                {
+                    if (s.sn == szRelaySN)
                     {
-                        error = ERROR_CODES::BAD_SERNUM;
+                        num_channels = s.channels;
+                        break;
                     }
                 }
 
-                if (num_channels > 0)
+                if (num_channels < 1)
                 {
+                    error = ERROR_CODES::BAD_SERNUM;
+                }
+            }
 
-                    intptr_t hHandle = usb_relay_device_open_with_serial_number(szRelaySN, (unsigned int)strlen(szRelaySN));
+            if (num_channels > 0)
+            {
+                sernums.push_back(szRelaySN);
+                qs.push_back(q);
+                nums.push_back(num_channels);
+            }
+        }
 
-                    if (hHandle)
-                    {
-                        unsigned int status;
+        Fan_Out(sernums.size(), (sernums.size() > 1) ? Fan_Out_Width(context, channels) : 1, [&](size_t i) {
+            results[i] = Relays_Query_Module(context, sernums[i], qs[i], nums[i], outputs[i]);
+        });
 
-                        usb_relay_device_get_status(hHandle, &status);
+        for (size_t i = 0; i < sernums.size(); ++i)
+        {
+            std::cout << outputs[i] << " ";
 
-                        if (q.empty())
-                        {   // query all channels if empty
-                            for (auto i = 1; i <= num_channels; ++i)
-                                q.append(1, '0' + i);
-                        }
+            if (results[i] != ERROR_CODES::NONE)
+            {
+                error = results[i];
+                error_sernum += (error_sernum.empty() ? "" : ",") + sernums[i];
+            }
+        }
+    }
 
-                        for (char c : q)
-                        {
-                            if (c >= '1' && c <= '8')
-                            {
-                                int ch = int(c - '0');
+    return error;
+}
 
-                                if (ch >= 1 && ch <= num_channels)
-                                {
-                                    bool st = (status & (0x0001) << (ch - 1)) ? true : false;
 
-                                    if (st)
-                                        std::cout << "1";
-                                    else
-                                        std::cout << "0";
-                                }
-                            }
-                        }
+/*******************************************************************************
+* Function   : Relays_Query_Module
+* Arguments  : context       = open modules
+*              sernum        = serial number of the module (5 characters, upper case)
+*              q             = channels to query, or empty for all
+*              num_channels  = number of channels on the module
+*              output        = receives the state of the channels (e.g., "0110")
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads one module. Each driver call has a deadline and
+*   driver errors are retried.
+*/
+ERROR_CODES Relays_Query_Module(Relay_Context& context, const string& sernum, string q, int num_channels, string& output)
+{
+    unsigned status = 0;
+    ERROR_CODES error = context.Query(sernum, status);
 
-                        usb_relay_device_close(hHandle);
-                    }
+    if (error == ERROR_CODES::NONE)
+        output += Query_Bits(status, q, num_channels);
 
-                    std::cout << " ";
-                }
-            }
-        }
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Query_Bits
+* Arguments  : status        = state of the module (bit 0 = channel 1)
+*              q             = channels to show, or empty for all
+*              num_channels  = number of channels on the module
+* Returns    : the state of the channels (e.g., "0110")
+* Description:
+*   This function formats the state of a module as QUERY shows it
+*/
+string Query_Bits(unsigned status, string q, int num_channels)
+{
+    string output = "";
 
-        usb_relay_exit();
+    if (q.empty())
+    {   // query all channels if empty
+        for (auto i = 1; i <= num_channels; ++i)
+            q.append(1, '0' + i);
     }
-    else
+
+    for (char c : q)
     {
-        error = ERROR_CODES::NO_DRIVER_INIT;
+        if (c >= '1' && c <= '8')
+        {
+            int ch = int(c - '0');
+
+            if (ch >= 1 && ch <= num_channels)
+                output += (status & (0x0001 << (ch - 1))) ? "1" : "0";
+        }
     }
 
-    return error;
+    return output;
 }
 
 
 /*******************************************************************************
 * Function   : Relays_Get_Sernums
 * Arguments  : channels  = enumerate all sernums into this structure
+*              live      = enumerate the bus even if the inventory has modules
 * Returns    : true = success, false = failure
 * Description:
-*   Enumerates all of the relay modules to determine sernums and # of channels
+*   Determines the sernums and # of channels of the relay modules, from the
+*   inventory if it has any, otherwise by enumerating the bus (which also
+*   brings the inventory up to date)
 */
-bool Relays_Get_Sernums(MODULE_CHANNELS& channels)
+bool Relays_Get_Sernums(MODULE_CHANNELS& channels, bool live)
 {
-    channels = MODULE_CHANNELS{};
-    bool bResult = false;
+    Inventory inventory(Inventory_Path());
 
-    usb_relay_init();
-    pusb_relay_device_info_t pdevice = usb_relay_device_enumerate();
+    channels = MODULE_CHANNELS{};
 
-    if (pdevice)
-    {
-        while (pdevice)
-        {
-            channels_t ch;
-            ch.sn = pdevice->serial_number;
-            ch.channels = int(pdevice->type);
-            channels.push_back(ch);
-            pdevice = pdevice->next;
-        }
+    if (!live && inventory.Load() && inventory.Present(channels))
+        return true;
 
-        usb_relay_device_free_enumerate(pdevice);
-        bResult = true;
-    }
+    if (usb_relay_init() != 0)
+        return false;
 
+    inventory.Reconcile();
     usb_relay_exit();
 
-    return bResult;
+    return inventory.Present(channels);
+}
+
+
+/*******************************************************************************
+* Function   : Format_Time
+* Arguments  : time_us  = microseconds since 1970-01-01 UTC
+* Returns    : the time as local YYYY-MM-DD HH:MM:SS, or "-" for none
+* Description:
+*   This function formats a time kept in microseconds for people to read
+*/
+string Format_Time(uint64_t time_us)
+{
+    if (time_us == 0)
+        return "-";
+
+    const time_t t = time_t(time_us / 1000000);
+    tm local = {};
+
+#ifdef _WIN32
+    localtime_s(&local, &t);
+#else
+    localtime_r(&t, &local);
+#endif
+
+    ostringstream text;
+    text << put_time(&local, "%Y-%m-%d %H:%M:%S");
+
+    return text.str();
 }
 
 
@@ -909,6 +2214,43 @@ void ListAlias()
 }
 
 
+/*******************************************************************************
+* Function   : Alias_Index
+* Arguments  : channels = structure of enumerated channels
+* Returns    : alias or sernum -> sernum
+* Description:
+*   This function reads the alias assignments once and indexes them together
+*   with the enumerated sernums, for resolving many names. As in
+*   GetAliasSernum, an alias takes precedence over a sernum.
+*/
+unordered_map<string, string> Alias_Index(const MODULE_CHANNELS& channels)
+{
+    unordered_map<string, string> index;
+    string strAliasList;
+    smatch smMatch;
+
+    if (ReadRegSZ(REG_KEY_RELAY_ALIAS, REG_SETTING_ALIASES, strAliasList, ""))
+    {   // format is alias=sernum,alias=sernum,alias=sernum
+        while (regex_search(strAliasList, smMatch, regex_alias_registry))
+        {
+            string alias = smMatch[1];
+            string sernum = smMatch[2];
+
+            std::transform(alias.begin(), alias.end(), alias.begin(), ::toupper);
+            std::transform(sernum.begin(), sernum.end(), sernum.begin(), ::toupper);
+            index.emplace(alias, sernum);
+
+            strAliasList = smMatch.suffix().str();
+        }
+    }
+
+    for (channels_t s : channels)
+        index.emplace(s.sn, s.sn);
+
+    return index;
+}
+
+
 /*******************************************************************************
 * Function   : GetAliasSernum
 * Arguments  : alias_or_sernum   = alias or sernum from command line
@@ -960,6 +2302,6 @@ string GetAliasSernum(string alias_or_sernum)
 
 
 /*******************************************************************************
-* Copyright  2022 Kerry S. Martin, martin@wild-wood.net
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
 * Free for usage without warranty, expressed or implied; attribution required
 *******************************************************************************/
@@ -0,0 +1,132 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : Relay.h
+* Description:
+*   Types and support functions shared by the command line and server modes
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+// map to hold set states for relays
+enum class LOGIC { H, L, X };
+typedef char relay_idx_t;
+constexpr relay_idx_t RELAY_IDX_ALL = '0';
+constexpr relay_idx_t RELAY_IDX_MIN = '1';
+constexpr relay_idx_t RELAY_IDX_MAX = '8';
+typedef std::map<relay_idx_t, LOGIC> MODULE;
+typedef std::map<std::string, MODULE> MODULE_SET;
+
+// map to hold sernums and channels
+struct channels_t { std::string sn = ""; int channels = 0; };
+typedef std::vector<channels_t> MODULE_CHANNELS;
+
+// vector to hold query lists for relays
+struct queries_t { std::string sn = ""; std::string q = ""; };
+typedef std::vector<queries_t> MODULE_QUERIES;
+
+// read-modify-write operation on one module (TOGGLE, OR, ANDNOT, XOR, CAS):
+//   new = ((old & ~clear_mask) | set_mask) ^ toggle_mask
+// applied only if (old & care_mask) == expect_mask
+struct rmw_t
+{
+    std::string sn = "";
+    unsigned set_mask = 0;
+    unsigned clear_mask = 0;
+    unsigned toggle_mask = 0;
+    unsigned care_mask = 0;
+    unsigned expect_mask = 0;
+};
+typedef std::vector<rmw_t> MODULE_RMW;
+
+// WAIT until (state & care_mask) == expect_mask
+struct wait_t
+{
+    std::string sn = "";
+    unsigned care_mask = 0;
+    unsigned expect_mask = 0;
+    int64_t timeout_ms = -1;        // -1 = no timeout
+};
+
+// EXEC: SET and QUERY clauses carried out together (sets first, then queries)
+struct exec_t
+{
+    MODULE_SET sets;
+    MODULE_QUERIES queries;
+};
+
+// power-sequencing profile: groups of channels turned on in the order listed,
+// at least stagger_ms apart within a group (groups are independent)
+struct sequence_group_t
+{
+    std::string name = "";
+    uint32_t stagger_ms = 0;
+    std::vector<std::pair<std::string, int>> channels;     // sernum, channel (1-based)
+};
+typedef std::vector<sequence_group_t> SEQUENCE_PROFILE;
+
+// graph of steps: each sets channels of one module once every step it comes
+// after is done and that step's delay has passed
+struct step_t
+{
+    std::string name = "";
+    std::string sn = "";
+    unsigned set_mask = 0;
+    unsigned clear_mask = 0;
+    std::vector<std::pair<size_t, uint32_t>> after;    // step, delay_ms
+};
+typedef std::vector<step_t> STEP_GRAPH;
+
+// errors
+enum class ERROR_CODES : int { NONE = 0, SYNTAX = -1, NO_DEVICES = -2, BAD_SERNUM = -3, NO_DRIVER_INIT=-4, INVALID_CHANNEL=-5, RESERVED=-6, NO_SOCKET=-7, DEVICE_IO=-8, BAD_FILE=-9, TIMEOUT=-10, MISMATCH=-11, BUSY=-12, EXPIRED=-13, DUPLICATE=-14 };
+
+// string literals for common regex patterns
+// alias_name will match any sernum as well
+#define T_SERNUM "[A-Z0-9]{5}"
+#define T_ALIAS_NAME "[_#~@A-Z0-9][-_#~@A-Z0-9]*"
+#define T_LOGIC_BITS "[0L1HX_.]"
+#define T_LOGICS "ON|1|H|NO|OFF|0|L|NC"
+#define T_CHANNELS "[1-8]"
+
+// command parsing (shared by the command line and the server)
+ERROR_CODES Parse_Set(const std::vector<std::string>& args, const MODULE_CHANNELS& channels, MODULE_SET& modules, std::string& error_sernum);
+ERROR_CODES Parse_Set_File(const std::string& filename, const MODULE_CHANNELS& channels, MODULE_SET& modules, std::string& error_sernum);
+ERROR_CODES Parse_Query(const std::vector<std::string>& args, const MODULE_CHANNELS& channels, MODULE_QUERIES& queries, std::string& error_sernum);
+ERROR_CODES Parse_Wait(const std::vector<std::string>& args, const MODULE_CHANNELS& channels, wait_t& wait, std::string& error_sernum);
+ERROR_CODES Parse_Rmw(const std::string& op, const std::vector<std::string>& args, const MODULE_CHANNELS& channels, MODULE_RMW& rmws, std::string& error_sernum);
+ERROR_CODES Parse_Sequence_File(const std::string& filename, const MODULE_CHANNELS& channels, SEQUENCE_PROFILE& profile, std::string& error_sernum);
+ERROR_CODES Parse_Steps_File(const std::string& filename, const MODULE_CHANNELS& channels, STEP_GRAPH& steps, std::string& error_sernum);
+ERROR_CODES Parse_Exec(const std::vector<std::string>& args, const MODULE_CHANNELS& channels, exec_t& exec, std::string& error_sernum);
+
+// message for an error code (in RelayContext.cpp, so the Python module has it too)
+std::string Error_Message(ERROR_CODES error, const std::string& error_sernum);
+
+// channel bitmasks (bit 0 = channel 1)
+unsigned Module_Mask(const MODULE& module, LOGIC state, int num_channels);
+unsigned Query_Mask(const std::string& chlist, int num_channels);
+std::string Mask_Bits(unsigned mask, int num_channels);
+std::string Pattern_Bits(unsigned care, unsigned expect, int num_channels);
+
+// enumeration and aliases
+bool Relays_Get_Sernums(MODULE_CHANNELS& channels, bool live = false);
+int Relays_Get_NumChannels(std::string sernum, const MODULE_CHANNELS& channels);
+bool Is_Sernum_Present(std::string sernum, const MODULE_CHANNELS& channels);
+std::string GetAliasSernum(std::string alias_or_sernum);
+void AssignAlias(std::string alias, std::string sernum);
+void RemoveAlias(std::string alias);
+std::unordered_map<std::string, std::string> Alias_Index(const MODULE_CHANNELS& channels);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,783 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayContext.cpp
+* Description:
+*   Thread-safe context: owns the driver and a table of open relay modules
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include "RelayContext.h"
+#include "RelayLock.h"
+#include "usb_relay_device.h"
+using namespace std;
+
+// a driver call holds the lock WWES_Relay_<sernum>_CALL while it runs
+constexpr char CALL_LOCK_SUFFIX[] = "_CALL";
+
+// support function declarations
+static function<int()> Hold_Module(const string& sernum, function<int()> fn);
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Relay_Context
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Initializes the driver (check Is_Initialized) and takes the modules on
+*   the bus from the inventory. RELAY_MAX_OPEN, if set, bounds the modules
+*   held open at once.
+*/
+Relay_Context::Relay_Context()
+{
+    const char* env = getenv("RELAY_MAX_OPEN");
+
+    if (env && atoi(env) > 0)
+        max_open = size_t(atoi(env));
+
+    initialized = (usb_relay_init() == 0);
+
+    if (initialized && inventory.Load())
+        inventory.Present(known);
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::~Relay_Context
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Saves what was learned about the modules, closes every open module and
+*   releases the driver. A module stuck in a driver call is left alone, and
+*   then the driver is not released either, since the call is still using it.
+*/
+Relay_Context::~Relay_Context()
+{
+    lock_guard<mutex> table_lock(lock);
+    bool stuck = false;
+
+    Note_Devices();
+    inventory.Flush();
+
+    for (auto& [sn, dev] : devices)
+    {
+        lock_guard<mutex> dev_lock(dev->lock);
+        const intptr_t h = dev->hHandle;
+
+        if (dev->worker.Is_Stuck())
+            stuck = true;
+        else if (h)
+            Locked_Close(*dev);
+    }
+
+    devices.clear();
+
+    if (initialized && !stuck)
+        usb_relay_exit();
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Enumerate
+* Arguments  : channels  = receives the sernum and number of channels of each module
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Lists the modules on the bus (modules already open are not disturbed)
+*/
+ERROR_CODES Relay_Context::Enumerate(MODULE_CHANNELS& channels)
+{
+    if (!initialized)
+        return ERROR_CODES::NO_DRIVER_INIT;
+
+    lock_guard<mutex> table_lock(lock);
+
+    Refresh_Known();
+    channels = known;
+
+    return known.empty() ? ERROR_CODES::NO_DEVICES : ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Channels
+* Arguments  : sernum  = serial number of the module
+* Returns    : number of channels, or 0 if the module is not on the bus
+* Description:
+*   Returns the number of channels of a module
+*/
+int Relay_Context::Channels(const string& sernum)
+{
+    shared_ptr<device_t> dev = Get_Device(sernum);
+
+    return dev ? dev->channels : 0;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Topology
+* Arguments  : none
+* Returns    : sernum and device path of each module present, sorted by sernum
+* Description:
+*   Lists the modules on the bus as of the last enumeration, from the
+*   inventory. The bus is only enumerated if the inventory has none.
+*/
+vector<pair<string, string>> Relay_Context::Topology()
+{
+    vector<pair<string, string>> modules;
+
+    if (!initialized)
+        return modules;
+
+    lock_guard<mutex> table_lock(lock);
+
+    for (int pass = 0; pass < 2 && modules.empty(); ++pass)
+    {
+        if (pass == 1)
+            Refresh_Known();
+
+        for (inventory_t const& entry : inventory.Entries())
+        {
+            if (entry.present)
+                modules.emplace_back(entry.sn, entry.device_path);
+        }
+    }
+
+    return modules;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Call
+* Arguments  : sernum   = serial number of the module
+*              fn       = driver call, fn(hHandle) returns 0 on success
+*              retries  = number of times a failing call is repeated
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Makes one driver call on a module (opening it if necessary), with no other
+*   thread or process using the module at the same time
+*/
+ERROR_CODES Relay_Context::Call(const string& sernum, function<int(intptr_t)> fn, int retries)
+{
+    shared_ptr<device_t> dev = Get_Device(sernum);
+
+    if (!dev)
+        return ERROR_CODES::BAD_SERNUM;
+
+    Make_Room(*dev);
+
+    lock_guard<mutex> dev_lock(dev->lock);
+    Device_Lock sys_lock(dev->sn);
+
+    return Locked_Call(*dev, fn, retries);
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Open
+* Arguments  : sernum  = serial number of the module
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Opens a module ahead of use, without any I/O, and makes it the most
+*   recently used, so that a burst of calls does not wait for it to open
+*/
+ERROR_CODES Relay_Context::Open(const string& sernum)
+{
+    shared_ptr<device_t> dev = Get_Device(sernum);
+
+    if (!dev)
+        return ERROR_CODES::BAD_SERNUM;
+
+    Make_Room(*dev);
+
+    lock_guard<mutex> dev_lock(dev->lock);
+    Device_Lock sys_lock(dev->sn);
+
+    dev->last_used = ++use_clock;
+
+    return dev->hHandle ? ERROR_CODES::NONE : Locked_Open(*dev);
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Query
+* Arguments  : sernum  = serial number of the module
+*              state   = receives the state (bit 0 = channel 1)
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Reads the state of a module
+*/
+ERROR_CODES Relay_Context::Query(const string& sernum, unsigned& state)
+{
+    auto status = make_shared<unsigned int>(0);
+    ERROR_CODES error = Call(sernum, [status](intptr_t h) { return usb_relay_device_get_status(h, status.get()); });
+
+    if (error == ERROR_CODES::NONE)
+    {
+        shared_ptr<device_t> dev = Get_Device(sernum);
+        const unsigned all = (1u << dev->channels) - 1;
+
+        if (*status & ~all)
+            dev->quirks |= QUIRK_STATUS_BITS;
+        state = *status & all;
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Apply
+* Arguments  : op         = read-modify-write operation (op.sn is the module)
+*              new_state  = optionally receives the state after the operation
+*              old_state  = optionally receives the state before the operation
+*              matched    = optionally receives whether the expected state matched
+*              read_back  = read the state again after the write
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Applies the operation to the state read from the module (see Update)
+*/
+ERROR_CODES Relay_Context::Apply(const rmw_t& op, unsigned* new_state, unsigned* old_state, bool* matched, bool read_back)
+{
+    return Update(op.sn, [&op, matched](unsigned old_mask) { return Rmw_Apply(op, old_mask, matched); }, new_state, old_state, read_back);
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Update
+* Arguments  : sernum     = serial number of the module
+*              fn         = works out the state to write from the state read
+*              new_state  = optionally receives the state after the write
+*              old_state  = optionally receives the state read
+*              read_back  = read the state again after the write
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Reads the state of a module and writes the channels in which fn's state
+*   differs, while holding the module, so no other caller (in this or any
+*   other process) can change it in between. old_state is filled in as soon
+*   as the state has been read, so a caller can tell what the module held if
+*   the write fails. With read_back, the state is read again before the
+*   module is let go, and new_state receives what was read; a module that
+*   does not read back what was written fails with DEVICE_IO.
+*/
+ERROR_CODES Relay_Context::Update(const string& sernum, function<unsigned(unsigned)> fn, unsigned* new_state, unsigned* old_state, bool read_back)
+{
+    shared_ptr<device_t> dev = Get_Device(sernum);
+
+    if (!dev)
+        return ERROR_CODES::BAD_SERNUM;
+
+    Make_Room(*dev);
+
+    lock_guard<mutex> dev_lock(dev->lock);
+    Device_Lock sys_lock(dev->sn);
+
+    auto status = make_shared<unsigned int>(0);
+    ERROR_CODES error = Locked_Call(*dev, [status](intptr_t h) { return usb_relay_device_get_status(h, status.get()); }, RELAY_RETRIES);
+
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    const int channels = dev->channels;
+    const unsigned old_mask = *status & ((1u << channels) - 1);
+
+    if (*status & ~((1u << channels) - 1))
+        dev->quirks |= QUIRK_STATUS_BITS;
+    const unsigned new_mask = fn(old_mask) & ((1u << channels) - 1);
+
+    if (old_state)
+        *old_state = old_mask;
+
+    error = Locked_Call(*dev, [old_mask, new_mask, channels](intptr_t h) { return Relay_Write_Mask(h, old_mask, new_mask, channels); }, RELAY_RETRIES);
+
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    state.Save(dev->sn, new_mask);
+
+    unsigned read_mask = new_mask;
+
+    if (read_back)
+    {
+        error = Locked_Call(*dev, [status](intptr_t h) { return usb_relay_device_get_status(h, status.get()); }, RELAY_RETRIES);
+        read_mask = *status & ((1u << channels) - 1);
+
+        if (error == ERROR_CODES::NONE && read_mask != new_mask)
+            error = ERROR_CODES::DEVICE_IO;     // read back differs from what was written
+    }
+
+    if (new_state)
+        *new_state = read_mask;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Write
+* Arguments  : sernum    = serial number of the module
+*              old_mask  = current state of the module
+*              new_mask  = requested state of the module
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Writes a new state over a known one, for callers that track the state
+*   themselves (only the channels that differ are written)
+*/
+ERROR_CODES Relay_Context::Write(const string& sernum, unsigned old_mask, unsigned new_mask)
+{
+    const int channels = Channels(sernum);
+    ERROR_CODES error = Call(sernum, [old_mask, new_mask, channels](intptr_t h) { return Relay_Write_Mask(h, old_mask, new_mask, channels); });
+
+    if (error == ERROR_CODES::NONE)
+        state.Save(sernum, new_mask);
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Latency
+* Arguments  : sernum   = serial number of the module
+*              latency  = receives the I/O latency statistics
+*              stuck    = receives whether the module is isolated
+* Returns    : true = success, false = the module has not been used
+* Description:
+*   Reports the observed I/O latency of a module
+*/
+bool Relay_Context::Latency(const string& sernum, latency_t& latency, bool& stuck)
+{
+    lock_guard<mutex> table_lock(lock);
+    auto it = devices.find(sernum);
+
+    if (it == devices.end())
+        return false;
+
+    latency = it->second->worker.Latency(DEVICE_OP::IO);
+    stuck = it->second->worker.Is_Stuck();
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Handle_Stats
+* Arguments  : none
+* Returns    : the counters
+* Description:
+*   Reports how many modules are open, how often a call found its module
+*   open, and how long opening took
+*/
+handle_stats_t Relay_Context::Handle_Stats()
+{
+    lock_guard<mutex> guard(stats_lock);
+    handle_stats_t s = stats;
+
+    s.open = open_count;
+    s.max_open = max_open;
+
+    return s;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Get_Device
+* Arguments  : sernum  = serial number of the module
+* Returns    : the module's entry, or nullptr if it is not on the bus
+* Description:
+*   Looks up a module, adding it to the table on first use (the bus is
+*   enumerated again once if the module was not there the last time)
+*/
+shared_ptr<Relay_Context::device_t> Relay_Context::Get_Device(const string& sernum)
+{
+    if (!initialized)
+        return nullptr;
+
+    lock_guard<mutex> table_lock(lock);
+    auto it = devices.find(sernum);
+
+    if (it != devices.end())
+        return it->second;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (channels_t const& ch : known)
+        {
+            if (ch.sn == sernum)
+            {
+                auto dev = make_shared<device_t>();
+                dev->sn = sernum;
+                dev->channels = ch.channels;
+                devices[sernum] = dev;
+                return dev;
+            }
+        }
+
+        if (pass == 0)
+            Refresh_Known();    // not seen yet, enumerate again
+    }
+
+    return nullptr;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Refresh_Known
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Enumerates the modules on the bus into known, reconciling the inventory
+*   (caller holds lock)
+*/
+void Relay_Context::Refresh_Known()
+{
+    Note_Devices();
+    inventory.Reconcile();
+    inventory.Present(known);
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Note_Devices
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Passes the latency and quirks of every open module to the inventory
+*   (caller holds lock)
+*/
+void Relay_Context::Note_Devices()
+{
+    for (auto& [sn, dev] : devices)
+    {
+        const latency_t latency = dev->worker.Latency(DEVICE_OP::IO);
+
+        inventory.Note(sn, latency.samples ? uint32_t(latency.mean_us) : 0, dev->quirks);
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Locked_Call
+* Arguments  : dev      = module (caller holds dev.lock and its Device_Lock)
+*              fn       = driver call, fn(hHandle) returns 0 on success
+*              retries  = number of times a failing call is repeated
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Opens the module if necessary and makes one driver call. A module that
+*   still fails after the retries is closed, to be opened again next time.
+*   A call that misses its deadline returns TIMEOUT, and the caller lets go
+*   of the module's locks, but the call keeps the module to itself until it
+*   returns (see Hold_Module).
+*/
+ERROR_CODES Relay_Context::Locked_Call(device_t& dev, function<int(intptr_t)> fn, int retries)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+
+    dev.last_used = ++use_clock;
+
+    if (!dev.hHandle)
+    {
+        error = Locked_Open(dev);
+
+        if (error != ERROR_CODES::NONE)
+            return error;
+    }
+    else
+    {
+        lock_guard<mutex> guard(stats_lock);
+        ++stats.hits;
+    }
+
+    const intptr_t h = dev.hHandle;
+
+    error = dev.worker.Call(DEVICE_OP::IO, Hold_Module(dev.sn, [h, fn] { return fn(h); }), retries);
+
+    if (error == ERROR_CODES::TIMEOUT)
+        dev.quirks |= QUIRK_TIMEOUT;
+
+    if (error == ERROR_CODES::DEVICE_IO)
+    {
+        dev.quirks |= QUIRK_IO_ERROR;
+        Locked_Close(dev);
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Locked_Open
+* Arguments  : dev  = closed module (caller holds dev.lock and its Device_Lock)
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Opens the module, timing the open. If the open misses its deadline, the
+*   handle the driver returns late belongs to nobody, so the worker closes
+*   it as soon as it arrives (and the caller, if it arrived just after the
+*   deadline).
+*/
+ERROR_CODES Relay_Context::Locked_Open(device_t& dev)
+{
+    struct open_t
+    {
+        mutex lock;                 // guards everything below
+        intptr_t handle = 0;
+        bool abandoned = false;     // the caller gave up waiting
+    };
+
+    auto open = make_shared<open_t>();
+    const string sn = dev.sn;
+    const auto start = chrono::steady_clock::now();
+
+    ERROR_CODES error = dev.worker.Call(DEVICE_OP::OPEN, Hold_Module(sn, [sn, open] {
+        const intptr_t h = usb_relay_device_open_with_serial_number(sn.c_str(), (unsigned int)sn.length());
+        unique_lock<mutex> guard(open->lock);
+
+        if (open->abandoned)
+        {
+            guard.unlock();
+            if (h)
+                usb_relay_device_close(h);
+            return 1;
+        }
+
+        open->handle = h;
+        return h ? 0 : 1;
+    }));
+
+    intptr_t late = 0;
+
+    if (error == ERROR_CODES::TIMEOUT)
+    {
+        lock_guard<mutex> guard(open->lock);
+
+        open->abandoned = true;
+        late = exchange(open->handle, 0);
+    }
+
+    if (late)
+        dev.worker.Call(DEVICE_OP::IO, Hold_Module(sn, [late] { usb_relay_device_close(late); return 0; }), 0);
+
+    const uint64_t open_us = uint64_t(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+
+    {
+        lock_guard<mutex> guard(stats_lock);
+        ++stats.misses;
+        stats.open_us_total += open_us;
+        stats.open_us_max = max(stats.open_us_max, open_us);
+    }
+
+    if (error == ERROR_CODES::DEVICE_IO)
+        inventory.Reconcile();  // most likely unplugged: let the inventory know
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    dev.hHandle = open->handle;
+    dev.is_open = true;
+    ++open_count;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Locked_Close
+* Arguments  : dev  = open module (caller holds dev.lock)
+* Returns    : none
+* Description:
+*   Closes the module
+*/
+void Relay_Context::Locked_Close(device_t& dev)
+{
+    const intptr_t h = dev.hHandle;
+
+    dev.worker.Call(DEVICE_OP::IO, Hold_Module(dev.sn, [h] { usb_relay_device_close(h); return 0; }), 0);
+    dev.hHandle = 0;
+    dev.is_open = false;
+    --open_count;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Context::Make_Room
+* Arguments  : keep  = module about to be used (caller holds no locks)
+* Returns    : none
+* Description:
+*   If keep is closed and max_open modules are open, closes the least
+*   recently used ones until there is room to open it. A module in use (or
+*   stuck in a driver call) is passed over rather than waited for.
+*/
+void Relay_Context::Make_Room(const device_t& keep)
+{
+    if (keep.is_open || open_count < max_open)
+        return;
+
+    vector<shared_ptr<device_t>> open;
+
+    {
+        lock_guard<mutex> table_lock(lock);
+
+        for (auto& [sn, dev] : devices)
+            if (dev.get() != &keep && dev->is_open)
+                open.push_back(dev);
+    }
+
+    sort(open.begin(), open.end(), [](auto const& a, auto const& b) { return a->last_used < b->last_used; });
+
+    for (shared_ptr<device_t>& dev : open)
+    {
+        if (open_count < max_open)
+            break;
+
+        unique_lock<mutex> dev_lock(dev->lock, try_to_lock);
+
+        if (!dev_lock.owns_lock() || !dev->hHandle || dev->worker.Is_Stuck())
+            continue;
+
+        Locked_Close(*dev);
+
+        lock_guard<mutex> guard(stats_lock);
+        ++stats.evictions;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Rmw_Apply
+* Arguments  : op        = read-modify-write operation
+*              old_mask  = current state of the module
+*              matched   = optionally receives whether the expected state matched
+* Returns    : new state of the module (old_mask if the expected state did not match)
+* Description:
+*   This function applies a read-modify-write operation to a state
+*/
+unsigned Rmw_Apply(const rmw_t& op, unsigned old_mask, bool* matched)
+{
+    const bool match = (old_mask & op.care_mask) == op.expect_mask;
+
+    if (matched)
+        *matched = match;
+
+    return match ? (((old_mask & ~op.clear_mask) | op.set_mask) ^ op.toggle_mask) : old_mask;
+}
+
+
+/*******************************************************************************
+* Function   : Relay_Write_Mask
+* Arguments  : hHandle       = open device handle
+*              old_mask      = current state of the module
+*              new_mask      = requested state of the module
+*              num_channels  = number of channels on the module
+* Returns    : 0 = success, non-zero = error from the driver
+* Description:
+*   This function writes a new state to a module using the fewest reports
+*   the driver allows: a single all-on/all-off report when possible, otherwise
+*   one report for each channel that actually changes.
+*/
+int Relay_Write_Mask(intptr_t hHandle, unsigned old_mask, unsigned new_mask, int num_channels)
+{
+    const unsigned all = (1u << num_channels) - 1;
+    unsigned changed = (old_mask ^ new_mask) & all;
+    int result = 0;
+
+    if (changed == 0)
+        return 0;
+
+    if ((new_mask & all) == all)
+        return usb_relay_device_open_all_relay_channel(hHandle);
+    else if ((new_mask & all) == 0)
+        return usb_relay_device_close_all_relay_channel(hHandle);
+
+    for (int ch = 1; ch <= num_channels; ++ch)
+    {
+        unsigned bit = 1u << (ch - 1);
+
+        if (changed & bit)
+        {
+            int rc = (new_mask & bit) ? usb_relay_device_open_one_relay_channel(hHandle, ch)
+                                      : usb_relay_device_close_one_relay_channel(hHandle, ch);
+            if (rc != 0)
+                result = rc;
+        }
+    }
+
+    return result;
+}
+
+
+/*******************************************************************************
+* Function   : Error_Message
+* Arguments  : error         = error code
+*              error_sernum  = offending sernum (empty if none)
+* Returns    : text describing the error
+* Description:
+*   This function converts an error code to the message reported to the user
+*   (by the command line, the server and the Python module)
+*/
+string Error_Message(ERROR_CODES error, const string& error_sernum)
+{
+    switch (error)
+    {
+    case ERROR_CODES::SYNTAX:
+        return "Syntax error";
+    case ERROR_CODES::NO_DEVICES:
+        return "No devices found";
+    case ERROR_CODES::BAD_SERNUM:
+        return "Serial number " + error_sernum + " not found";
+    case ERROR_CODES::NO_DRIVER_INIT:
+        return "Driver did not initialize";
+    case ERROR_CODES::INVALID_CHANNEL:
+        return "Invalid channel specified";
+    case ERROR_CODES::RESERVED:
+        return "Channel reserved by another client";
+    case ERROR_CODES::NO_SOCKET:
+        return "Unable to open server socket";
+    case ERROR_CODES::DEVICE_IO:
+        return error_sernum.empty() ? "Device I/O error" : "Serial number " + error_sernum + " I/O error";
+    case ERROR_CODES::BAD_FILE:
+        return "Unable to read file";
+    case ERROR_CODES::TIMEOUT:
+        return error_sernum.empty() ? "Device timed out" : "Serial number " + error_sernum + " timed out";
+    case ERROR_CODES::MISMATCH:
+        return "Serial number " + error_sernum + " does not match the expected state";
+    case ERROR_CODES::BUSY:
+        return "Serial number " + error_sernum + " is busy";
+    case ERROR_CODES::EXPIRED:
+        return "Deadline passed before serial number " + error_sernum + " was written";
+    case ERROR_CODES::DUPLICATE:
+        return "Request ID already used";
+    default:
+        return "";
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Hold_Module
+* Arguments  : sernum  = serial number of the module
+*              fn      = driver call to run on the module's worker
+* Returns    : fn, taking the module's call lock around it
+* Description:
+*   The caller's Device_Lock is let go when a call misses its deadline,
+*   while the call itself may still be running in the driver. The call lock
+*   is taken by the worker thread that makes the call, so it is held until
+*   the call returns: a call on the module by any process waits for it
+*   (and so misses its own deadline, isolating the module there too).
+*/
+static function<int()> Hold_Module(const string& sernum, function<int()> fn)
+{
+    return [call_lock = sernum + CALL_LOCK_SUFFIX, fn] {
+        Device_Lock lock(call_lock);
+        return fn();
+    };
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,144 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayContext.h
+* Description:
+*   Thread-safe context: owns the driver and a table of open relay modules
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Relay.h"
+#include "RelayWorker.h"
+#include "RelayState.h"
+#include "RelayInventory.h"
+
+// most modules held open at once (RELAY_MAX_OPEN overrides it)
+constexpr size_t CONTEXT_MAX_OPEN = 64;
+
+// handle counters (HANDLES)
+struct handle_stats_t
+{
+    size_t open = 0;                // modules open now
+    size_t max_open = 0;
+    uint64_t hits = 0;              // calls on a module already open
+    uint64_t misses = 0;            // opens (by a call or by Open)
+    uint64_t evictions = 0;         // modules closed to make room
+    uint64_t open_us_total = 0;     // time spent opening
+    uint64_t open_us_max = 0;
+};
+
+// Owns the driver (usb_relay_init/usb_relay_exit) and a table of open modules.
+// Any number of threads may share one context: calls on different modules run
+// in parallel, calls on the same module are serialized (and serialized with
+// other processes by Device_Lock; a driver call that misses its deadline
+// keeps every process off the module until it returns). A module is opened on first use and stays
+// open, up to max_open modules: to open another, the least recently used
+// idle module is closed (a module in use is never closed, so while every
+// open module is busy the bound is passed). A module that fails is closed
+// and opened again on its next call. Every change of state is saved (State_Store,
+// off the caller's thread) for RESTORE. Modules are looked up in the inventory, and the bus is only
+// enumerated by Enumerate, for a module not in it, or when a module cannot be
+// opened. The driver has global state, so a process should have only one
+// context at a time.
+class Relay_Context
+{
+public:
+    Relay_Context();
+    ~Relay_Context();
+    Relay_Context(const Relay_Context&) = delete;
+    Relay_Context& operator=(const Relay_Context&) = delete;
+
+    bool Is_Initialized() const { return initialized; }
+
+    // refresh the list of modules on the bus
+    ERROR_CODES Enumerate(MODULE_CHANNELS& channels);
+    int Channels(const std::string& sernum);
+
+    // sernum and device path of each module on the bus, from the inventory
+    std::vector<std::pair<std::string, std::string>> Topology();
+
+    // one driver call on an open module: fn(hHandle) returns 0 on success
+    ERROR_CODES Call(const std::string& sernum, std::function<int(intptr_t)> fn, int retries = RELAY_RETRIES);
+
+    // open a module ahead of a burst of calls (no I/O), as the most recently used
+    ERROR_CODES Open(const std::string& sernum);
+
+    // state of a module (bit 0 = channel 1)
+    ERROR_CODES Query(const std::string& sernum, unsigned& state);
+
+    // read-modify-write of op.sn; no other caller can change the module in between
+    // (read_back: new_state is read back after the write, in the same hold)
+    ERROR_CODES Apply(const rmw_t& op, unsigned* new_state = nullptr, unsigned* old_state = nullptr, bool* matched = nullptr, bool read_back = false);
+
+    // read-modify-write of a module where fn works out the state to write from
+    // the state read (old_state receives what was read, even if the write fails)
+    ERROR_CODES Update(const std::string& sernum, std::function<unsigned(unsigned)> fn, unsigned* new_state = nullptr, unsigned* old_state = nullptr, bool read_back = false);
+
+    // write a state over a known one (only the channels that differ are written)
+    ERROR_CODES Write(const std::string& sernum, unsigned old_mask, unsigned new_mask);
+
+    // observed I/O latency of a module; false if the module is not open
+    bool Latency(const std::string& sernum, latency_t& latency, bool& stuck);
+
+    // how often calls found their module open, and what opening cost
+    handle_stats_t Handle_Stats();
+
+    // last state written to each module (by any process)
+    bool Saved_State(std::map<std::string, unsigned>& masks) { return state.Load(masks); }
+
+private:
+    struct device_t
+    {
+        std::string sn = "";
+        int channels = 0;
+        intptr_t hHandle = 0;       // 0 while closed
+        std::mutex lock;            // serializes callers of this module
+        Device_Worker worker;       // makes the driver calls, with deadlines
+        std::atomic<uint16_t> quirks{ 0 };  // QUIRK_* seen since opened
+        std::atomic<bool> is_open{ false }; // hHandle != 0, readable without lock
+        std::atomic<uint64_t> last_used{ 0 };   // use_clock at the last call
+    };
+
+    std::shared_ptr<device_t> Get_Device(const std::string& sernum);
+    void Refresh_Known();
+    void Note_Devices();
+    ERROR_CODES Locked_Call(device_t& dev, std::function<int(intptr_t)> fn, int retries);
+    ERROR_CODES Locked_Open(device_t& dev);
+    void Locked_Close(device_t& dev);
+    void Make_Room(const device_t& keep);
+
+    bool initialized = false;
+    State_Store state{ State_Path() };  // last state written to each module
+    Inventory inventory{ Inventory_Path() };    // every module seen, and where
+    std::mutex lock;                // guards known and devices
+    MODULE_CHANNELS known;          // last enumeration
+    std::map<std::string, std::shared_ptr<device_t>> devices;
+    size_t max_open = CONTEXT_MAX_OPEN;
+    std::atomic<size_t> open_count{ 0 };
+    std::atomic<uint64_t> use_clock{ 0 };   // orders the calls, for least recently used
+    std::mutex stats_lock;          // guards stats
+    handle_stats_t stats;
+};
+
+// read-modify-write and minimal write helpers (also used by the server)
+unsigned Rmw_Apply(const rmw_t& op, unsigned old_mask, bool* matched = nullptr);
+int Relay_Write_Mask(intptr_t hHandle, unsigned old_mask, unsigned new_mask, int num_channels);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,316 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayDuty.cpp
+* Description:
+*   Slow software PWM: duty-cycles relay channels with periods of a fraction
+*   of a second to hours, for the server's DUTY command
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <algorithm>
+using namespace std;
+
+#include "RelayDuty.h"
+
+// period and on time of a cycle
+static chrono::microseconds Period(const duty_t& d);
+static chrono::microseconds On_Time(const duty_t& d);
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::Duty_Scheduler
+* Arguments  : writer  = makes the writes of each pass
+* Returns    : none
+* Description:
+*   Starts the scheduler thread
+*/
+Duty_Scheduler::Duty_Scheduler(writer_t writer) : writer(writer)
+{
+    worker = thread(&Duty_Scheduler::Run, this);
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::~Duty_Scheduler
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Stops the scheduler thread (channels are left as they are)
+*/
+Duty_Scheduler::~Duty_Scheduler()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+
+    changed.notify_all();
+    passed.notify_all();
+    worker.join();
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::Set
+* Arguments  : duties  = channels to start or change
+* Returns    : none
+* Description:
+*   A channel already running with the same period keeps its cycle and takes
+*   the new duty from the current period on (an on time cut short ends at
+*   once). Any other channel starts a cycle; it joins the cycle of a channel
+*   already running with the same period, if there is one, so their rising
+*   edges coincide, otherwise its cycle starts now.
+*/
+void Duty_Scheduler::Set(const vector<duty_t>& duties)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        const clock::time_point now = clock::now();
+
+        for (duty_t const& d : duties)
+        {
+            const auto key = make_pair(d.dev, d.channel);
+            auto it = cycles.find(key);
+
+            if (it != cycles.end() && it->second.duty.period_ms == d.period_ms)
+            {   // same cycle, new duty
+                it->second.duty = d;
+                continue;
+            }
+
+            cycle_t c;
+            c.duty = d;
+            c.start = now;
+            c.on = (it != cycles.end()) && it->second.on;
+
+            for (auto const& [other_key, other] : cycles)
+            {
+                if (other_key != key && other.duty.period_ms == d.period_ms)
+                {   // join it: its current period starts at once
+                    c.start = other.start;
+                    c.n = (now - other.start) / Period(d) - 1;
+                    break;
+                }
+            }
+
+            cycles[key] = c;
+        }
+    }
+
+    changed.notify_all();
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::Stop
+* Arguments  : dev     = module
+*              mask    = channels to stop
+*              client  = who stopped them (passed to the writer)
+* Returns    : none
+* Description:
+*   Stops duty-cycling the channels and turns them off, waiting until the
+*   write is done so that no edge already under way can turn them back on
+*/
+void Duty_Scheduler::Stop(size_t dev, unsigned mask, uint32_t client)
+{
+    unique_lock<mutex> guard(lock);
+
+    for (auto it = cycles.begin(); it != cycles.end(); )
+    {
+        const bool stop = (it->first.first == dev) && (mask & (1u << (it->first.second - 1)));
+
+        it = stop ? cycles.erase(it) : next(it);
+    }
+
+    stopping[{ dev, client }] |= mask;
+
+    const uint64_t ticket = passes_begun + 1;      // the next pass to begin writes it
+
+    changed.notify_all();
+    passed.wait(guard, [&] { return passes_done >= ticket || !running; });
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::List
+* Arguments  : none
+* Returns    : every running channel, by module and channel
+* Description:
+*   Lists the running channels
+*/
+vector<duty_t> Duty_Scheduler::List()
+{
+    lock_guard<mutex> guard(lock);
+    vector<duty_t> list;
+
+    for (auto const& [key, c] : cycles)
+        list.push_back(c.duty);
+
+    return list;
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::Run
+* Arguments  : none
+* Returns    : none
+* Description:
+*   The scheduler thread. It sleeps until the earliest edge (or until the
+*   channels change), then moves every channel with an edge due within
+*   DUTY_MERGE_US on by one edge and writes each of their modules once per
+*   client that started channels on it (so the writer can check each
+*   client's reservations).
+*/
+void Duty_Scheduler::Run()
+{
+    unique_lock<mutex> guard(lock);
+
+    while (running)
+    {
+        clock::time_point next = clock::time_point::max();
+
+        for (auto const& [key, c] : cycles)
+            next = min(next, Next_Edge(c));
+
+        if (stopping.empty() && next > clock::now())
+        {
+            if (next == clock::time_point::max())
+                changed.wait(guard);
+            else
+                changed.wait_until(guard, next);
+            continue;
+        }
+
+        const clock::time_point now = clock::now();
+        const clock::time_point horizon = now + chrono::microseconds(DUTY_MERGE_US);
+        map<pair<size_t, uint32_t>, duty_write_t> writes;     // (dev, client) -> write
+
+        for (auto& [key, c] : cycles)
+        {
+            if (Next_Edge(c) <= horizon)
+            {
+                Advance(c, now);
+                writes[{ c.duty.dev, c.duty.client }];
+            }
+        }
+
+        // each write carries every channel its client duty-cycles on the module
+        for (auto const& [key, c] : cycles)
+        {
+            auto it = writes.find({ c.duty.dev, c.duty.client });
+
+            if (it != writes.end())
+                (c.on ? it->second.on : it->second.off) |= 1u << (c.duty.channel - 1);
+        }
+
+        for (auto const& [key, mask] : stopping)
+        {
+            duty_write_t& w = writes[key];
+
+            w.on &= ~mask;
+            w.off |= mask;
+        }
+
+        stopping.clear();
+
+        vector<duty_write_t> list;
+
+        for (auto& [key, w] : writes)
+        {
+            w.dev = key.first;
+            w.client = key.second;
+            list.push_back(w);
+        }
+
+        ++passes_begun;
+        guard.unlock();
+        writer(list);
+        guard.lock();
+        ++passes_done;
+        passed.notify_all();
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::Next_Edge
+* Arguments  : c  = cycle
+* Returns    : time of the cycle's next edge
+* Description:
+*   The end of the on time if the channel is on (and not on all the time),
+*   otherwise the start of the next period
+*/
+Duty_Scheduler::clock::time_point Duty_Scheduler::Next_Edge(const cycle_t& c) const
+{
+    if (c.n < 0)
+        return c.start;
+
+    const clock::time_point begin = c.start + Period(c.duty) * c.n;
+
+    if (c.on && On_Time(c.duty) < Period(c.duty))
+        return begin + On_Time(c.duty);
+
+    return begin + Period(c.duty);
+}
+
+
+/*******************************************************************************
+* Function   : Duty_Scheduler::Advance
+* Arguments  : c    = cycle
+*              now  = time of this pass
+* Returns    : none
+* Description:
+*   Moves the cycle on by one edge. If the thread has fallen whole periods
+*   behind, they are skipped rather than played out late.
+*/
+void Duty_Scheduler::Advance(cycle_t& c, clock::time_point now)
+{
+    const chrono::microseconds period = Period(c.duty);
+    const chrono::microseconds on_time = On_Time(c.duty);
+
+    if (c.n >= 0 && c.on && on_time < period)
+    {   // end of the on time
+        c.on = false;
+        return;
+    }
+
+    // start of a period (on unless its on time is already over)
+    c.n = max<int64_t>(c.n + 1, (now - c.start) / period);
+    c.on = (on_time.count() > 0) && now < c.start + period * c.n + on_time;
+}
+
+
+/*******************************************************************************
+* Function   : Period
+* Arguments  : d  = duty cycle
+* Returns    : the period
+* Description:
+*   Period of a duty cycle
+*/
+static chrono::microseconds Period(const duty_t& d)
+{
+    return chrono::microseconds(int64_t(d.period_ms) * 1000);
+}
+
+
+/*******************************************************************************
+* Function   : On_Time
+* Arguments  : d  = duty cycle
+* Returns    : the on time of each period
+* Description:
+*   On time of a duty cycle, rounded to the microsecond
+*/
+static chrono::microseconds On_Time(const duty_t& d)
+{
+    return chrono::microseconds(int64_t(d.period_ms * 1000.0 * d.duty + 0.5));
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
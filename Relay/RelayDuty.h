@@ -0,0 +1,113 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayDuty.h
+* Description:
+*   Slow software PWM: duty-cycles relay channels with periods of a fraction
+*   of a second to hours, for the server's DUTY command
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// limits on the period of a duty cycle
+constexpr uint32_t DUTY_PERIOD_MIN_MS = 100;
+constexpr uint32_t DUTY_PERIOD_MAX_MS = 86400000;   // a day
+
+// edges of one module due within this long of each other are written together
+constexpr int64_t DUTY_MERGE_US = 2000;
+
+// one channel being duty-cycled
+struct duty_t
+{
+    size_t dev = 0;                 // module (the caller's index)
+    int channel = 0;                // 1-based
+    uint32_t period_ms = 0;
+    double duty = 0;                // fraction of the period on, 0 .. 1
+    uint32_t client = 0;            // who started it (passed to the writer)
+};
+
+// one write to a module: the state every duty-cycled channel of it should have
+struct duty_write_t
+{
+    size_t dev = 0;
+    unsigned on = 0;                // channels to turn on
+    unsigned off = 0;               // channels to turn off
+    uint32_t client = 0;
+};
+
+// Duty-cycles channels from a thread of its own. Every edge is scheduled at an
+// absolute time counted from the start of the cycle (start + n * period, and
+// that plus the on time), never from the previous edge, so a late write does
+// not delay the edges after it and there is no drift. Channels with the same
+// period share a start, so their rising edges coincide. Every edge due on a
+// module within DUTY_MERGE_US is written as one mask per client, and each
+// write carries the state of all of the module's channels that client
+// duty-cycles, so a write that fails is made good by the next one.
+class Duty_Scheduler
+{
+public:
+    // makes the writes of one pass (modules may be written in parallel)
+    using writer_t = std::function<void(const std::vector<duty_write_t>& writes)>;
+
+    explicit Duty_Scheduler(writer_t writer);
+    ~Duty_Scheduler();
+    Duty_Scheduler(const Duty_Scheduler&) = delete;
+    Duty_Scheduler& operator=(const Duty_Scheduler&) = delete;
+
+    // start channels, or change them if they are running: a new duty takes
+    // effect in the current period without restarting the cycle, a new
+    // period starts a new cycle
+    void Set(const std::vector<duty_t>& duties);
+
+    // stop the channels in mask and turn them off; returns once they are off
+    void Stop(size_t dev, unsigned mask, uint32_t client);
+
+    // every running channel
+    std::vector<duty_t> List();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct cycle_t
+    {
+        duty_t duty;
+        clock::time_point start;    // start of period 0
+        int64_t n = -1;             // current period (-1 = not started)
+        bool on = false;            // state last written
+    };
+
+    void Run();
+    clock::time_point Next_Edge(const cycle_t& c) const;
+    void Advance(cycle_t& c, clock::time_point now);
+
+    std::mutex lock;                // guards everything below
+    std::condition_variable changed;    // cycles or stopping changed, or shutting down
+    std::condition_variable passed;     // a pass was written
+    bool running = true;
+    uint64_t passes_begun = 0;
+    uint64_t passes_done = 0;
+    std::map<std::pair<size_t, int>, cycle_t> cycles;      // (dev, channel) -> cycle
+    std::map<std::pair<size_t, uint32_t>, unsigned> stopping;  // (dev, client) -> channels to turn off
+
+    writer_t writer;
+    std::thread worker;             // last, so it starts after everything else
+};
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,99 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayHistory.cpp
+* Description:
+*   Bounded lock-free history of state transitions for one relay module
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <chrono>
+#include "RelayHistory.h"
+
+static_assert((HISTORY_DEPTH & (HISTORY_DEPTH - 1)) == 0, "HISTORY_DEPTH must be a power of 2");
+
+
+/*******************************************************************************
+* Function   : History_Ring::Record
+* Arguments  : t  = transition to record
+* Returns    : none
+* Description:
+*   Appends a transition, overwriting the oldest one when the ring is full.
+*   Never blocks.
+*/
+void History_Ring::Record(const transition_t& t)
+{
+    const uint64_t pos = head.fetch_add(1, std::memory_order_relaxed);
+    slot_t& slot = slots[pos & (HISTORY_DEPTH - 1)];
+    const uint64_t data = (uint64_t(t.client) << 32) | (uint64_t(t.old_mask & 0xFFFF) << 16) | (t.new_mask & 0xFFFF);
+
+    slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.time_us.store(t.time_us, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+    slot.seq.store(2 * pos + 2, std::memory_order_release);
+}
+
+
+/*******************************************************************************
+* Function   : History_Ring::Snapshot
+* Arguments  : since_us  = only return transitions at or after this time
+*              result    = receives the transitions, oldest first
+* Returns    : none
+* Description:
+*   Copies the retained transitions without blocking writers. Slots that are
+*   being rewritten while they are copied are skipped.
+*/
+void History_Ring::Snapshot(uint64_t since_us, std::vector<transition_t>& result) const
+{
+    const uint64_t end = head.load(std::memory_order_acquire);
+    const uint64_t begin = (end > HISTORY_DEPTH) ? end - HISTORY_DEPTH : 0;
+
+    for (uint64_t pos = begin; pos < end; ++pos)
+    {
+        const slot_t& slot = slots[pos & (HISTORY_DEPTH - 1)];
+        const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+
+        if (seq != 2 * pos + 2)
+            continue;   // not yet written, or already overwritten
+
+        transition_t t;
+        t.time_us = slot.time_us.load(std::memory_order_relaxed);
+        const uint64_t data = slot.data.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq)
+            continue;   // rewritten while copying
+
+        t.client = uint32_t(data >> 32);
+        t.old_mask = unsigned(data >> 16) & 0xFFFF;
+        t.new_mask = unsigned(data) & 0xFFFF;
+
+        if (t.time_us >= since_us)
+            result.push_back(t);
+    }
+}
+
+
+/*******************************************************************************
+* Function   : History_Now
+* Arguments  : none
+* Returns    : current time in microseconds since 1970-01-01 UTC
+* Description:
+*   Timestamp used for recorded transitions
+*/
+uint64_t History_Now()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
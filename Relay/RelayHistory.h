@@ -0,0 +1,58 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayHistory.h
+* Description:
+*   Bounded lock-free history of state transitions for one relay module
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+
+// number of transitions kept per module (power of 2)
+constexpr size_t HISTORY_DEPTH = 1024;
+
+// one state transition
+struct transition_t
+{
+    uint64_t time_us = 0;       // microseconds since 1970-01-01 UTC
+    uint32_t client = 0;        // id of the client that made the change
+    unsigned old_mask = 0;      // bit 0 = channel 1
+    unsigned new_mask = 0;
+};
+
+// Ring buffer of the most recent HISTORY_DEPTH transitions. Writers never wait
+// for readers: each slot carries a sequence number, and a reader discards any
+// slot that was rewritten while it was being copied.
+class History_Ring
+{
+public:
+    void Record(const transition_t& t);
+    void Snapshot(uint64_t since_us, std::vector<transition_t>& result) const;
+
+private:
+    struct slot_t
+    {
+        std::atomic<uint64_t> seq{ 0 };     // 2*pos+1 while writing, 2*pos+2 when valid
+        std::atomic<uint64_t> time_us{ 0 };
+        std::atomic<uint64_t> data{ 0 };    // client(32) | old_mask(16) | new_mask(16)
+    };
+
+    std::atomic<uint64_t> head{ 0 };        // position of the next record
+    slot_t slots[HISTORY_DEPTH];
+};
+
+// current time for transition_t::time_us
+uint64_t History_Now();
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
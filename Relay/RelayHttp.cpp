@@ -0,0 +1,493 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayHttp.cpp
+* Description:
+*   Minimal HTTP/1.1 request parser and JSON helpers for the server's HTTP
+*   interface. The parser does not allocate: the parts of a request are views
+*   into the connection's receive buffer.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <cstdio>
+using namespace std;
+
+#include "RelayHttp.h"
+
+// support function declarations
+static bool Take_Line(string_view& buf, string_view& line);
+static bool Equal_Nocase(string_view a, string_view b);
+static bool Has_Token(string_view value, string_view token);
+static string_view Trim(string_view s);
+static int Hex_Digit(char c);
+static const char* Status_Text(int status);
+
+
+/*******************************************************************************
+* Function   : Http_Parse
+* Arguments  : buf  = received data, starting at a request
+*              req  = receives the parts of the request (views into buf)
+* Returns    : length of the request, HTTP_INCOMPLETE or HTTP_MALFORMED
+* Description:
+*   Parses the request line and headers, and finds the body from
+*   Content-Length. Only the headers that matter here are looked at
+*   (Content-Length, Connection, Transfer-Encoding); chunked bodies are not
+*   supported. Lines may end in CRLF or LF.
+*/
+int Http_Parse(string_view buf, http_request_t& req)
+{
+    string_view rest = buf;
+    string_view line;
+    size_t content_length = 0;
+    bool http_10 = false;
+    bool has_connection = false;
+
+    req = http_request_t{};
+
+    if (!Take_Line(rest, line))
+        return (buf.size() > HTTP_HEADER_MAX) ? HTTP_MALFORMED : HTTP_INCOMPLETE;
+
+    // request line: METHOD SP target SP HTTP/1.x
+    if (!Http_Is_Request_Line(line))
+        return HTTP_MALFORMED;
+
+    const size_t sp1 = line.find(' ');
+    const size_t sp2 = line.find(' ', sp1 + 1);
+    const string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    const size_t q = target.find('?');
+
+    req.method = line.substr(0, sp1);
+    req.path = target.substr(0, q);
+    req.query = (q == string_view::npos) ? string_view() : target.substr(q + 1);
+    http_10 = (line.back() == '0');
+
+    // headers, up to an empty line
+    for (;;)
+    {
+        if (!Take_Line(rest, line))
+            return (buf.size() > HTTP_HEADER_MAX) ? HTTP_MALFORMED : HTTP_INCOMPLETE;
+
+        if (line.empty())
+            break;
+
+        const size_t colon = line.find(':');
+
+        if (colon == string_view::npos || colon == 0)
+            return HTTP_MALFORMED;
+
+        const string_view name = line.substr(0, colon);
+        const string_view value = Trim(line.substr(colon + 1));
+
+        if (Equal_Nocase(name, "Content-Length"))
+        {
+            content_length = 0;
+            for (char c : value)
+            {
+                if (c < '0' || c > '9' || content_length > HTTP_BODY_MAX)
+                    return HTTP_MALFORMED;
+                content_length = content_length * 10 + (c - '0');
+            }
+        }
+        else if (Equal_Nocase(name, "Connection"))
+        {
+            has_connection = true;
+            req.keep_alive = http_10 ? Has_Token(value, "keep-alive") : !Has_Token(value, "close");
+        }
+        else if (Equal_Nocase(name, "Transfer-Encoding"))
+        {
+            return HTTP_MALFORMED;
+        }
+    }
+
+    const size_t header_length = buf.size() - rest.size();
+
+    if (header_length > HTTP_HEADER_MAX || content_length > HTTP_BODY_MAX)
+        return HTTP_MALFORMED;
+
+    if (rest.size() < content_length)
+        return HTTP_INCOMPLETE;
+
+    if (!has_connection)
+        req.keep_alive = !http_10;
+
+    req.body = rest.substr(0, content_length);
+
+    return int(header_length + content_length);
+}
+
+
+/*******************************************************************************
+* Function   : Http_Is_Request_Line
+* Arguments  : line  = first line received on a connection
+* Returns    : true if it is METHOD SP target SP HTTP/1.0 or HTTP/1.1
+* Description:
+*   Tells an HTTP client from a client of the line protocol
+*/
+bool Http_Is_Request_Line(string_view line)
+{
+    const size_t sp1 = line.find(' ');
+
+    if (sp1 == 0 || sp1 == string_view::npos)
+        return false;
+
+    for (size_t i = 0; i < sp1; ++i)
+    {
+        if (line[i] < 'A' || line[i] > 'Z')
+            return false;
+    }
+
+    const size_t sp2 = line.find(' ', sp1 + 1);
+
+    if (sp2 == string_view::npos || sp2 == sp1 + 1 || line[sp1 + 1] != '/')
+        return false;
+
+    const string_view version = line.substr(sp2 + 1);
+
+    return version == "HTTP/1.1" || version == "HTTP/1.0";
+}
+
+
+/*******************************************************************************
+* Function   : Http_Query_Next
+* Arguments  : query  = rest of the query string (advanced past the pair)
+*              name   = receives the name (not decoded)
+*              value  = receives the value, percent-decoded ('+' is a space)
+* Returns    : true if a pair was taken, false at the end of the query
+* Description:
+*   Iterates over name=value pairs separated by '&'
+*/
+bool Http_Query_Next(string_view& query, string_view& name, string& value)
+{
+    while (!query.empty())
+    {
+        const size_t amp = query.find('&');
+        const string_view pair = query.substr(0, amp);
+
+        query = (amp == string_view::npos) ? string_view() : query.substr(amp + 1);
+
+        if (pair.empty())
+            continue;
+
+        const size_t eq = pair.find('=');
+        const string_view raw = (eq == string_view::npos) ? string_view() : pair.substr(eq + 1);
+
+        name = pair.substr(0, eq);
+        value.clear();
+
+        for (size_t i = 0; i < raw.size(); ++i)
+        {
+            if (raw[i] == '+')
+                value += ' ';
+            else if (raw[i] == '%' && i + 2 < raw.size() && Hex_Digit(raw[i + 1]) >= 0 && Hex_Digit(raw[i + 2]) >= 0)
+            {
+                value += char(Hex_Digit(raw[i + 1]) * 16 + Hex_Digit(raw[i + 2]));
+                i += 2;
+            }
+            else
+                value += raw[i];
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+/*******************************************************************************
+* Function   : Http_Response
+* Arguments  : out         = receives the response (appended)
+*              status      = HTTP status code
+*              json        = body
+*              keep_alive  = false to tell the client the connection closes
+* Returns    : none
+* Description:
+*   Formats a response with a JSON body
+*/
+void Http_Response(string& out, int status, const string& json, bool keep_alive)
+{
+    char head[160];
+    const int n = snprintf(head, sizeof(head),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+        status, Status_Text(status), json.size(), keep_alive ? "" : "Connection: close\r\n");
+
+    out.append(head, size_t(n));
+    out += json;
+}
+
+
+/*******************************************************************************
+* Function   : Json_String
+* Arguments  : s  = text
+* Returns    : s as a JSON string literal
+* Description:
+*   Quotes s, escaping quotes, backslashes and control characters
+*/
+string Json_String(string_view s)
+{
+    string out = "\"";
+
+    for (unsigned char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += char(c);
+        }
+        else if (c < 0x20)
+        {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        }
+        else
+        {
+            out += char(c);
+        }
+    }
+
+    return out + "\"";
+}
+
+
+/*******************************************************************************
+* Function   : Json_Object
+* Arguments  : text     = JSON text
+*              members  = receives the name/value pairs, in order
+* Returns    : true = success, false = not a flat object of strings
+* Description:
+*   Parses {"name": "value", ...}. Escapes other than \uXXXX are decoded;
+*   \uXXXX is accepted only for ASCII.
+*/
+bool Json_Object(string_view text, vector<pair<string, string>>& members)
+{
+    size_t i = 0;
+
+    auto skip_ws = [&] { while (i < text.size() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == '\n')) ++i; };
+
+    auto parse_string = [&](string& s) {
+        if (i >= text.size() || text[i] != '"')
+            return false;
+        for (++i; i < text.size() && text[i] != '"'; ++i)
+        {
+            if (text[i] != '\\')
+            {
+                s += text[i];
+                continue;
+            }
+            if (++i >= text.size())
+                return false;
+            switch (text[i])
+            {
+            case 'n': s += '\n'; break;
+            case 't': s += '\t'; break;
+            case 'r': s += '\r'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'u':
+            {
+                int code = 0;
+                for (int k = 1; k <= 4; ++k)
+                {
+                    const int d = (i + k < text.size()) ? Hex_Digit(text[i + k]) : -1;
+                    if (d < 0)
+                        return false;
+                    code = code * 16 + d;
+                }
+                if (code > 0x7F)
+                    return false;
+                s += char(code);
+                i += 4;
+                break;
+            }
+            default: s += text[i]; break;
+            }
+        }
+        if (i >= text.size())
+            return false;
+        ++i;    // closing quote
+        return true;
+    };
+
+    skip_ws();
+    if (i >= text.size() || text[i++] != '{')
+        return false;
+
+    skip_ws();
+    if (i < text.size() && text[i] == '}')
+        ++i;
+    else
+    {
+        for (;;)
+        {
+            string name, value;
+
+            skip_ws();
+            if (!parse_string(name))
+                return false;
+            skip_ws();
+            if (i >= text.size() || text[i++] != ':')
+                return false;
+            skip_ws();
+            if (!parse_string(value))
+                return false;
+            members.emplace_back(move(name), move(value));
+            skip_ws();
+            if (i < text.size() && text[i] == ',')
+            {
+                ++i;
+                continue;
+            }
+            if (i < text.size() && text[i] == '}')
+            {
+                ++i;
+                break;
+            }
+            return false;
+        }
+    }
+
+    skip_ws();
+
+    return i == text.size();
+}
+
+
+/*******************************************************************************
+* Function   : Take_Line
+* Arguments  : buf   = data (advanced past the line)
+*              line  = receives the line without its terminator
+* Returns    : true if a whole line was there
+* Description:
+*   Splits off one CRLF- or LF-terminated line
+*/
+static bool Take_Line(string_view& buf, string_view& line)
+{
+    const size_t eol = buf.find('\n');
+
+    if (eol == string_view::npos)
+        return false;
+
+    line = buf.substr(0, (eol > 0 && buf[eol - 1] == '\r') ? eol - 1 : eol);
+    buf.remove_prefix(eol + 1);
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Equal_Nocase
+* Arguments  : a, b  = ASCII text
+* Returns    : true if equal ignoring case
+* Description:
+*   Compares header names
+*/
+static bool Equal_Nocase(string_view a, string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if ((a[i] | 0x20) != (b[i] | 0x20))
+            return false;
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Has_Token
+* Arguments  : value  = comma-separated header value
+*              token  = token to look for (case ignored)
+* Returns    : true if the token is in the list
+* Description:
+*   Looks for a token such as "close" in a Connection header
+*/
+static bool Has_Token(string_view value, string_view token)
+{
+    while (!value.empty())
+    {
+        const size_t comma = value.find(',');
+
+        if (Equal_Nocase(Trim(value.substr(0, comma)), token))
+            return true;
+
+        value = (comma == string_view::npos) ? string_view() : value.substr(comma + 1);
+    }
+
+    return false;
+}
+
+
+/*******************************************************************************
+* Function   : Trim
+* Arguments  : s  = text
+* Returns    : s without leading and trailing spaces and tabs
+* Description:
+*   Strips optional white space around header values
+*/
+static string_view Trim(string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+
+    return s;
+}
+
+
+/*******************************************************************************
+* Function   : Hex_Digit
+* Arguments  : c  = character
+* Returns    : value of the hex digit, or -1
+* Description:
+*   Decodes one hex digit
+*/
+static int Hex_Digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+
+/*******************************************************************************
+* Function   : Status_Text
+* Arguments  : status  = HTTP status code
+* Returns    : reason phrase
+* Description:
+*   Reason phrases for the status codes the server uses
+*/
+static const char* Status_Text(int status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default:  return "Unknown";
+    }
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,62 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayHttp.h
+* Description:
+*   Minimal HTTP/1.1 request parser and JSON helpers for the server's HTTP
+*   interface. The parser does not allocate: the parts of a request are views
+*   into the connection's receive buffer.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// limits on one request
+constexpr size_t HTTP_HEADER_MAX = 8192;    // request line and headers
+constexpr size_t HTTP_BODY_MAX = 65536;
+
+// one request; every view points into the buffer given to Http_Parse
+struct http_request_t
+{
+    std::string_view method;
+    std::string_view path;          // target up to '?'
+    std::string_view query;         // target after '?'
+    std::string_view body;
+    bool keep_alive = true;         // HTTP/1.1 unless "Connection: close"
+};
+
+// result of Http_Parse other than the length of a complete request
+constexpr int HTTP_INCOMPLETE = 0;
+constexpr int HTTP_MALFORMED = -1;
+
+// parses the request at the start of buf; returns its length (headers and
+// body), HTTP_INCOMPLETE if more data is needed, or HTTP_MALFORMED
+int Http_Parse(std::string_view buf, http_request_t& req);
+
+// true if line (without its terminator) is an HTTP/1.x request line
+bool Http_Is_Request_Line(std::string_view line);
+
+// takes the next name=value pair off a query string, percent-decoding the value
+bool Http_Query_Next(std::string_view& query, std::string_view& name, std::string& value);
+
+// appends a response with a JSON body
+void Http_Response(std::string& out, int status, const std::string& json, bool keep_alive);
+
+// JSON string literal (quoted and escaped)
+std::string Json_String(std::string_view s);
+
+// parses a flat JSON object whose values are strings: {"name": "value", ...}
+bool Json_Object(std::string_view text, std::vector<std::pair<std::string, std::string>>& members);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,532 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayInventory.cpp
+* Description:
+*   Persistent inventory of every module ever seen: when it was seen, its
+*   channels, where it is plugged in, how it behaves, and how fast it is.
+*   Lookups are served from the inventory; the bus is enumerated only to
+*   reconcile it with what is really there.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <cfgmgr32.h>
+#pragma comment(lib, "cfgmgr32.lib")
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <regex>
+using namespace std;
+
+#include "RelayInventory.h"
+#include "RelayLock.h"
+#include "usb_relay_device.h"
+
+// file layout
+constexpr char INVENTORY_MAGIC[] = "RLYINV01";      // 8-byte header, then a 4-byte count
+constexpr size_t INVENTORY_HEADER_SIZE = 12;
+constexpr size_t INVENTORY_SN_SIZE = 12;
+constexpr size_t INVENTORY_RECORD_SIZE = 42;        // fixed fields; the paths follow
+
+// last_seen is saved when it has moved on this much (so a reconcile that
+// changes nothing else does not rewrite the file every time)
+constexpr uint64_t INVENTORY_SEEN_US = 60000000;
+
+// name of the cross-process lock that serializes access to the file
+constexpr char INVENTORY_LOCK_NAME[] = "~INVENTORY";
+
+#ifdef _WIN32
+constexpr char INVENTORY_FILE_NAME[] = "\\WWES_Relay.inventory";
+#else
+constexpr char INVENTORY_FILE_DEFAULT[] = "/var/tmp/WWES_Relay.inventory";
+#endif
+
+// support functions
+static string Usb_Port_Path(const string& device_path);
+static void Put_Le(string& out, uint64_t value, int bytes);
+static uint64_t Get_Le(const unsigned char* p, int bytes);
+
+
+/*******************************************************************************
+* Function   : Inventory_Path
+* Arguments  : none
+* Returns    : path of the inventory file (empty = keep none)
+* Description:
+*   RELAY_INVENTORY_FILE if it is set, otherwise a file that survives a reboot
+*/
+string Inventory_Path()
+{
+    const char* env = getenv("RELAY_INVENTORY_FILE");
+
+    if (env)
+        return env;
+
+#ifdef _WIN32
+    const char* dir = getenv("ProgramData");
+
+    return string(dir ? dir : ".") + INVENTORY_FILE_NAME;
+#else
+    return INVENTORY_FILE_DEFAULT;
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Inventory
+* Arguments  : path  = inventory file (empty = keep the inventory in memory only)
+* Returns    : none
+* Description:
+*   The file is read by Load
+*/
+Inventory::Inventory(const string& path) : path(path)
+{
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Load
+* Arguments  : none
+* Returns    : true = the file was read, false = there is no usable file
+* Description:
+*   Reads the inventory file. The file is only ever replaced whole, so no
+*   file lock is needed just to read it.
+*/
+bool Inventory::Load()
+{
+    lock_guard<mutex> guard(lock);
+
+    if (path.empty())
+        return false;
+
+    return Read();
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Reconcile
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Enumerates the bus and brings the inventory up to date: modules seen for
+*   the first time are added, modules gone are marked absent, and paths and
+*   channels are refreshed. The file is read again first, so changes made by
+*   other processes are kept, and written only if something changed.
+*/
+void Inventory::Reconcile()
+{
+    pusb_relay_device_info_t list = usb_relay_device_enumerate();
+    const uint64_t now = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+    lock_guard<mutex> guard(lock);
+    optional<Device_Lock> file_lock;
+    bool changed = false;
+
+    if (!path.empty())
+    {
+        file_lock.emplace(INVENTORY_LOCK_NAME);
+        Read();
+    }
+
+    map<string, bool> seen;
+    int order = 0;
+
+    for (auto p = list; p; p = p->next, ++order)
+    {
+        inventory_t& entry = entries[p->serial_number];
+        const string device_path = p->device_path ? p->device_path : "";
+
+        if (entry.sn.empty())
+        {   // first time seen
+            entry.sn = p->serial_number;
+            entry.first_seen = now;
+            changed = true;
+        }
+
+        if (!entry.present || entry.order != order || entry.channels != int(p->type) || entry.device_path != device_path
+            || now - entry.last_seen >= INVENTORY_SEEN_US)
+        {
+            changed = true;
+        }
+
+        if (entry.device_path != device_path || (!entry.present && entry.port_path.empty()))
+            entry.port_path = Usb_Port_Path(device_path);   // replugged: look up the port again
+
+        entry.channels = int(p->type);
+        entry.order = order;
+        entry.device_path = device_path;
+        entry.present = true;
+        entry.last_seen = now;
+        seen[entry.sn] = true;
+    }
+
+    usb_relay_device_free_enumerate(list);
+
+    for (auto& [sn, entry] : entries)
+    {
+        if (entry.present && !seen.count(sn))
+        {
+            entry.present = false;
+            changed = true;
+        }
+    }
+
+    if (Apply_Notes())
+        changed = true;
+
+    if (changed && !path.empty())
+        Write();
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Present
+* Arguments  : channels  = receives the sernum and channels of each module
+* Returns    : true = there is at least one module, false = none
+* Description:
+*   Lists the modules that were on the bus at the last reconcile, in the
+*   order they were enumerated
+*/
+bool Inventory::Present(MODULE_CHANNELS& channels)
+{
+    lock_guard<mutex> guard(lock);
+    map<int, channels_t> ordered;
+
+    for (auto const& [sn, entry] : entries)
+    {
+        if (entry.present)
+            ordered[entry.order] = channels_t{ sn, entry.channels };
+    }
+
+    channels.clear();
+    for (auto const& [order, ch] : ordered)
+        channels.push_back(ch);
+
+    return !channels.empty();
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Entries
+* Arguments  : none
+* Returns    : every module ever seen, sorted by sernum
+* Description:
+*   Returns a copy of the inventory
+*/
+vector<inventory_t> Inventory::Entries()
+{
+    lock_guard<mutex> guard(lock);
+    vector<inventory_t> list;
+
+    for (auto const& [sn, entry] : entries)
+        list.push_back(entry);
+
+    return list;
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Note
+* Arguments  : sernum      = serial number of the module
+*              latency_us  = mean I/O latency measured (0 = none)
+*              quirks      = QUIRK_* bits seen
+* Returns    : none
+* Description:
+*   Records measurements to be saved by the next Reconcile or Flush. Only a
+*   latency that differs noticeably from the saved one, or a quirk not seen
+*   before, is worth saving.
+*/
+void Inventory::Note(const string& sernum, uint32_t latency_us, uint16_t quirks)
+{
+    lock_guard<mutex> guard(lock);
+    auto it = entries.find(sernum);
+
+    if (it == entries.end())
+        return;
+
+    const uint32_t saved = it->second.latency_us;
+    const bool new_latency = latency_us && (saved == 0 || latency_us > saved + saved / 4 || latency_us < saved - saved / 4);
+    const bool new_quirks = (quirks & ~it->second.quirks) != 0;
+
+    if (new_latency || new_quirks)
+        notes[sernum] = { new_latency ? latency_us : 0, quirks };
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Flush
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Saves the measurements recorded by Note (the file is read again first,
+*   so changes made by other processes are kept)
+*/
+void Inventory::Flush()
+{
+    lock_guard<mutex> guard(lock);
+
+    if (notes.empty() || path.empty())
+        return;
+
+    Device_Lock file_lock(INVENTORY_LOCK_NAME);
+    Read();
+    Apply_Notes();
+    Write();
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Apply_Notes
+* Arguments  : none
+* Returns    : true if there were any measurements
+* Description:
+*   Moves the measurements recorded by Note into the entries (the caller
+*   holds lock)
+*/
+bool Inventory::Apply_Notes()
+{
+    const bool any = !notes.empty();
+
+    for (auto const& [sn, note] : notes)
+    {
+        auto it = entries.find(sn);
+
+        if (it != entries.end())
+        {
+            it->second.latency_us = note.first ? note.first : it->second.latency_us;
+            it->second.quirks |= note.second;
+        }
+    }
+
+    notes.clear();
+
+    return any;
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Read
+* Arguments  : none
+* Returns    : true = success, false = no file, or not an inventory file
+* Description:
+*   Reads the whole file with one read and replaces the entries with it
+*   (the caller holds lock)
+*/
+bool Inventory::Read()
+{
+    ifstream file(path, ios::binary | ios::ate);
+
+    if (!file.is_open())
+        return false;
+
+    const streamoff size = file.tellg();
+    string data(size_t(max<streamoff>(size, 0)), '\0');
+
+    file.seekg(0);
+    if (!file.read(data.data(), data.size()) || data.size() < INVENTORY_HEADER_SIZE
+        || memcmp(data.data(), INVENTORY_MAGIC, 8) != 0)
+    {
+        return false;
+    }
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* end = p + data.size();
+    const uint64_t count = Get_Le(p + 8, 4);
+
+    p += INVENTORY_HEADER_SIZE;
+    entries.clear();
+
+    for (uint64_t i = 0; i < count && end - p >= ptrdiff_t(INVENTORY_RECORD_SIZE); ++i)
+    {
+        inventory_t entry;
+        const size_t device_len = size_t(Get_Le(p + 38, 2));
+        const size_t port_len = size_t(Get_Le(p + 40, 2));
+
+        if (size_t(end - p) < INVENTORY_RECORD_SIZE + device_len + port_len)
+            break;      // truncated
+
+        entry.sn.assign(reinterpret_cast<const char*>(p), strnlen(reinterpret_cast<const char*>(p), INVENTORY_SN_SIZE));
+        entry.channels = p[12];
+        entry.present = (p[13] != 0);
+        entry.quirks = uint16_t(Get_Le(p + 14, 2));
+        entry.order = int(Get_Le(p + 16, 2));
+        entry.latency_us = uint32_t(Get_Le(p + 18, 4));
+        entry.first_seen = Get_Le(p + 22, 8);
+        entry.last_seen = Get_Le(p + 30, 8);
+        p += INVENTORY_RECORD_SIZE;
+        entry.device_path.assign(reinterpret_cast<const char*>(p), device_len);
+        p += device_len;
+        entry.port_path.assign(reinterpret_cast<const char*>(p), port_len);
+        p += port_len;
+
+        entries[entry.sn] = entry;
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Inventory::Write
+* Arguments  : none
+* Returns    : true = success, false = the file could not be written
+* Description:
+*   Writes the inventory to a new file and renames it over the old one, so
+*   a reader never sees half a file (the caller holds lock and the file lock)
+*/
+bool Inventory::Write()
+{
+    string data(INVENTORY_MAGIC, 8);
+
+    Put_Le(data, entries.size(), 4);
+
+    for (auto const& [sn, entry] : entries)
+    {
+        const string device_path = entry.device_path.substr(0, 0xFFFF);
+        const string port_path = entry.port_path.substr(0, 0xFFFF);
+        char name[INVENTORY_SN_SIZE] = {};
+
+        memcpy(name, sn.data(), min(sn.size(), INVENTORY_SN_SIZE));
+        data.append(name, INVENTORY_SN_SIZE);
+        Put_Le(data, uint64_t(entry.channels), 1);
+        Put_Le(data, entry.present ? 1 : 0, 1);
+        Put_Le(data, entry.quirks, 2);
+        Put_Le(data, uint64_t(entry.order), 2);
+        Put_Le(data, entry.latency_us, 4);
+        Put_Le(data, entry.first_seen, 8);
+        Put_Le(data, entry.last_seen, 8);
+        Put_Le(data, device_path.size(), 2);
+        Put_Le(data, port_path.size(), 2);
+        data += device_path + port_path;
+    }
+
+    const string temp = path + ".tmp";
+    {
+        ofstream file(temp, ios::binary | ios::trunc);
+
+        if (!file.is_open() || !file.write(data.data(), data.size()))
+            return false;
+    }
+
+    error_code ec;
+    filesystem::rename(temp, path, ec);
+
+    return !ec;
+}
+
+
+/*******************************************************************************
+* Function   : Usb_Port_Path
+* Arguments  : device_path  = device path reported by the driver
+* Returns    : chain of hub ports the module is plugged into, "" if unknown
+* Description:
+*   Windows: the location path of the USB device the HID interface belongs
+*   to, e.g. PCIROOT(0)#PCI(1400)#USBROOT(0)#USB(2)#USB(3).
+*   Linux (hidraw): the sysfs port name, e.g. 1-2.3 (bus 1, port 2, port 3).
+*/
+static string Usb_Port_Path(const string& device_path)
+{
+#ifdef _WIN32
+    // \\?\hid#vid_16c0&pid_05df#7&1d1c5d0a&0&0000#{guid} -> hid\vid_16c0&pid_05df\7&1d1c5d0a&0&0000
+    string id = device_path;
+
+    if (id.rfind("\\\\?\\", 0) == 0)
+        id = id.substr(4);
+    if (id.find("#{") != string::npos)
+        id = id.substr(0, id.find("#{"));
+    replace(id.begin(), id.end(), '#', '\\');
+
+    DEVINST hid = 0, usb = 0;
+    char buffer[1024] = {};
+    ULONG len = sizeof(buffer);
+
+    if (id.empty()
+        || CM_Locate_DevNodeA(&hid, id.data(), CM_LOCATE_DEVNODE_NORMAL) != CR_SUCCESS
+        || CM_Get_Parent(&usb, hid, 0) != CR_SUCCESS)
+    {
+        return "";
+    }
+
+    if (CM_Get_DevNode_Registry_PropertyA(usb, CM_DRP_LOCATION_PATHS, nullptr, buffer, &len, 0) == CR_SUCCESS)
+        return buffer;      // the first of a multi-string
+
+    len = sizeof(buffer);
+    if (CM_Get_DevNode_Registry_PropertyA(usb, CM_DRP_LOCATION_INFORMATION, nullptr, buffer, &len, 0) == CR_SUCCESS)
+        return buffer;
+
+    return "";
+#else
+    // /dev/hidrawN -> /sys/devices/.../usb1/1-2/1-2.3/1-2.3:1.0/0003:16C0:05DF.0001/hidraw/hidrawN
+    const regex regex_port("^[0-9]+-[0-9.]+$");
+    const string node = filesystem::path(device_path).filename().string();
+    error_code ec;
+
+    if (node.rfind("hidraw", 0) != 0)
+        return "";
+
+    const filesystem::path sys = filesystem::canonical("/sys/class/hidraw/" + node, ec);
+    string port = "";
+
+    if (ec)
+        return "";
+
+    for (auto const& part : sys)
+    {
+        if (regex_match(part.string(), regex_port))
+            port = part.string();   // the last one is the module's own port
+    }
+
+    return port;
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Put_Le
+* Arguments  : out    = string to append to
+*              value  = value to append
+*              bytes  = width in bytes
+* Returns    : none
+* Description:
+*   Appends a little-endian integer
+*/
+static void Put_Le(string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        out += char(value >> (8 * i));
+}
+
+
+/*******************************************************************************
+* Function   : Get_Le
+* Arguments  : p      = first byte
+*              bytes  = width in bytes
+* Returns    : the value
+* Description:
+*   Reads a little-endian integer
+*/
+static uint64_t Get_Le(const unsigned char* p, int bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = bytes - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+
+    return value;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,92 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayInventory.h
+* Description:
+*   Persistent inventory of every module ever seen: when it was seen, its
+*   channels, where it is plugged in, how it behaves, and how fast it is.
+*   Lookups are served from the inventory; the bus is enumerated only to
+*   reconcile it with what is really there.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Relay.h"
+
+// protocol quirks seen on a module (inventory_t::quirks)
+constexpr uint16_t QUIRK_STATUS_BITS = 0x0001;     // reports status bits beyond its channels
+constexpr uint16_t QUIRK_TIMEOUT = 0x0002;         // has missed a deadline
+constexpr uint16_t QUIRK_IO_ERROR = 0x0004;        // has failed a call after retries
+
+// what is known about one module
+struct inventory_t
+{
+    std::string sn = "";
+    int channels = 0;               // channel type: 1, 2, 4 or 8
+    bool present = false;           // on the bus at the last reconcile
+    int order = 0;                  // position in that enumeration
+    uint16_t quirks = 0;            // QUIRK_*
+    uint32_t latency_us = 0;        // mean I/O latency, 0 = not measured
+    uint64_t first_seen = 0;        // microseconds since 1970-01-01 UTC
+    uint64_t last_seen = 0;
+    std::string device_path = "";   // driver's device path
+    std::string port_path = "";     // USB port chain, "" if unknown
+};
+
+// The file is an 8-byte header and a count, then one record per module: 42
+// bytes of fixed fields followed by the two paths. It is read with a single
+// read and replaced as a whole (it holds at most a few hundred modules), and
+// it is only written when something changes.
+class Inventory
+{
+public:
+    explicit Inventory(const std::string& path);
+    Inventory(const Inventory&) = delete;
+    Inventory& operator=(const Inventory&) = delete;
+
+    // read the file; false if there is none (or it cannot be used)
+    bool Load();
+
+    // enumerate the bus and update the inventory to match (the driver must
+    // be initialized); saves the file if anything changed
+    void Reconcile();
+
+    // modules present at the last reconcile; false if there are none
+    bool Present(MODULE_CHANNELS& channels);
+
+    // every module ever seen, sorted by sernum
+    std::vector<inventory_t> Entries();
+
+    // measurements to be saved by the next Reconcile or Flush
+    void Note(const std::string& sernum, uint32_t latency_us, uint16_t quirks);
+    void Flush();
+
+private:
+    bool Apply_Notes();
+    bool Read();
+    bool Write();
+
+    std::mutex lock;                // guards everything below
+    std::string path;
+    std::map<std::string, inventory_t> entries;
+    std::map<std::string, std::pair<uint32_t, uint16_t>> notes;    // sernum -> latency, quirks
+};
+
+// the inventory file: RELAY_INVENTORY_FILE if set (empty to keep none),
+// otherwise %ProgramData%\WWES_Relay.inventory (Windows) or
+// /var/tmp/WWES_Relay.inventory
+std::string Inventory_Path();
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
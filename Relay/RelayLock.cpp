@@ -0,0 +1,108 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayLock.cpp
+* Description:
+*   Cross-process lock for one relay module (addressed by its serial number)
+*   Windows: named mutex; elsewhere: flock() on a file in /tmp
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+#include <algorithm>
+#include "RelayLock.h"
+
+#ifdef _WIN32
+// mutex names are WWES_Relay_<sernum> in the global (all sessions) namespace,
+// falling back to the session namespace if global objects cannot be created
+constexpr char LOCK_NAME_GLOBAL[] = "Global\\WWES_Relay_";
+constexpr char LOCK_NAME_LOCAL[] = "Local\\WWES_Relay_";
+#else
+// lock files are /tmp/WWES_Relay_<sernum>.lock, readable by every user (flock
+// needs only read access, so no one but their creator can write them)
+constexpr char LOCK_FILE_PREFIX[] = "/tmp/WWES_Relay_";
+constexpr char LOCK_FILE_SUFFIX[] = ".lock";
+constexpr mode_t LOCK_FILE_MODE = 0644;
+#endif
+
+
+/*******************************************************************************
+* Function   : Device_Lock::Device_Lock
+* Arguments  : sernum  = serial number of the module to lock
+* Returns    : none
+* Description:
+*   Waits until no other process or thread holds the lock for this sernum.
+*   A lock abandoned by a process that exited is taken over. A lock file
+*   this process creates is set to LOCK_FILE_MODE whatever the umask, so
+*   processes of other users can take the lock too; an existing one is
+*   opened for reading only, and not through a symbolic link.
+*/
+Device_Lock::Device_Lock(const std::string& sernum)
+{
+    std::string sn = sernum;
+    std::transform(sn.begin(), sn.end(), sn.begin(), ::toupper);
+
+#ifdef _WIN32
+    hMutex = CreateMutexA(NULL, FALSE, (LOCK_NAME_GLOBAL + sn).c_str());
+
+    if (!hMutex)
+        hMutex = CreateMutexA(NULL, FALSE, (LOCK_NAME_LOCAL + sn).c_str());
+
+    if (hMutex)
+    {
+        DWORD result = WaitForSingleObject(hMutex, INFINITE);
+        bLocked = (result == WAIT_OBJECT_0 || result == WAIT_ABANDONED);
+    }
+#else
+    const std::string path = LOCK_FILE_PREFIX + sn + LOCK_FILE_SUFFIX;
+
+    fd = open(path.c_str(), O_RDONLY | O_CREAT | O_EXCL | O_CLOEXEC, LOCK_FILE_MODE);
+
+    if (fd >= 0)
+        fchmod(fd, LOCK_FILE_MODE);
+    else
+        fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+    if (fd >= 0)
+        bLocked = (flock(fd, LOCK_EX) == 0);
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Device_Lock::~Device_Lock
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Releases the lock
+*/
+Device_Lock::~Device_Lock()
+{
+#ifdef _WIN32
+    if (bLocked)
+        ReleaseMutex(hMutex);
+
+    if (hMutex)
+        CloseHandle(hMutex);
+#else
+    if (fd >= 0)
+        close(fd);  // releases the flock
+#endif
+}
+
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
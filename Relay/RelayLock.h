@@ -0,0 +1,44 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayLock.h
+* Description:
+*   Cross-process lock for one relay module (addressed by its serial number)
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <string>
+
+// Holds a system-wide lock (a named mutex on Windows, flock elsewhere) for one
+// sernum for the lifetime of the object.
+// Processes (and threads) working on different modules never wait for each other;
+// those working on the same module are serialized. The lock is released
+// automatically if the owning process exits.
+class Device_Lock
+{
+public:
+    explicit Device_Lock(const std::string& sernum);
+    ~Device_Lock();
+    Device_Lock(const Device_Lock&) = delete;
+    Device_Lock& operator=(const Device_Lock&) = delete;
+
+    bool Is_Locked() const { return bLocked; }
+
+private:
+#ifdef _WIN32
+    void* hMutex = nullptr;
+#else
+    int fd = -1;
+#endif
+    bool bLocked = false;
+};
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,161 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayPlans.cpp
+* Description:
+*   Cache of the server's write plans: the parsed, alias-resolved and
+*   validated form of a request, looked up by its normalized text so that a
+*   repeated request skips parsing and resolution
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <algorithm>
+using namespace std;
+
+#include "RelayPlans.h"
+
+
+/*******************************************************************************
+* Function   : Plan_Cache::Plan_Cache
+* Arguments  : capacity  = most plans kept
+* Returns    : none
+* Description:
+*   Creates an empty cache
+*/
+Plan_Cache::Plan_Cache(size_t capacity) : capacity(max<size_t>(capacity, 1))
+{
+    stats.capacity = this->capacity;
+}
+
+
+/*******************************************************************************
+* Function   : Plan_Cache::Find
+* Arguments  : key         = normalized request (see Plan_Key)
+*              generation  = receives the generation to insert a new plan with
+* Returns    : the plan, or nullptr if there is none
+* Description:
+*   Looks up a plan and makes it the most recently used
+*/
+shared_ptr<const write_plan_t> Plan_Cache::Find(const string& key, uint64_t& generation)
+{
+    lock_guard<mutex> guard(lock);
+    auto it = index.find(key);
+
+    generation = this->generation;
+
+    if (it == index.end())
+    {
+        ++stats.misses;
+        return nullptr;
+    }
+
+    ++stats.hits;
+    order.splice(order.begin(), order, it->second);
+
+    return it->second->second;
+}
+
+
+/*******************************************************************************
+* Function   : Plan_Cache::Insert
+* Arguments  : key         = normalized request
+*              plan        = its plan
+*              generation  = from the Find that missed it
+* Returns    : none
+* Description:
+*   Keeps the plan as the most recently used, dropping the least recently
+*   used if the cache is full. A plan made before an invalidation is dropped.
+*/
+void Plan_Cache::Insert(const string& key, shared_ptr<const write_plan_t> plan, uint64_t generation)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (generation != this->generation)
+        return;
+
+    auto it = index.find(key);
+
+    if (it != index.end())
+    {   // made by another client at the same time
+        it->second->second = plan;
+        order.splice(order.begin(), order, it->second);
+        return;
+    }
+
+    order.emplace_front(key, plan);
+    index[key] = order.begin();
+
+    if (order.size() > capacity)
+    {
+        index.erase(order.back().first);
+        order.pop_back();
+        ++stats.evictions;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Plan_Cache::Invalidate
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Drops every plan, and any plan being made from the old state
+*/
+void Plan_Cache::Invalidate()
+{
+    lock_guard<mutex> guard(lock);
+
+    order.clear();
+    index.clear();
+    ++generation;
+    ++stats.invalidations;
+}
+
+
+/*******************************************************************************
+* Function   : Plan_Cache::Stats
+* Arguments  : none
+* Returns    : the counters
+* Description:
+*   Reports the size of the cache and how it has been used
+*/
+plan_stats_t Plan_Cache::Stats()
+{
+    lock_guard<mutex> guard(lock);
+    plan_stats_t s = stats;
+
+    s.entries = order.size();
+    return s;
+}
+
+
+/*******************************************************************************
+* Function   : Plan_Key
+* Arguments  : cmd   = request word (SET, TOGGLE, ...)
+*              args  = its arguments
+* Returns    : the key
+* Description:
+*   Normalizes a request: every word in upper case, separated by one space.
+*   Sernums, aliases, states and commands are all case-insensitive, so
+*   requests that differ only in case or spacing share a plan.
+*/
+string Plan_Key(const string& cmd, const vector<string>& args)
+{
+    string key = cmd;
+
+    for (string const& arg : args)
+        key += " " + arg;
+
+    std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+
+    return key;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
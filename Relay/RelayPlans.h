@@ -0,0 +1,85 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayPlans.h
+* Description:
+*   Cache of the server's write plans: the parsed, alias-resolved and
+*   validated form of a request, looked up by its normalized text so that a
+*   repeated request skips parsing and resolution
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Relay.h"
+
+// plans kept (least recently used dropped first)
+constexpr size_t PLAN_CACHE_SIZE = 256;
+
+// what a write request does to each module
+struct write_plan_t
+{
+    std::vector<size_t> devs;       // server's index of each module
+    MODULE_RMW rmws;                // operation on each module (sn is resolved)
+};
+
+// cache counters (PLANS)
+struct plan_stats_t
+{
+    size_t entries = 0;
+    size_t capacity = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;
+};
+
+// An LRU of plans keyed by request text. Invalidate drops every plan at once;
+// a plan made from the state before an invalidation is not kept (Insert
+// takes the generation that Find returned when the plan was missed).
+class Plan_Cache
+{
+public:
+    explicit Plan_Cache(size_t capacity = PLAN_CACHE_SIZE);
+    Plan_Cache(const Plan_Cache&) = delete;
+    Plan_Cache& operator=(const Plan_Cache&) = delete;
+
+    // the plan for key, or nullptr (and the generation to insert it with)
+    std::shared_ptr<const write_plan_t> Find(const std::string& key, uint64_t& generation);
+
+    // keep a plan, unless the cache was invalidated since generation
+    void Insert(const std::string& key, std::shared_ptr<const write_plan_t> plan, uint64_t generation);
+
+    // drop every plan (aliases or modules changed)
+    void Invalidate();
+
+    plan_stats_t Stats();
+
+private:
+    using entry_t = std::pair<std::string, std::shared_ptr<const write_plan_t>>;
+
+    std::mutex lock;                // guards everything below
+    size_t capacity;
+    uint64_t generation = 0;
+    std::list<entry_t> order;       // most recently used first
+    std::unordered_map<std::string, std::list<entry_t>::iterator> index;
+    plan_stats_t stats;
+};
+
+// normalized text of a request: the words upper-cased, separated by one space
+std::string Plan_Key(const std::string& cmd, const std::vector<std::string>& args);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,554 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayRecorder.cpp
+* Description:
+*   Compact time-series recording of relay states, and a reader that
+*   reconstructs the state of every module at any time
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include "RelayRecorder.h"
+#include "RelayHistory.h"
+using namespace std;
+
+constexpr char REC_MAGIC_HEADER[] = "RREC";
+constexpr char REC_MAGIC_CHUNK[] = "RCHK";
+constexpr char REC_MAGIC_INDEX[] = "RIDX";
+constexpr char REC_MAGIC_END[] = "REND";
+constexpr uint8_t REC_VERSION = 2;
+constexpr uint32_t REC_OPEN_CHUNK = 0xFFFFFFFF;
+constexpr size_t REC_HEADER = 4 + 1 + 4;
+constexpr size_t REC_DEVICE = 5 + 1;
+constexpr size_t REC_CHUNK_HEADER = 4 + 8 + 4 + 4;
+
+// support function declarations
+static void Put_U32(string& buf, uint32_t v);
+static void Put_U64(string& buf, uint64_t v);
+static void Put_Varint(string& buf, uint64_t v);
+static uint32_t Get_U32(const char* p);
+static uint64_t Get_U64(const char* p);
+static bool Get_Varint(const string& buf, size_t& pos, uint64_t& v);
+
+
+/*******************************************************************************
+* Function   : State_Recorder::~State_Recorder
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Closes the recording (writing the index) if it is still open
+*/
+State_Recorder::~State_Recorder()
+{
+    Close();
+}
+
+
+/*******************************************************************************
+* Function   : State_Recorder::Open
+* Arguments  : filename  = recording to create (overwritten if it exists)
+*              devices   = modules to record, in the order used by Record()
+*              masks     = current state of each module
+* Returns    : true = success, false = failure
+* Description:
+*   Creates the recording, starts the first chunk and the flush thread
+*/
+bool State_Recorder::Open(const string& filename, const MODULE_CHANNELS& devices, const vector<unsigned>& initial)
+{
+    lock_guard<mutex> guard(lock);
+
+    file.open(filename, ios::binary | ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    string buf(REC_MAGIC_HEADER, 4);
+    buf += char(REC_VERSION);
+    Put_U32(buf, uint32_t(devices.size()));
+    for (channels_t s : devices)
+    {
+        s.sn.resize(5, ' ');
+        buf += s.sn;
+        buf += char(s.channels);
+    }
+    file.write(buf.data(), buf.size());
+
+    masks = initial;
+    index.clear();
+    Begin_Chunk(History_Now());
+
+    if (!file.good())
+        return false;
+
+    running = true;
+    flusher = thread(&State_Recorder::Flush_Thread, this);
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : State_Recorder::Record
+* Arguments  : time_us   = time of the change (microseconds since 1970-01-01 UTC)
+*              device    = index of the module (order given to Open)
+*              new_mask  = new state of the module
+* Returns    : none
+* Description:
+*   Appends one transition: the time since the previous transition and the
+*   channels that changed (XOR with the previous state). This is usually
+*   4-5 bytes. The record is flushed to disk by the end of the chunk or
+*   the flush thread, whichever comes first.
+*/
+void State_Recorder::Record(uint64_t time_us, size_t device, unsigned new_mask)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (!file.is_open() || device >= masks.size())
+        return;
+
+    if (time_us < last_time_us)
+        time_us = last_time_us;    // wall clock stepped back
+
+    if (chunk_records >= RECORDER_CHUNK_RECORDS)
+    {
+        End_Chunk();
+        Begin_Chunk(time_us);
+    }
+
+    string buf;
+    Put_Varint(buf, time_us - last_time_us);
+    Put_Varint(buf, device);
+    buf += char((masks[device] ^ new_mask) & 0xFF);
+    file.write(buf.data(), buf.size());
+    dirty = true;
+
+    masks[device] = new_mask;
+    last_time_us = time_us;
+    chunk_records += 1;
+    chunk_bytes += uint32_t(buf.size());
+}
+
+
+/*******************************************************************************
+* Function   : State_Recorder::Close
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Stops the flush thread, completes the last chunk and writes the index
+*/
+void State_Recorder::Close()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+
+    stopped.notify_all();
+
+    if (flusher.joinable())
+        flusher.join();
+
+    lock_guard<mutex> guard(lock);
+
+    if (!file.is_open())
+        return;
+
+    End_Chunk();
+
+    const uint64_t index_offset = uint64_t(file.tellp());
+    string buf(REC_MAGIC_INDEX, 4);
+    Put_U32(buf, uint32_t(index.size()));
+    for (auto const& c : index)
+    {
+        Put_U64(buf, c.start_time_us);
+        Put_U64(buf, c.offset);
+    }
+    Put_U64(buf, index_offset);
+    buf.append(REC_MAGIC_END, 4);
+    file.write(buf.data(), buf.size());
+    file.close();
+}
+
+
+/*******************************************************************************
+* Function   : State_Recorder::Begin_Chunk
+* Arguments  : time_us  = start time of the chunk
+* Returns    : none
+* Description:
+*   Starts a new chunk with the complete current state (so a reader can start
+*   decoding at any chunk). The chunk stays marked open until End_Chunk().
+*/
+void State_Recorder::Begin_Chunk(uint64_t time_us)
+{
+    chunk_offset = uint64_t(file.tellp());
+    index.push_back(rec_chunk_t{ time_us, chunk_offset });
+
+    string buf(REC_MAGIC_CHUNK, 4);
+    Put_U64(buf, time_us);
+    Put_U32(buf, 0);
+    Put_U32(buf, REC_OPEN_CHUNK);
+    for (unsigned m : masks)
+        buf += char(m & 0xFF);
+    file.write(buf.data(), buf.size());
+    file.flush();
+
+    last_time_us = time_us;
+    chunk_records = 0;
+    chunk_bytes = 0;
+}
+
+
+/*******************************************************************************
+* Function   : State_Recorder::End_Chunk
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Patches the record count and payload size into the current chunk header
+*/
+void State_Recorder::End_Chunk()
+{
+    const auto end = file.tellp();
+    string buf;
+
+    Put_U32(buf, chunk_records);
+    Put_U32(buf, chunk_bytes);
+    file.seekp(chunk_offset + 12);
+    file.write(buf.data(), buf.size());
+    file.seekp(end);
+    file.flush();
+    dirty = false;
+}
+
+
+/*******************************************************************************
+* Function   : State_Recorder::Flush_Thread
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Flushes the transitions recorded since the last flush every
+*   RECORDER_FLUSH_MS, so an interrupted recording loses at most that much
+*/
+void State_Recorder::Flush_Thread()
+{
+    unique_lock<mutex> guard(lock);
+
+    while (running)
+    {
+        stopped.wait_for(guard, chrono::milliseconds(RECORDER_FLUSH_MS), [this] { return !running; });
+
+        if (dirty)
+        {
+            file.flush();
+            dirty = false;
+        }
+    }
+}
+
+
+/*******************************************************************************
+* Function   : State_Reader::Open
+* Arguments  : filename  = recording to read
+* Returns    : true = success, false = not a valid recording
+* Description:
+*   Reads the module table and the chunk index. If the recording was not
+*   closed (no index), the index is rebuilt from the chunk headers.
+*/
+bool State_Reader::Open(const string& filename)
+{
+    file.open(filename, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    file.seekg(0, ios::end);
+    file_size = uint64_t(file.tellg());
+    file.seekg(0);
+
+    char hdr[REC_HEADER];
+    if (!file.read(hdr, REC_HEADER) || string(hdr, 4) != REC_MAGIC_HEADER || uint8_t(hdr[4]) != REC_VERSION)
+        return false;
+
+    // the module table and at least one chunk must fit in the file
+    const uint64_t num_devices = Get_U32(hdr + 5);
+    const uint64_t header_end = REC_HEADER + num_devices * REC_DEVICE;
+
+    if (header_end + REC_CHUNK_HEADER + num_devices > file_size)
+        return false;
+
+    devices.clear();
+    for (uint64_t i = 0; i < num_devices; ++i)
+    {
+        char dev[REC_DEVICE];
+        if (!file.read(dev, REC_DEVICE))
+            return false;
+        devices.push_back(channels_t{ string(dev, 5), int(uint8_t(dev[5])) });
+    }
+
+    // use the index if the recording was closed
+    index.clear();
+    char trailer[12];
+    if (file_size >= header_end + 12 && file.seekg(file_size - 12) && file.read(trailer, 12)
+        && string(trailer + 8, 4) == REC_MAGIC_END)
+    {
+        char idx[8];
+        file.seekg(Get_U64(trailer));
+        if (file.read(idx, 8) && string(idx, 4) == REC_MAGIC_INDEX)
+        {
+            for (uint32_t n = Get_U32(idx + 4); n > 0; --n)
+            {
+                char entry[16];
+                if (!file.read(entry, 16))
+                    return false;
+                index.push_back(rec_chunk_t{ Get_U64(entry), Get_U64(entry + 8) });
+            }
+        }
+    }
+
+    // otherwise walk the chunk headers
+    if (index.empty())
+    {
+        file.clear();
+        uint64_t offset = header_end;
+
+        while (offset + REC_CHUNK_HEADER + devices.size() <= file_size)
+        {
+            char chk[REC_CHUNK_HEADER];
+            file.seekg(offset);
+            if (!file.read(chk, REC_CHUNK_HEADER) || string(chk, 4) != REC_MAGIC_CHUNK)
+                break;
+
+            index.push_back(rec_chunk_t{ Get_U64(chk + 4), offset });
+
+            if (Get_U32(chk + 16) == REC_OPEN_CHUNK)
+                break;
+            offset += REC_CHUNK_HEADER + devices.size() + Get_U32(chk + 16);
+        }
+    }
+
+    // the first chunk starts right after the module table (else the count is wrong)
+    if (index.empty() || index.front().offset != header_end)
+        return false;
+
+    // time span and number of records
+    vector<unsigned> masks;
+    num_records = 0;
+    for (size_t i = 0; i + 1 < index.size(); ++i)
+    {
+        char chk[REC_CHUNK_HEADER];
+        file.clear();
+        file.seekg(index[i].offset);
+        if (file.read(chk, REC_CHUNK_HEADER))
+            num_records += Get_U32(chk + 12);
+    }
+
+    uint32_t last_records = 0;
+    first_time_us = index.front().start_time_us;
+    if (!Read_Chunk(index.size() - 1, UINT64_MAX, masks, &last_time_us, &last_records))
+        return false;
+    num_records += last_records;
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : State_Reader::State_At
+* Arguments  : time_us  = time of interest (microseconds since 1970-01-01 UTC)
+*              masks    = receives the state of each module at that time
+* Returns    : true = success, false = time is before the recording started
+* Description:
+*   Finds the chunk covering the time with a binary search of the index, then
+*   applies the transitions of that chunk only
+*/
+bool State_Reader::State_At(uint64_t time_us, vector<unsigned>& masks)
+{
+    auto it = upper_bound(index.begin(), index.end(), time_us,
+        [](uint64_t t, const rec_chunk_t& c) { return t < c.start_time_us; });
+
+    if (it == index.begin())
+        return false;
+
+    return Read_Chunk(size_t(it - index.begin()) - 1, time_us, masks);
+}
+
+
+/*******************************************************************************
+* Function   : State_Reader::Read_Chunk
+* Arguments  : chunk     = index of the chunk
+*              until_us  = apply transitions up to and including this time
+*              masks     = receives the resulting state
+*              pend_us   = optionally receives the time of the last transition applied
+*              precords  = optionally receives the number of transitions applied
+* Returns    : true = success, false = chunk could not be read
+* Description:
+*   Decodes one chunk. A truncated last record (interrupted recording) is ignored.
+*/
+bool State_Reader::Read_Chunk(size_t chunk, uint64_t until_us, vector<unsigned>& masks, uint64_t* pend_us, uint32_t* precords)
+{
+    char chk[REC_CHUNK_HEADER];
+    string keyframe(devices.size(), '\0');
+
+    file.clear();
+    file.seekg(index[chunk].offset);
+    if (!file.read(chk, REC_CHUNK_HEADER) || string(chk, 4) != REC_MAGIC_CHUNK || !file.read(keyframe.data(), keyframe.size()))
+        return false;
+
+    uint64_t time_us = Get_U64(chk + 4);
+    uint64_t payload = Get_U32(chk + 16);
+    const uint64_t payload_offset = index[chunk].offset + REC_CHUNK_HEADER + devices.size();
+    if (payload == REC_OPEN_CHUNK)
+        payload = file_size - payload_offset;
+
+    string buf(size_t(payload), '\0');
+    if (!file.read(buf.data(), buf.size()))
+        return false;
+
+    masks.assign(devices.size(), 0);
+    for (size_t i = 0; i < devices.size(); ++i)
+        masks[i] = uint8_t(keyframe[i]);
+
+    uint32_t records = 0;
+    size_t pos = 0;
+    while (pos < buf.size())
+    {
+        uint64_t dt, device;
+        if (!Get_Varint(buf, pos, dt) || !Get_Varint(buf, pos, device) || pos >= buf.size())
+            break;
+        const uint8_t x = uint8_t(buf[pos++]);
+
+        if (time_us + dt > until_us)
+            break;
+        time_us += dt;
+        if (device < masks.size())
+            masks[size_t(device)] ^= x;
+        ++records;
+    }
+
+    if (pend_us)
+        *pend_us = time_us;
+    if (precords)
+        *precords = records;
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Recording
+* Arguments  : filename  = recording to read
+*              has_time  = true to print the state at time_us, false for a summary
+*              time_us   = time of interest (microseconds since 1970-01-01 UTC)
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function prints a summary of a recording, or the state of every module
+*   at a given time as sernum:pattern (the same form SET accepts)
+*/
+ERROR_CODES Relays_Recording(const string& filename, bool has_time, uint64_t time_us)
+{
+    State_Reader reader;
+
+    if (!reader.Open(filename))
+        return ERROR_CODES::BAD_FILE;
+
+    if (!has_time)
+    {
+        for (size_t i = 0; i < reader.devices.size(); ++i)
+            std::cout << (i ? "," : "") << reader.devices[i].sn << "(" << reader.devices[i].channels << ")";
+        std::cout << "\n" << reader.first_time_us << " " << reader.last_time_us << " "
+            << reader.num_records << " transitions in " << reader.index.size() << " chunks";
+        return ERROR_CODES::NONE;
+    }
+
+    vector<unsigned> masks;
+    if (!reader.State_At(time_us, masks))
+        return ERROR_CODES::BAD_FILE;
+
+    for (size_t i = 0; i < reader.devices.size(); ++i)
+    {
+        std::cout << (i ? " " : "") << reader.devices[i].sn << ":";
+        for (int ch = 0; ch < reader.devices[i].channels; ++ch)
+            std::cout << ((masks[i] & (1u << ch)) ? '1' : '0');
+    }
+
+    return ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Put_U32, Put_U64, Put_Varint
+* Arguments  : buf  = buffer to append to
+*              v    = value
+* Returns    : none
+* Description:
+*   Little-endian and LEB128 (7 bits per byte) encoders
+*/
+static void Put_U32(string& buf, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        buf += char((v >> (8 * i)) & 0xFF);
+}
+
+static void Put_U64(string& buf, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        buf += char((v >> (8 * i)) & 0xFF);
+}
+
+static void Put_Varint(string& buf, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        buf += char((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    buf += char(v);
+}
+
+
+/*******************************************************************************
+* Function   : Get_U32, Get_U64, Get_Varint
+* Arguments  : p/buf  = data to decode
+*              pos    = position in buf (advanced past the value)
+*              v      = receives the value
+* Returns    : value, or for Get_Varint: true = success, false = truncated
+* Description:
+*   Little-endian and LEB128 (7 bits per byte) decoders
+*/
+static uint32_t Get_U32(const char* p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i)
+        v = (v << 8) | uint8_t(p[i]);
+    return v;
+}
+
+static uint64_t Get_U64(const char* p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i)
+        v = (v << 8) | uint8_t(p[i]);
+    return v;
+}
+
+static bool Get_Varint(const string& buf, size_t& pos, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; pos < buf.size() && shift < 64; shift += 7)
+    {
+        const uint8_t b = uint8_t(buf[pos++]);
+        v |= uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,107 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayRecorder.h
+* Description:
+*   Compact time-series recording of relay states, and a reader that
+*   reconstructs the state of every module at any time
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "Relay.h"
+
+// File layout (all integers little-endian):
+//   header   "RREC" u8 version u32 num_devices { char sn[5] u8 channels } ...
+//   chunk    "RCHK" u64 start_time_us u32 num_records u32 payload_bytes
+//            u8 mask[num_devices]                    (state at start_time_us)
+//            { varint dt_us varint device u8 xor } ... (payload)
+//   index    "RIDX" u32 num_chunks { u64 start_time_us u64 offset } ...
+//   trailer  u64 index_offset "REND"
+// dt_us is relative to the previous record of the chunk (or to start_time_us).
+// payload_bytes is 0xFFFFFFFF for a chunk that was not closed (the recording
+// was interrupted); such a chunk extends to the end of the file and the reader
+// rebuilds the index by walking the chunk headers.
+
+// number of transitions per chunk
+constexpr uint32_t RECORDER_CHUNK_RECORDS = 4096;
+
+// longest a transition stays in the write buffer before it is flushed to disk
+constexpr int RECORDER_FLUSH_MS = 1000;
+
+// one chunk as listed in the index
+struct rec_chunk_t
+{
+    uint64_t start_time_us = 0;
+    uint64_t offset = 0;
+};
+
+// Appends transitions to a recording. Transitions are buffered and flushed
+// to disk at the end of each chunk, and by a thread of its own within
+// RECORDER_FLUSH_MS of being recorded, so recording costs no disk write per
+// transition. Record() may be called from any thread.
+class State_Recorder
+{
+public:
+    ~State_Recorder();
+    bool Open(const std::string& filename, const MODULE_CHANNELS& devices, const std::vector<unsigned>& initial);
+    void Record(uint64_t time_us, size_t device, unsigned new_mask);
+    void Close();
+
+private:
+    void Begin_Chunk(uint64_t time_us);
+    void End_Chunk();
+    void Flush_Thread();
+
+    std::mutex lock;                // guards everything below
+    std::condition_variable stopped;    // closing
+    bool running = false;
+    bool dirty = false;             // transitions not yet flushed
+    std::thread flusher;
+    std::ofstream file;
+    std::vector<unsigned> masks;            // current state of each device
+    std::vector<rec_chunk_t> index;
+    uint64_t chunk_offset = 0;
+    uint64_t last_time_us = 0;
+    uint32_t chunk_records = 0;
+    uint32_t chunk_bytes = 0;
+};
+
+// Reads a recording and reconstructs states
+class State_Reader
+{
+public:
+    bool Open(const std::string& filename);
+    bool State_At(uint64_t time_us, std::vector<unsigned>& masks);
+
+    MODULE_CHANNELS devices;
+    std::vector<rec_chunk_t> index;
+    uint64_t first_time_us = 0;
+    uint64_t last_time_us = 0;
+    uint64_t num_records = 0;
+
+private:
+    bool Read_Chunk(size_t chunk, uint64_t until_us, std::vector<unsigned>& masks, uint64_t* pend_us = nullptr, uint32_t* precords = nullptr);
+
+    std::ifstream file;
+    uint64_t file_size = 0;
+};
+
+// command line: summarize a recording, or print the state at a given time
+ERROR_CODES Relays_Recording(const std::string& filename, bool has_time, uint64_t time_us);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
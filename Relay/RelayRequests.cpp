@@ -0,0 +1,301 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayRequests.cpp
+* Description:
+*   Bounded lock-free table of recent request IDs and their replies, so a
+*   request retried by a client is answered without being carried out again
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <chrono>
+#include <thread>
+#include "RelayRequests.h"
+
+static_assert((REQUEST_TABLE_SIZE & (REQUEST_TABLE_SIZE - 1)) == 0, "REQUEST_TABLE_SIZE must be a power of 2");
+static_assert(REQUEST_PROBE <= REQUEST_TABLE_SIZE, "REQUEST_PROBE must not exceed REQUEST_TABLE_SIZE");
+
+// how often a retry checks whether the original request is done
+constexpr std::chrono::milliseconds REQUEST_POLL{ 1 };
+
+// support function declarations
+static uint64_t Request_Key(const std::string& id);
+static uint64_t Request_Now();
+
+
+/*******************************************************************************
+* Function   : Request_Table::Begin
+* Arguments  : id       = request ID, scoped by the caller
+*              request  = text of the request
+*              slot     = receives the slot to pass to Complete (NEW)
+*              reply    = receives the original reply (DONE)
+* Returns    : what to do with the request (see BEGIN)
+* Description:
+*   Looks for the ID among the slots it can go in. If it is there with a
+*   different request, the ID is being reused (CONFLICT). If it is not
+*   there, a slot is claimed for it. Two threads can claim slots for the same ID at once;
+*   each then looks again, and the one further along the search yields, so
+*   only one of them carries out the request.
+*/
+Request_Table::BEGIN Request_Table::Begin(const std::string& id, const std::string& request, size_t& slot, std::string& reply)
+{
+    const uint64_t key = Request_Key(id);
+    const uint64_t hash = Request_Key(request);
+    const size_t home = size_t(key) & (REQUEST_TABLE_SIZE - 1);
+
+    for (;;)
+    {
+        const uint64_t now = Request_Now();
+        size_t found = REQUEST_TABLE_SIZE;
+        size_t stale = REQUEST_TABLE_SIZE;      // first free or stale slot
+        size_t oldest = REQUEST_TABLE_SIZE;     // oldest finished slot
+        uint64_t stale_ctl = 0, oldest_ctl = 0;
+        uint64_t oldest_us = UINT64_MAX;
+
+        for (size_t p = 0; p < REQUEST_PROBE && found == REQUEST_TABLE_SIZE; ++p)
+        {
+            const size_t idx = (home + p) & (REQUEST_TABLE_SIZE - 1);
+            const slot_t& s = slots[idx];
+            const uint64_t ctl = s.ctl.load();
+
+            if (!Is_Live(s, ctl, now))
+            {
+                if (stale == REQUEST_TABLE_SIZE)
+                {
+                    stale = idx;
+                    stale_ctl = ctl;
+                }
+            }
+            else if (s.key.load() == key)
+            {
+                found = idx;
+            }
+            else if ((ctl & 3) != SLOT_RUNNING && s.time_us.load() < oldest_us)
+            {
+                oldest = idx;
+                oldest_ctl = ctl;
+                oldest_us = s.time_us.load();
+            }
+        }
+
+        if (found != REQUEST_TABLE_SIZE)
+        {
+            const slot_t& s = slots[found];
+            const uint64_t ctl = s.ctl.load(std::memory_order_acquire);
+
+            if (s.request.load() != hash)
+            {
+                if (s.ctl.load() != ctl || s.key.load() != key)
+                    continue;   // reused meanwhile
+                return BEGIN::CONFLICT;
+            }
+
+            if ((ctl & 3) == SLOT_RUNNING)
+            {   // the original is still being carried out
+                std::this_thread::sleep_for(REQUEST_POLL);
+                continue;
+            }
+
+            if ((ctl & 3) == SLOT_LONG)
+            {
+                repeats.fetch_add(1, std::memory_order_relaxed);
+                return BEGIN::FORGOTTEN;
+            }
+
+            if ((ctl & 3) != SLOT_DONE)
+                continue;
+
+            const size_t length = size_t(s.length.load(std::memory_order_relaxed));
+            std::string copy(length, '\0');
+
+            for (size_t i = 0; i < length; ++i)
+                copy[i] = char(s.reply[i / 8].load(std::memory_order_relaxed) >> (8 * (i % 8)));
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.ctl.load(std::memory_order_relaxed) != ctl || s.key.load() != key || s.request.load() != hash)
+                continue;   // reused while copying
+
+            reply = copy;
+            repeats.fetch_add(1, std::memory_order_relaxed);
+            return BEGIN::DONE;
+        }
+
+        // claim a free slot, or failing that the oldest finished one
+        const size_t victim = (stale != REQUEST_TABLE_SIZE) ? stale : oldest;
+        const size_t victim_probe = (victim - home) & (REQUEST_TABLE_SIZE - 1);
+
+        if (victim == REQUEST_TABLE_SIZE)
+            return BEGIN::FULL;
+
+        if (!Claim(victim, key, hash, (victim == stale) ? stale_ctl : oldest_ctl))
+            continue;
+
+        // another claim for the same ID nearer home (or already finished) wins
+        bool yield = false;
+
+        for (size_t p = 0; p < REQUEST_PROBE && !yield; ++p)
+        {
+            const size_t idx = (home + p) & (REQUEST_TABLE_SIZE - 1);
+            const slot_t& s = slots[idx];
+            const uint64_t ctl = s.ctl.load();
+
+            if (idx != victim && Is_Live(s, ctl, now) && s.key.load() == key)
+                yield = ((ctl & 3) != SLOT_RUNNING) || p < victim_probe;
+        }
+
+        if (yield)
+        {
+            Release(victim);
+            continue;
+        }
+
+        slot = victim;
+        return BEGIN::NEW;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Request_Table::Complete
+* Arguments  : slot   = slot returned by Begin
+*              reply  = reply to the request
+*              keep   = false to forget the ID
+* Returns    : none
+* Description:
+*   Stores the reply and marks the request done, releasing any retries
+*   waiting for it
+*/
+void Request_Table::Complete(size_t slot, const std::string& reply, bool keep)
+{
+    slot_t& s = slots[slot];
+    const uint64_t ctl = s.ctl.load();
+
+    if (!keep)
+    {
+        Release(slot);
+        return;
+    }
+
+    if (reply.size() <= REQUEST_REPLY_MAX)
+    {
+        for (size_t w = 0; w < (reply.size() + 7) / 8; ++w)
+        {
+            uint64_t word = 0;
+
+            for (size_t i = w * 8; i < reply.size() && i < w * 8 + 8; ++i)
+                word |= uint64_t(uint8_t(reply[i])) << (8 * (i % 8));
+
+            s.reply[w].store(word, std::memory_order_relaxed);
+        }
+
+        s.length.store(reply.size(), std::memory_order_relaxed);
+    }
+
+    s.time_us.store(Request_Now(), std::memory_order_relaxed);
+    s.ctl.store((((ctl >> 2) + 1) << 2) | ((reply.size() <= REQUEST_REPLY_MAX) ? SLOT_DONE : SLOT_LONG), std::memory_order_release);
+}
+
+
+/*******************************************************************************
+* Function   : Request_Table::Claim
+* Arguments  : idx      = slot to claim
+*              key      = hash of the ID
+*              request  = hash of the request
+*              ctl      = control word the slot was seen with
+* Returns    : true = claimed, false = the slot changed meanwhile
+* Description:
+*   Marks the slot running for the ID
+*/
+bool Request_Table::Claim(size_t idx, uint64_t key, uint64_t request, uint64_t ctl)
+{
+    slot_t& s = slots[idx];
+
+    if (!s.ctl.compare_exchange_strong(ctl, (((ctl >> 2) + 1) << 2) | SLOT_RUNNING))
+        return false;
+
+    s.request.store(request);
+    s.key.store(key);
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Request_Table::Release
+* Arguments  : idx  = slot claimed by this thread
+* Returns    : none
+* Description:
+*   Frees a claimed slot without recording a reply
+*/
+void Request_Table::Release(size_t idx)
+{
+    slot_t& s = slots[idx];
+    const uint64_t ctl = s.ctl.load();
+
+    s.key.store(0);
+    s.ctl.store((((ctl >> 2) + 1) << 2) | SLOT_FREE);
+}
+
+
+/*******************************************************************************
+* Function   : Request_Table::Is_Live
+* Arguments  : s       = slot
+*              ctl     = its control word
+*              now_us  = current time
+* Returns    : true if the slot holds a running request or a reply not yet stale
+* Description:
+*   Decides whether a slot still counts
+*/
+bool Request_Table::Is_Live(const slot_t& s, uint64_t ctl, uint64_t now_us) const
+{
+    switch (ctl & 3)
+    {
+    case SLOT_RUNNING:
+        return true;
+    case SLOT_DONE:
+    case SLOT_LONG:
+        return now_us - s.time_us.load() < REQUEST_TTL_US;
+    default:
+        return false;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Request_Key
+* Arguments  : id  = request ID (or request text)
+* Returns    : 64-bit hash of the ID (never 0)
+* Description:
+*   FNV-1a hash
+*/
+static uint64_t Request_Key(const std::string& id)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned char c : id)
+        hash = (hash ^ c) * 0x100000001b3ull;
+
+    return hash ? hash : 1;
+}
+
+
+/*******************************************************************************
+* Function   : Request_Now
+* Arguments  : none
+* Returns    : microseconds on a clock that never goes back
+* Description:
+*   Time base for the age of replies
+*/
+static uint64_t Request_Now()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,86 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayRequests.h
+* Description:
+*   Bounded lock-free table of recent request IDs and their replies, so a
+*   request retried by a client is answered without being carried out again
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+
+// table size (power of 2), slots searched for one ID, and how long a reply is kept
+constexpr size_t REQUEST_TABLE_SIZE = 1024;
+constexpr size_t REQUEST_PROBE = 16;
+constexpr uint64_t REQUEST_TTL_US = 300000000;  // 5 minutes
+
+// longest reply kept (a longer reply is not repeated; see Request_Table::Begin)
+constexpr size_t REQUEST_REPLY_MAX = 512;
+
+// Open-addressed hash table of request IDs. The caller scopes an ID (by
+// client, for example), and each ID is kept with a hash of its request, so a
+// reused ID with a different request is refused rather than answered with
+// the other request's reply. Every field of a slot is atomic
+// and a slot's control word carries a version, so a reader copying a reply
+// can tell that the slot was reused meanwhile. A slot whose request is still
+// running is never reused; a finished one is reused once it is older than
+// REQUEST_TTL_US, or when every slot an ID can go in is taken (oldest first).
+class Request_Table
+{
+public:
+    enum class BEGIN
+    {
+        NEW,        // first time: carry out the request, then call Complete
+        DONE,       // seen before: reply is the original reply
+        FORGOTTEN,  // seen before, but the reply was too long to keep
+        CONFLICT,   // seen before with a different request
+        FULL        // no slot free (every candidate slot is still running)
+    };
+
+    // looks up id; for a request still running, waits until it is done
+    // (request is the request's text, compared with the original's)
+    BEGIN Begin(const std::string& id, const std::string& request, size_t& slot, std::string& reply);
+
+    // records the reply of a NEW request; if keep is false the ID is
+    // forgotten, so a retry is carried out again
+    void Complete(size_t slot, const std::string& reply, bool keep = true);
+
+    // retries answered from the table
+    uint64_t Repeats() const { return repeats.load(std::memory_order_relaxed); }
+
+private:
+    enum : uint64_t { SLOT_FREE = 0, SLOT_RUNNING = 1, SLOT_DONE = 2, SLOT_LONG = 3 };
+
+    static constexpr size_t REPLY_WORDS = REQUEST_REPLY_MAX / 8;
+
+    struct slot_t
+    {
+        std::atomic<uint64_t> ctl{ 0 };         // version << 2 | state
+        std::atomic<uint64_t> key{ 0 };         // hash of the ID (never 0)
+        std::atomic<uint64_t> request{ 0 };     // hash of the request
+        std::atomic<uint64_t> time_us{ 0 };     // when the request finished
+        std::atomic<uint64_t> length{ 0 };
+        std::atomic<uint64_t> reply[REPLY_WORDS] = {};
+    };
+
+    bool Claim(size_t idx, uint64_t key, uint64_t request, uint64_t ctl);
+    void Release(size_t idx);
+    bool Is_Live(const slot_t& s, uint64_t ctl, uint64_t now_us) const;
+
+    std::atomic<uint64_t> repeats{ 0 };
+    slot_t slots[REQUEST_TABLE_SIZE];
+};
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,262 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayRules.cpp
+* Description:
+*   Reactive rules for the server's RULE command: when a module enters a
+*   state, set channels of the same or other modules
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <algorithm>
+using namespace std;
+
+#include "RelayRules.h"
+#include "RelayHistory.h"
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::Rule_Engine
+* Arguments  : num_devices  = number of modules
+*              writer       = makes the writes of each pass
+* Returns    : none
+* Description:
+*   Starts the rule thread, with no rules
+*/
+Rule_Engine::Rule_Engine(size_t num_devices, writer_t writer) :
+    triggers(new atomic<unsigned>[num_devices]), num_devices(num_devices), watching(num_devices), writer(writer)
+{
+    for (size_t i = 0; i < num_devices; ++i)
+        triggers[i] = 0;
+
+    worker = thread(&Rule_Engine::Run, this);
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::~Rule_Engine
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Stops the rule thread (changes still queued are dropped)
+*/
+Rule_Engine::~Rule_Engine()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+
+    queued.notify_all();
+    worker.join();
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::Set
+* Arguments  : rule  = rule to add or replace
+* Returns    : none
+* Description:
+*   Adds the rule, or replaces the rule of the same name (its counts start
+*   over). It sees only changes made from now on.
+*/
+void Rule_Engine::Set(const rule_t& rule)
+{
+    lock_guard<mutex> guard(lock);
+
+    rules[rule.name] = rule;
+    Compile();
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::Remove
+* Arguments  : name  = rule to remove
+* Returns    : true if it was removed, false if there is no such rule
+* Description:
+*   Removes a rule. Writes it has already caused are still made.
+*/
+bool Rule_Engine::Remove(const string& name)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (rules.erase(name) == 0)
+        return false;
+
+    Compile();
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::List
+* Arguments  : none
+* Returns    : every rule, by name
+* Description:
+*   Lists the rules with their counts
+*/
+vector<rule_t> Rule_Engine::List()
+{
+    lock_guard<mutex> guard(lock);
+    vector<rule_t> list;
+
+    for (auto const& [name, rule] : rules)
+        list.push_back(rule);
+
+    return list;
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::Changed
+* Arguments  : dev       = module
+*              old_mask  = state before the change
+*              new_mask  = state after it
+*              time_us   = time of the change
+* Returns    : none
+* Description:
+*   Queues a change for the rule thread, unless it touches no channel that
+*   a rule looks at. Never waits for the rules to run.
+*/
+void Rule_Engine::Changed(size_t dev, unsigned old_mask, unsigned new_mask, uint64_t time_us)
+{
+    if (dev >= num_devices || ((old_mask ^ new_mask) & triggers[dev].load(memory_order_relaxed)) == 0)
+        return;
+
+    {
+        lock_guard<mutex> guard(lock);
+        changes.push_back(change_t{ dev, old_mask, new_mask, time_us });
+    }
+
+    queued.notify_one();
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::Run
+* Arguments  : none
+* Returns    : none
+* Description:
+*   The rule thread. It takes every change queued, fires each rule whose
+*   module changed into its state (it did not match before and does now),
+*   merges the writes of all of them into one per module and client that
+*   defined the rules, and makes them.
+*   Each rule's reaction latency runs from the change that fired it to the
+*   end of that pass. Writes made by rules are changes too, so rules chain.
+*/
+void Rule_Engine::Run()
+{
+    unique_lock<mutex> guard(lock);
+
+    while (running)
+    {
+        if (changes.empty())
+        {
+            queued.wait(guard);
+            continue;
+        }
+
+        vector<change_t> batch;
+        batch.swap(changes);
+
+        map<pair<size_t, uint32_t>, rule_write_t> writes;     // module, client -> write
+        vector<pair<string, uint64_t>> fired;       // rule, time of the change
+
+        for (change_t const& c : batch)
+        {
+            for (rule_t* rule : watching[c.dev])
+            {
+                const bool was = (c.old_mask & rule->care) == rule->expect;
+                const bool is = (c.new_mask & rule->care) == rule->expect;
+
+                if (was || !is)
+                    continue;
+
+                for (rule_write_t const& a : rule->actions)
+                {
+                    // this rule wins over earlier ones, whoever defined them
+                    for (auto it = writes.lower_bound({ a.dev, 0 }); it != writes.end() && it->first.first == a.dev; ++it)
+                    {
+                        it->second.on &= ~(a.on | a.off);
+                        it->second.off &= ~(a.on | a.off);
+                    }
+
+                    rule_write_t& w = writes[{ a.dev, a.client }];
+
+                    w.on |= a.on;
+                    w.off |= a.off;
+                    w.client = a.client;
+                }
+
+                fired.emplace_back(rule->name, c.time_us);
+            }
+        }
+
+        if (writes.empty())
+            continue;
+
+        vector<rule_write_t> list;
+
+        for (auto& [key, w] : writes)
+        {
+            w.dev = key.first;
+            if (w.on | w.off)
+                list.push_back(w);
+        }
+
+        guard.unlock();
+        writer(list);
+        const uint64_t done_us = History_Now();
+        guard.lock();
+
+        for (auto const& [name, time_us] : fired)
+        {
+            auto it = rules.find(name);
+
+            if (it == rules.end())
+                continue;       // removed meanwhile
+
+            const uint64_t latency_us = (done_us > time_us) ? done_us - time_us : 0;
+            rule_t& rule = it->second;
+
+            ++rule.fired;
+            rule.last_us = latency_us;
+            rule.max_us = max(rule.max_us, latency_us);
+            rule.total_us += latency_us;
+        }
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Rule_Engine::Compile
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Rebuilds each module's list of rules and trigger mask (lock held)
+*/
+void Rule_Engine::Compile()
+{
+    for (auto& list : watching)
+        list.clear();
+
+    vector<unsigned> masks(num_devices, 0);
+
+    for (auto& [name, rule] : rules)
+    {
+        watching[rule.dev].push_back(&rule);
+        masks[rule.dev] |= rule.care;
+    }
+
+    for (size_t i = 0; i < num_devices; ++i)
+        triggers[i].store(masks[i], memory_order_relaxed);
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
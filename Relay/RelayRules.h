@@ -0,0 +1,111 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayRules.h
+* Description:
+*   Reactive rules for the server's RULE command: when a module enters a
+*   state, set channels of the same or other modules
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one write to a module made by the rules
+struct rule_write_t
+{
+    size_t dev = 0;                 // module (the caller's index)
+    unsigned on = 0;                // channels to turn on
+    unsigned off = 0;               // channels to turn off
+    uint32_t client = 0;            // who defined the rule (passed to the writer)
+};
+
+// one rule: when module dev changes into the state (care, expect), make the writes
+struct rule_t
+{
+    std::string name = "";
+    size_t dev = 0;                 // module watched
+    unsigned care = 0;              // channels of the trigger pattern
+    unsigned expect = 0;            // their state in the pattern
+    std::vector<rule_write_t> actions;
+    uint32_t client = 0;
+
+    // reaction latency: from the change to the end of the write it caused
+    uint64_t fired = 0;
+    uint64_t last_us = 0;
+    uint64_t max_us = 0;
+    uint64_t total_us = 0;
+};
+
+// Runs the rules from a thread of its own. The rules are compiled into a
+// trigger mask per module (every channel any of its rules looks at), so a
+// change that touches none of them costs one AND and is never queued. The
+// rules fired by the changes queued at once are merged into one write per
+// module and client (the writer checks each client's reservations), later
+// rules winning where they disagree.
+class Rule_Engine
+{
+public:
+    // makes the writes of one pass (modules may be written in parallel)
+    using writer_t = std::function<void(const std::vector<rule_write_t>& writes)>;
+
+    Rule_Engine(size_t num_devices, writer_t writer);
+    ~Rule_Engine();
+    Rule_Engine(const Rule_Engine&) = delete;
+    Rule_Engine& operator=(const Rule_Engine&) = delete;
+
+    // add a rule, or replace the rule of the same name
+    void Set(const rule_t& rule);
+
+    // remove a rule; false if there is none of that name
+    bool Remove(const std::string& name);
+
+    // every rule, by name
+    std::vector<rule_t> List();
+
+    // a module changed state (time_us = History_Now() of the change)
+    void Changed(size_t dev, unsigned old_mask, unsigned new_mask, uint64_t time_us);
+
+private:
+    struct change_t
+    {
+        size_t dev;
+        unsigned old_mask;
+        unsigned new_mask;
+        uint64_t time_us;
+    };
+
+    void Run();
+    void Compile();
+
+    std::unique_ptr<std::atomic<unsigned>[]> triggers;  // dev -> channels watched
+    size_t num_devices = 0;
+
+    std::mutex lock;                // guards everything below
+    std::condition_variable queued; // changes queued, or shutting down
+    bool running = true;
+    std::vector<change_t> changes;
+    std::map<std::string, rule_t> rules;                // name -> rule
+    std::vector<std::vector<rule_t*>> watching;         // dev -> its rules, by name
+
+    writer_t writer;
+    std::thread worker;             // last, so it starts after everything else
+};
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
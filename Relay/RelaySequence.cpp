@@ -0,0 +1,397 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelaySequence.cpp
+* Description:
+*   Power sequencing: turns on groups of channels with a minimum stagger
+*   between the turn-ons of each group, to limit inrush, as fast as the
+*   staggers and the modules allow. Groups are independent, so they all
+*   start at once; turn-ons that fall due on the same module at the same
+*   time are made in one write, and writes to different modules at the same
+*   time are made in parallel.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+#include "RelaySequence.h"
+#include "RelayContext.h"
+#include "RelayTune.h"
+
+// support function declarations
+static void Print_Step(const sequence_step_t& step, int64_t actual_us);
+
+
+/*******************************************************************************
+* Function   : Sequence_Plan
+* Arguments  : profile    = groups of channels to turn on
+*              report_us  = time one report to each module takes
+* Returns    : the writes to make, in order of time
+* Description:
+*   Plans the turn-ons by list scheduling. Each group's next channel can go
+*   at the later of the time its group allows (stagger after the write of
+*   its last channel is done) and the time its module is free (its last
+*   write done, at one report per channel turned on: Relay_Write_Mask writes
+*   channels one at a time).
+*   The earliest of these goes next, the group with the longest remaining
+*   tail first on a tie, and every other channel due on the same module by
+*   then goes in the same write. With modules that take no time to write,
+*   this is the shortest possible: the longest group's (channels - 1) *
+*   stagger.
+*/
+vector<sequence_step_t> Sequence_Plan(const SEQUENCE_PROFILE& profile, const map<string, int64_t>& report_us)
+{
+    struct cursor_t
+    {
+        size_t next = 0;            // next channel of the group to turn on
+        int64_t ready_us = 0;       // when the group allows it
+    };
+
+    vector<sequence_step_t> plan;
+    vector<cursor_t> cursors(profile.size());
+    map<string, int64_t> free_us;   // sernum -> when the module can be written
+
+    auto stagger_us = [&](size_t g) { return int64_t(profile[g].stagger_ms) * 1000; };
+    auto tail_us = [&](size_t g) { return int64_t(profile[g].channels.size() - cursors[g].next - 1) * stagger_us(g); };
+
+    for (;;)
+    {
+        size_t best = profile.size();
+        int64_t best_us = 0;
+
+        for (size_t g = 0; g < profile.size(); ++g)
+        {
+            if (cursors[g].next >= profile[g].channels.size())
+                continue;
+
+            const int64_t t = max(cursors[g].ready_us, free_us[profile[g].channels[cursors[g].next].first]);
+
+            if (best == profile.size() || t < best_us || (t == best_us && tail_us(g) > tail_us(best)))
+            {
+                best = g;
+                best_us = t;
+            }
+        }
+
+        if (best == profile.size())
+            break;
+
+        sequence_step_t step;
+        step.at_us = best_us;
+        step.sn = profile[best].channels[cursors[best].next].first;
+
+        // the chosen channel, and everything else due on the module by then
+        // (a stagger of 0 lets a group add several)
+        vector<size_t> added_groups;
+
+        for (bool added = true; added; )
+        {
+            added = false;
+
+            for (size_t i = 0; i < profile.size(); ++i)
+            {
+                const size_t g = (i == 0) ? best : (i <= best) ? i - 1 : i;
+                cursor_t& c = cursors[g];
+
+                while (c.next < profile[g].channels.size() && profile[g].channels[c.next].first == step.sn
+                    && c.ready_us <= step.at_us)
+                {
+                    step.on |= 1u << (profile[g].channels[c.next].second - 1);
+                    if (find(step.groups.begin(), step.groups.end(), profile[g].name) == step.groups.end())
+                        step.groups.push_back(profile[g].name);
+
+                    if (find(added_groups.begin(), added_groups.end(), g) == added_groups.end())
+                        added_groups.push_back(g);
+
+                    c.ready_us = step.at_us + stagger_us(g);
+                    ++c.next;
+                    added = true;
+                }
+            }
+        }
+
+        auto it = report_us.find(step.sn);
+        free_us[step.sn] = step.at_us + ((it != report_us.end()) ? it->second * popcount(step.on) : 0);
+
+        for (size_t g : added_groups)
+            cursors[g].ready_us = free_us[step.sn] + stagger_us(g);
+
+        plan.push_back(step);
+    }
+
+    return plan;
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Sequence
+* Arguments  : context       = open modules
+*              profile       = groups of channels to turn on
+*              channels      = structure of enumerated channels
+*              plan_only     = print the plan without carrying it out
+*              error_sernum  = receives the sernum of a module that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads every module in the profile, plans the sequence and
+*   prints it, one write per line, in the same form SET takes. Nothing has
+*   been written yet, so the time a write takes is estimated from the read:
+*   a read is one report, as is each channel a write turns on. The estimate
+*   is printed with the plan. Unless plan_only, it then turns the channels
+*   on, timing each group's next turn-on from when the write of its last
+*   channel was actually done, so a write that takes longer than planned
+*   holds the rest of its group back rather than closing up the stagger.
+*   Whenever channels are due, those on each idle module are turned on in
+*   one write, on a thread per module. The plan is only printed, with when
+*   each of its writes' channels were actually all on. No write is started
+*   after one fails, leaving the channels not reached as they were.
+*/
+ERROR_CODES Relays_Sequence(Relay_Context& context, const SEQUENCE_PROFILE& profile, const MODULE_CHANNELS& channels, bool plan_only, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    map<string, unsigned> states;
+    map<string, int64_t> report_us;
+    vector<string> sernums;
+
+    for (sequence_group_t const& group : profile)
+    {
+        for (auto const& [sn, ch] : group.channels)
+        {
+            if (!states.count(sn))
+                sernums.push_back(sn);
+            states[sn] = 0;
+            report_us[sn] = 0;
+        }
+    }
+
+    // read each module once, in parallel
+    vector<ERROR_CODES> results(sernums.size(), ERROR_CODES::NONE);
+
+    Fan_Out(sernums.size(), (sernums.size() > 1) ? Fan_Out_Width(context, channels) : 1, [&](size_t i) {
+        latency_t latency;
+        bool stuck = false;
+
+        results[i] = context.Query(sernums[i], states[sernums[i]]);
+
+        if (context.Latency(sernums[i], latency, stuck))
+            report_us[sernums[i]] = int64_t(latency.mean_us);
+    });
+
+    for (size_t i = 0; i < sernums.size() && error == ERROR_CODES::NONE; ++i)
+    {
+        error = results[i];
+        error_sernum = sernums[i];
+    }
+
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    error_sernum = "";
+
+    vector<sequence_step_t> plan = Sequence_Plan(profile, report_us);
+    map<pair<string, int>, int64_t> done_us;    // sernum, channel -> when it was turned on
+
+    for (sequence_step_t& step : plan)
+        step.channels = Relays_Get_NumChannels(step.sn, channels);
+
+    if (!plan_only)
+    {
+        struct cursor_t
+        {
+            size_t next = 0;            // next channel of the group to turn on
+            int64_t ready_us = 0;       // when the group allows it
+            bool writing = false;       // its last channel's write is under way
+        };
+
+        const auto start = chrono::steady_clock::now();
+        auto elapsed_us = [start] { return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count(); };
+
+        mutex lock;                 // guards everything below
+        condition_variable finished;
+        vector<cursor_t> cursors(profile.size());
+        map<string, bool> busy;     // sernum -> a write is under way
+        size_t num_left = 0;        // channels not yet written
+        size_t in_flight = 0;
+        vector<thread> writers;
+
+        for (sequence_group_t const& group : profile)
+            num_left += group.channels.size();
+
+        unique_lock<mutex> guard(lock);
+
+        while (in_flight > 0 || (error == ERROR_CODES::NONE && num_left > 0))
+        {
+            const int64_t now = elapsed_us();
+            int64_t wake_us = INT64_MAX;
+            map<string, vector<pair<size_t, int>>> batches;     // sernum -> group, channel turned on
+
+            for (size_t g = 0; g < profile.size() && error == ERROR_CODES::NONE; ++g)
+            {
+                cursor_t& c = cursors[g];
+
+                if (c.writing || c.next >= profile[g].channels.size())
+                    continue;
+
+                const string& sn = profile[g].channels[c.next].first;
+
+                if (c.ready_us > now)
+                {
+                    wake_us = min(wake_us, c.ready_us);
+                    continue;
+                }
+
+                if (busy[sn])
+                    continue;
+
+                // a stagger of 0 lets the group add its next channels on the module too
+                do
+                {
+                    batches[sn].emplace_back(g, profile[g].channels[c.next].second);
+                    ++c.next;
+                    --num_left;
+                } while (profile[g].stagger_ms == 0 && c.next < profile[g].channels.size() && profile[g].channels[c.next].first == sn);
+
+                c.writing = true;
+            }
+
+            for (auto const& [sn, batch] : batches)
+            {
+                busy[sn] = true;
+                ++in_flight;
+
+                writers.emplace_back([&, sn = sn, batch = batch] {
+                    unsigned on = 0;
+
+                    for (auto const& [g, ch] : batch)
+                        on |= 1u << (ch - 1);
+
+                    const ERROR_CODES rc = context.Write(sn, states[sn], states[sn] | on);
+                    const int64_t when_us = elapsed_us();
+
+                    lock_guard<mutex> done_guard(lock);
+
+                    if (rc == ERROR_CODES::NONE)
+                    {
+                        states[sn] |= on;
+                        for (auto const& [g, ch] : batch)
+                            done_us[{ sn, ch }] = when_us;
+                    }
+                    else if (error == ERROR_CODES::NONE)
+                    {
+                        error = rc;
+                        error_sernum = sn;
+                    }
+
+                    // the stagger is counted from when the write was done
+                    for (auto const& [g, ch] : batch)
+                    {
+                        cursors[g].ready_us = when_us + int64_t(profile[g].stagger_ms) * 1000;
+                        cursors[g].writing = false;
+                    }
+
+                    busy[sn] = false;
+                    --in_flight;
+                    finished.notify_all();
+                });
+            }
+
+            if (!batches.empty())
+                continue;
+
+            if (wake_us == INT64_MAX)
+                finished.wait(guard);
+            else
+                finished.wait_until(guard, start + chrono::microseconds(wake_us));
+        }
+
+        guard.unlock();
+
+        for (thread& t : writers)
+            t.join();
+
+        if (error == ERROR_CODES::NONE)
+            error_sernum = "";
+    }
+
+    // the plan (and what happened)
+    int64_t bound_us = 0;
+    size_t num_channels = 0;
+
+    for (sequence_group_t const& group : profile)
+    {
+        bound_us = max(bound_us, int64_t(group.channels.size() - 1) * group.stagger_ms * 1000);
+        num_channels += group.channels.size();
+    }
+
+    std::cout << "    at ms  sernum  turn on   " << (plan_only ? "" : "  done ms  ") << "groups" << endl;
+
+    for (sequence_step_t const& step : plan)
+    {   // a step was done when the last of its channels was turned on
+        int64_t actual_us = plan_only ? -2 : 0;
+
+        for (int ch = 1; ch <= 32 && actual_us != -2; ++ch)
+        {
+            if (!(step.on & (1u << (ch - 1))))
+                continue;
+
+            auto it = done_us.find({ step.sn, ch });
+            actual_us = (it == done_us.end() || actual_us < 0) ? -1 : max(actual_us, it->second);
+        }
+
+        Print_Step(step, actual_us);
+    }
+
+    std::cout << num_channels << " channels in " << plan.size() << " writes over " << fixed << setprecision(3)
+        << (plan.empty() ? 0.0 : plan.back().at_us / 1000.0) << " ms (staggers alone need " << bound_us / 1000.0 << " ms)" << endl;
+
+    std::cout << "Write times estimated from the read, per channel turned on:";
+    for (size_t i = 0; i < sernums.size(); ++i)
+        std::cout << (i ? ", " : " ") << sernums[i] << " " << report_us[sernums[i]] << " us";
+    std::cout << endl;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Print_Step
+* Arguments  : step       = write of the plan
+*              actual_us  = when it was made, -1 if not made, -2 to leave out
+* Returns    : none
+* Description:
+*   Prints one line of the plan
+*/
+static void Print_Step(const sequence_step_t& step, int64_t actual_us)
+{
+    string groups = "";
+
+    for (string const& name : step.groups)
+        groups += (groups.empty() ? "" : ",") + name;
+
+    std::cout << fixed << setprecision(3) << setw(9) << step.at_us / 1000.0 << "  " << step.sn << "   "
+        << left << setw(8) << Pattern_Bits(step.on, step.on, step.channels) << right << "  ";
+
+    if (actual_us >= 0)
+        std::cout << setw(9) << actual_us / 1000.0 << "  ";
+    else if (actual_us == -1)
+        std::cout << setw(9) << "-" << "  ";
+
+    std::cout << groups << endl;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
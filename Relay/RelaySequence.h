@@ -0,0 +1,46 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelaySequence.h
+* Description:
+*   Power sequencing: turns on groups of channels with a minimum stagger
+*   between the turn-ons of each group, to limit inrush, as fast as the
+*   staggers and the modules allow
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Relay.h"
+
+class Relay_Context;
+
+// one write of a sequence: channels of one module turned on together
+struct sequence_step_t
+{
+    int64_t at_us = 0;              // from the start of the sequence
+    std::string sn = "";
+    int channels = 0;               // of the module
+    unsigned on = 0;                // channels turned on
+    std::vector<std::string> groups;    // groups they belong to
+};
+
+// plans the profile: report_us[sn] is how long one report to the module takes,
+// and a write sends one report per channel it turns on (its writes cannot
+// overlap); the steps are in order of time
+std::vector<sequence_step_t> Sequence_Plan(const SEQUENCE_PROFILE& profile, const std::map<std::string, int64_t>& report_us);
+
+// plans the profile and prints the plan; carries it out unless plan_only,
+// printing when each step was actually written
+ERROR_CODES Relays_Sequence(Relay_Context& context, const SEQUENCE_PROFILE& profile, const MODULE_CHANNELS& channels, bool plan_only, std::string& error_sernum);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
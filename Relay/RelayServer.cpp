@@ -0,0 +1,2455 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayServer.cpp
+* Description:
+*   Long-running server mode. The relay modules are opened once and held for
+*   the life of the server (up to RELAY_MAX_OPEN of them, the least recently
+*   used closed to make room for others); clients connect to localhost and
+*   send one request per line:
+*     CLIENT name                    # identify the client (owner of reservations)
+*     LIST                           # sn(#channels),...
+*     QUERY sernum{@chlist} ...      # same syntax as the command line
+*     SET ...                        # same syntax as the command line
+*     TOGGLE|OR|ANDNOT|XOR|CAS ...   # atomic read-modify-write, same syntax as the
+*                                    # command line; replies with the new states
+*     RESERVE sernum{@chlist} ...    # take ownership of channels
+*     RELEASE {sernum{@chlist} ...}  # give up ownership (all if no arguments)
+*     WAIT sernum:pattern {timeout}  # block until the module matches the pattern
+*     HISTORY sernum{@chlist}|* {since}  # recent state transitions
+*     LATENCY                        # observed latency and deadline of each module
+*     QUEUE                          # write queue depth and rejections of each module
+*     DUTY sernum{@chlist} ... period duty   # duty-cycle channels (ms, percent on)
+*     DUTY sernum{@chlist} ... OFF   # stop duty-cycling, channels off
+*     DUTY                           # channels being duty-cycled
+*     RULE name sernum:pattern THEN sernum:pattern ...  # when the module enters
+*                                    # the first state, set the others
+*     RULE name OFF                  # remove a rule
+*     RULE                           # rules, with firing counts and latency
+*     PLANS                          # plan cache size and hit/miss counts
+*     OPEN sernum ...                # open modules ahead of a burst of requests
+*     HANDLES                        # open modules, hit rate and open latency
+*     QUIT
+*   Each request is answered with a single line: "OK {result}" or "ERR code message".
+*   HISTORY precedes its OK line with one "H ..." line per transition, and
+*   RULE one "R ..." line per rule.
+*
+*   A write (SET or read-modify-write) may be prefixed with DEADLINE=ms. It is
+*   refused at once with BUSY if a module's write queue is full or the module
+*   cannot be written in time, and with EXPIRED if the deadline passes while
+*   it waits in the queue (nothing is written to that module). Writes without
+*   a deadline are refused only when the queue is full.
+*
+*   A write may also be prefixed with ID=token, a token chosen by the client
+*   and unique to the request. A request repeated with the same ID within
+*   REQUEST_TTL_US gets the original reply and writes nothing (a repeat that
+*   arrives while the original is still running waits for it). IDs belong to
+*   the client name; an ID sent again with a different request is refused.
+*
+*   The parsed form of each write (modules, masks) is cached under the text
+*   of the request, so a repeated request is not parsed or resolved again.
+*   The cache is emptied whenever the aliases change.
+*
+*   A connection whose first line is an HTTP/1.x request line is served as
+*   HTTP instead (keep-alive and pipelining), with JSON bodies:
+*     GET /list                       # modules, channels and last known states
+*     GET /query?m=sernum{@chlist}&m=...
+*     POST /set{?id=token&deadline=ms}   body {"sernum": "pattern", ...}
+*     GET /alias                      # {"aliases": {"alias": "sernum", ...}}
+*     POST /alias                     body {"alias": "sernum", ...}
+*     DELETE /alias/alias
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <regex>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+using namespace std;
+
+#include "Relay.h"
+#include "RelayServer.h"
+#include "RelayContext.h"
+#include "RelayHistory.h"
+#include "RelayRecorder.h"
+#include "RelayTune.h"
+#include "RelayRequests.h"
+#include "RelayHttp.h"
+#include "RelayDuty.h"
+#include "RelayRules.h"
+#include "RelayPlans.h"
+
+using deadline_t = chrono::steady_clock::time_point;
+constexpr deadline_t NO_DEADLINE = deadline_t::max();
+
+// admission control
+constexpr size_t DEVICE_QUEUE_MAX = 32;     // writes waiting for one module before more are refused (BUSY)
+constexpr int DEADLINE_MAX_MS = 3600000;    // longest DEADLINE=ms accepted
+constexpr size_t REQUEST_LINE_MAX = 8192;   // longest request line accepted (the connection is closed)
+
+// aliases changed by another program are noticed within this long
+constexpr int64_t ALIAS_CHECK_US = 1000000;
+
+// outcome of one queued write
+struct outcome_t
+{
+    unsigned state = 0;             // state of the module right after the write
+    bool matched = true;            // expected state matched (CAS)
+};
+
+// one write waiting to be merged into the next report
+struct pending_t
+{
+    uint32_t client;
+    rmw_t op;
+    outcome_t* outcome;             // optional, filled in when the write is done
+    ERROR_CODES* result;            // filled in when the write is done
+    deadline_t deadline;            // not written (EXPIRED) if still queued after this
+};
+
+// one relay module held open by the server
+struct device_t
+{
+    string sn = "";
+    int channels = 0;
+    Relay_Context* context = nullptr;   // makes the driver calls, with deadlines
+    unsigned mask = 0;              // last known state (bit 0 = channel 1)
+    uint64_t changed_us = 0;        // time of the last change to mask
+
+    size_t idx = 0;                 // index into server_t::devices
+    uint32_t external_id = 0;       // client of changes made outside the server
+    State_Recorder* recorder = nullptr;
+    Rule_Engine* rules = nullptr;   // told of every change
+
+    // recent state transitions (readers never block writers)
+    History_Ring history;
+
+    // writes from any number of clients are queued in pending and written
+    // together by whichever client thread finds the device idle
+    mutex lock;                     // guards everything below
+    condition_variable flushed;     // signaled after every write (WAIT also waits on it)
+    bool busy = false;
+    vector<pending_t> pending;
+    uint64_t seq_submit = 0;        // last write submitted
+    uint64_t seq_done = 0;          // last write applied to the device
+
+    // queue metrics (reported by QUEUE)
+    size_t peak = 0;                // most writes ever waiting at once
+    uint64_t queued = 0;            // writes admitted to the queue
+    uint64_t rejected_busy = 0;     // writes refused: queue full or deadline too close
+    uint64_t rejected_expired = 0;  // writes dropped: deadline passed before the write
+};
+
+// channels reserved by one client (indexed like server_t::devices)
+struct owner_t
+{
+    vector<unsigned> owned;         // reserved by this client
+    vector<unsigned> deny;          // reserved by any other client
+};
+
+struct server_t
+{
+    Relay_Context context;          // owns the driver and the open modules
+    MODULE_CHANNELS channels;
+    int fan_out = 1;                // modules written at once by one request (tuned per host)
+    vector<unique_ptr<device_t>> devices;
+    map<string, size_t> index;      // sernum -> devices[]
+
+    shared_mutex reserve_lock;      // guards reserved and owners
+    vector<unsigned> reserved;      // union of all reservations for each device
+    map<string, owner_t> owners;
+
+    State_Recorder recorder;        // optional recording of every state change
+    Request_Table requests;         // replies to recent writes that carried an ID
+    Plan_Cache plans;               // parsed writes, by request text
+
+    mutex alias_lock;               // serializes changes to the aliases, guards aliases
+    unordered_map<string, string> aliases;      // as of the last check
+    atomic<int64_t> aliases_checked_us{ 0 };    // steady clock
+
+    atomic<unsigned> next_client{ 1 };
+    mutex clients_lock;             // guards client_names and client_ids
+    vector<string> client_names;    // client id -> name
+    map<string, uint32_t> client_ids;
+    uint32_t external_id = 0;       // client of changes made outside the server
+    uint32_t anonymous_id = 0;      // client of every connection without a CLIENT name
+
+    unique_ptr<Rule_Engine> rules;      // RULE rules (stops after DUTY)
+    unique_ptr<Duty_Scheduler> duty;    // DUTY channels (last, so it stops first)
+};
+
+// one connected client
+struct client_t
+{
+    SOCKET sock = INVALID_SOCKET;
+    string name = "";
+    uint32_t id = 0;                // index into server_t::client_names
+    string connection = "";         // "#N", owner of reservations made before CLIENT
+    deadline_t deadline = NO_DEADLINE;  // deadline of the request being handled
+};
+
+// regex patterns for client names and request IDs (names starting with # or ~
+// belong to the server: connections without a name, changes made outside it)
+const regex regex_client_name("^[-_@A-Z0-9][-_#~@A-Z0-9]{0,31}$", regex::icase);
+const regex regex_request_id("^[-_.:#A-Z0-9]{1,64}$", regex::icase);
+const regex regex_rule_name("^[-_A-Z0-9]{1,32}$", regex::icase);
+
+// regex patterns for HTTP alias requests
+const regex regex_alias_only("^" T_ALIAS_NAME "$", regex::icase);
+const regex regex_sernum_only("^" T_SERNUM "$", regex::icase);
+
+// regex patterns for request commands and prefixes
+const regex regex_set("^SET$", regex::icase);
+const regex regex_query("^(?:Q|Query)$", regex::icase);
+const regex regex_rmw("^(?:TOGGLE|OR|ANDNOT|XOR|CAS)$", regex::icase);
+const regex regex_list("^(?:ENUM|ENUMerate|L|List)$", regex::icase);
+const regex regex_reserve("^RESERVE$", regex::icase);
+const regex regex_release("^RELEASE$", regex::icase);
+const regex regex_client("^CLIENT$", regex::icase);
+const regex regex_history("^HISTORY$", regex::icase);
+const regex regex_wait("^WAIT$", regex::icase);
+const regex regex_latency("^LATENCY$", regex::icase);
+const regex regex_queue("^QUEUE$", regex::icase);
+const regex regex_duty("^DUTY$", regex::icase);
+const regex regex_rule("^RULE$", regex::icase);
+const regex regex_plans("^PLANS$", regex::icase);
+const regex regex_open("^OPEN$", regex::icase);
+const regex regex_handles("^HANDLES$", regex::icase);
+const regex regex_deadline("^DEADLINE=([0-9]{1,7})$", regex::icase);
+const regex regex_id("^ID=(.*)$", regex::icase);
+const regex regex_quit("^(?:QUIT|EXIT)$", regex::icase);
+
+// regex patterns for command arguments
+const regex regex_since("^[0-9]{1,20}$");
+const regex regex_period("^[0-9]{1,8}$");
+const regex regex_percent("^([0-9]{1,3}(?:\\.[0-9]{1,3})?)%?$");
+const regex regex_off("^OFF$", regex::icase);
+const regex regex_then("^THEN$", regex::icase);
+
+// support function declarations
+static void Client_Thread(server_t* srv, SOCKET sock);
+static string Server_Command(server_t& srv, client_t& client, const string& line, bool& quit);
+static string Cmd_List(server_t& srv);
+static string Cmd_Query(server_t& srv, const vector<string>& args);
+static ERROR_CODES Query_Modules(server_t& srv, const vector<string>& args, vector<pair<string, string>>& states, string& error_sernum);
+static ERROR_CODES Run_Once(server_t& srv, const client_t& client, const string& protocol, const string& id, const string& request, const function<string(ERROR_CODES&)>& cmd, string& reply);
+static string Cmd_Set(server_t& srv, client_t& client, const vector<string>& args, ERROR_CODES* result = nullptr);
+static ERROR_CODES Set_Modules(server_t& srv, client_t& client, const vector<string>& args, string& error_sernum);
+static string Cmd_Rmw(server_t& srv, client_t& client, const string& op, const vector<string>& args, ERROR_CODES* result = nullptr);
+static ERROR_CODES Write_Modules(server_t& srv, client_t& client, const write_plan_t& plan, vector<outcome_t>& outcomes, string& error_sernum);
+static shared_ptr<const write_plan_t> Write_Plan(server_t& srv, const string& op, const vector<string>& args, ERROR_CODES& error, string& error_sernum);
+static void Check_Aliases(server_t& srv, bool now = false);
+static string Cmd_Plans(server_t& srv);
+static string Cmd_Open(server_t& srv, const vector<string>& args);
+static string Cmd_Handles(server_t& srv);
+static string Cmd_Reserve(server_t& srv, client_t& client, const vector<string>& args);
+static string Cmd_Release(server_t& srv, client_t& client, const vector<string>& args);
+static string Cmd_History(server_t& srv, client_t& client, const vector<string>& args);
+static string Cmd_Wait(server_t& srv, const vector<string>& args);
+static string Cmd_Latency(server_t& srv);
+static string Cmd_Queue(server_t& srv);
+static string Cmd_Duty(server_t& srv, client_t& client, const vector<string>& args);
+static string Cmd_Rule(server_t& srv, client_t& client, const vector<string>& args);
+static ERROR_CODES Device_Admit(server_t& srv, device_t& dev, deadline_t deadline);
+static ERROR_CODES Device_Write(device_t& dev, uint32_t client_id, const rmw_t& op, outcome_t* outcome = nullptr, deadline_t deadline = NO_DEADLINE);
+static void Device_Observe(server_t& srv, device_t& dev, unsigned status, uint64_t seq);
+static uint32_t Client_Id(server_t& srv, const string& name);
+static string Client_Name(server_t& srv, uint32_t id);
+static device_t* Find_Device(server_t& srv, const string& sernum, size_t* pidx = nullptr);
+static owner_t& Get_Owner(server_t& srv, const string& name);
+static void Update_Deny(server_t& srv, size_t idx);
+static unsigned Deny_Mask(server_t& srv, const string& name, size_t idx);
+static ERROR_CODES Write_Checked(server_t& srv, size_t idx, uint32_t client_id, unsigned on, unsigned off);
+static void Drop_Owner(server_t& srv, const string& name);
+static string Reply_Error(ERROR_CODES error, const string& error_sernum = "");
+static void Http_Session(server_t& srv, client_t& client, string& buffer);
+static string Http_Route(server_t& srv, client_t& client, const http_request_t& req, int& status);
+static string Http_Set(server_t& srv, client_t& client, const http_request_t& req, int& status);
+static string Http_Aliases(server_t& srv);
+static string Http_Error(ERROR_CODES error, const string& error_sernum, int& status);
+static bool Send_Line(SOCKET sock, const string& line);
+static bool Send_Data(SOCKET sock, const string& data);
+
+
+/*******************************************************************************
+* Function   : Relays_Serve
+* Arguments  : port         = TCP port to listen on (localhost)
+*              channels     = structure of enumerated channels
+*              record_file  = recording of all state changes (empty for none)
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function opens every enumerated module and serves client requests
+*   until the process is terminated. Each client connection gets its own thread.
+*/
+ERROR_CODES Relays_Serve(unsigned short port, const MODULE_CHANNELS& channels, const string& record_file)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    WSADATA wsaData;
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        return ERROR_CODES::NO_SOCKET;
+
+    server_t srv;
+
+    if (srv.context.Is_Initialized())
+    {
+        srv.channels = channels;
+
+        for (channels_t s : channels)
+        {
+            unsigned mask = 0;
+            ERROR_CODES rc = srv.context.Query(s.sn, mask);
+
+            // a module that cannot be opened is left out, one that is slow is kept
+            if (rc != ERROR_CODES::BAD_SERNUM && rc != ERROR_CODES::DEVICE_IO)
+            {
+                auto dev = make_unique<device_t>();
+
+                dev->sn = s.sn;
+                dev->channels = s.channels;
+                dev->context = &srv.context;
+                dev->idx = srv.devices.size();
+                if (rc == ERROR_CODES::NONE)
+                    dev->mask = mask;
+
+                srv.index[s.sn] = srv.devices.size();
+                srv.devices.push_back(move(dev));
+            }
+        }
+
+        srv.reserved.assign(srv.devices.size(), 0);
+        srv.fan_out = Fan_Out_Width(srv.context, channels);
+        srv.external_id = Client_Id(srv, "~EXTERNAL");
+        srv.anonymous_id = Client_Id(srv, "#");
+
+        for (auto& dev : srv.devices)
+            dev->external_id = srv.external_id;
+        srv.aliases = Alias_Index(MODULE_CHANNELS{});
+
+        // rule actions go through the reservations and the write queue like any other write
+        srv.rules = make_unique<Rule_Engine>(srv.devices.size(), [&srv](const vector<rule_write_t>& writes) {
+            Fan_Out(writes.size(), srv.fan_out, [&](size_t i) {
+                Write_Checked(srv, writes[i].dev, writes[i].client, writes[i].on, writes[i].off);
+            });
+        });
+
+        for (auto& dev : srv.devices)
+            dev->rules = srv.rules.get();
+
+        // duty-cycle edges go through the reservations and the write queue like any other write
+        srv.duty = make_unique<Duty_Scheduler>([&srv](const vector<duty_write_t>& writes) {
+            Fan_Out(writes.size(), srv.fan_out, [&](size_t i) {
+                Write_Checked(srv, writes[i].dev, writes[i].client, writes[i].on, writes[i].off);
+            });
+        });
+
+        if (!record_file.empty())
+        {
+            MODULE_CHANNELS recorded;
+            vector<unsigned> masks;
+
+            for (auto& dev : srv.devices)
+            {
+                recorded.push_back(channels_t{ dev->sn, dev->channels });
+                masks.push_back(dev->mask);
+                dev->recorder = &srv.recorder;
+            }
+
+            if (!srv.recorder.Open(record_file, recorded, masks))
+                error = ERROR_CODES::BAD_FILE;
+        }
+
+        SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (srv.devices.empty())
+        {
+            error = ERROR_CODES::NO_DEVICES;
+        }
+        else if (error == ERROR_CODES::NONE && (listener == INVALID_SOCKET
+            || ::bind(listener, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR
+            || listen(listener, SOMAXCONN) == SOCKET_ERROR))
+        {
+            error = ERROR_CODES::NO_SOCKET;
+        }
+
+        if (error == ERROR_CODES::NONE)
+        {
+            std::cout << "Serving " << srv.devices.size() << " module(s) on 127.0.0.1:" << port << endl;
+
+            for (;;)
+            {
+                SOCKET sock = accept(listener, nullptr, nullptr);
+
+                if (sock == INVALID_SOCKET)
+                    break;
+
+                thread(Client_Thread, &srv, sock).detach();
+            }
+        }
+
+        if (listener != INVALID_SOCKET)
+            closesocket(listener);
+
+        srv.recorder.Close();
+    }
+    else
+    {
+        error = ERROR_CODES::NO_DRIVER_INIT;
+    }
+
+    WSACleanup();
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Client_Thread
+* Arguments  : srv   = server state
+*              sock  = connected client socket
+* Returns    : none
+* Description:
+*   This function reads request lines from one client and answers each of them.
+*   Until it gives a CLIENT name, the client is known by its connection
+*   ("#N"); the channels it reserved under that name are released when it
+*   disconnects (reservations under a CLIENT name survive reconnects). Such
+*   clients share one id in the history, so connections do not add to the
+*   table of client names. A line longer than REQUEST_LINE_MAX is answered
+*   with a syntax error and the connection closed, so a client that never
+*   ends its line cannot make the server hold on to what it sends.
+*/
+static void Client_Thread(server_t* srv, SOCKET sock)
+{
+    client_t client;
+    client.sock = sock;
+    client.connection = "#" + to_string(srv->next_client++);
+    client.name = client.connection;
+    client.id = srv->anonymous_id;
+
+    string buffer;
+    char chunk[512];
+    bool quit = false;
+    bool first = true;
+
+    while (!quit)
+    {
+        size_t eol = buffer.find('\n');
+
+        if (min(eol, buffer.size()) > REQUEST_LINE_MAX)
+        {
+            Send_Line(sock, Reply_Error(ERROR_CODES::SYNTAX));
+            break;
+        }
+
+        if (eol == string::npos)
+        {
+            int n = recv(sock, chunk, sizeof(chunk), 0);
+
+            if (n <= 0)
+                break;
+
+            buffer.append(chunk, n);
+            continue;
+        }
+
+        if (first && Http_Is_Request_Line(string_view(buffer.data(), (eol > 0 && buffer[eol - 1] == '\r') ? eol - 1 : eol)))
+        {   // an HTTP client: the rest of the connection is HTTP
+            Http_Session(*srv, client, buffer);
+            break;
+        }
+
+        first = false;
+
+        string line = buffer.substr(0, eol);
+        buffer.erase(0, eol + 1);
+
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        string reply = Server_Command(*srv, client, line, quit);
+
+        if (!reply.empty() && !Send_Line(sock, reply))
+            break;
+    }
+
+    closesocket(sock);
+    Drop_Owner(*srv, client.connection);
+}
+
+
+/*******************************************************************************
+* Function   : Server_Command
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              line    = request line
+*              quit    = set to true when the client asks to disconnect
+* Returns    : reply line (without line terminator)
+* Description:
+*   This function dispatches one request line
+*/
+static string Server_Command(server_t& srv, client_t& client, const string& line, bool& quit)
+{
+    istringstream iss(line);
+    vector<string> args;
+    string cmd, arg;
+
+    smatch match;
+    bool has_deadline = false;
+    string id = "";
+
+    if (!(iss >> cmd))
+        return "";  // ignore blank lines
+
+    // options ahead of the request: DEADLINE=ms, ID=token
+    client.deadline = NO_DEADLINE;
+    for (;;)
+    {
+        if (regex_match(cmd, match, regex_deadline) && !has_deadline)
+        {
+            const int ms = stoi(match[1].str());
+
+            if (ms > DEADLINE_MAX_MS)
+                return Reply_Error(ERROR_CODES::SYNTAX);
+
+            client.deadline = chrono::steady_clock::now() + chrono::milliseconds(ms);
+            has_deadline = true;
+        }
+        else if (regex_match(cmd, match, regex_id) && id.empty())
+        {
+            id = match[1].str();
+
+            if (!regex_match(id, regex_request_id))
+                return Reply_Error(ERROR_CODES::SYNTAX);
+        }
+        else
+        {
+            break;
+        }
+
+        if (!(iss >> cmd))
+            return Reply_Error(ERROR_CODES::SYNTAX);
+    }
+
+    while (iss >> arg)
+        args.push_back(arg);
+
+    // only writes take options
+    const bool is_set = regex_match(cmd, regex_set) && !args.empty();
+    const bool is_rmw = regex_match(cmd, regex_rmw) && !args.empty();
+
+    if ((has_deadline || !id.empty()) && !is_set && !is_rmw)
+        return Reply_Error(ERROR_CODES::SYNTAX);
+
+    if (!id.empty())
+    {
+        string reply = "";
+        ERROR_CODES error = Run_Once(srv, client, "TCP", id, Plan_Key(cmd, args), [&](ERROR_CODES& result) {
+            return is_set ? Cmd_Set(srv, client, args, &result) : Cmd_Rmw(srv, client, cmd, args, &result);
+        }, reply);
+
+        return (error == ERROR_CODES::NONE) ? reply : Reply_Error(error, id);
+    }
+
+    if (is_set)
+        return Cmd_Set(srv, client, args);
+    else if (regex_match(cmd, regex_query) && !args.empty())
+        return Cmd_Query(srv, args);
+    else if (is_rmw)
+        return Cmd_Rmw(srv, client, cmd, args);
+    else if (regex_match(cmd, regex_list) && args.empty())
+        return Cmd_List(srv);
+    else if (regex_match(cmd, regex_reserve) && !args.empty())
+        return Cmd_Reserve(srv, client, args);
+    else if (regex_match(cmd, regex_release))
+        return Cmd_Release(srv, client, args);
+    else if (regex_match(cmd, regex_history) && (args.size() == 1 || args.size() == 2))
+        return Cmd_History(srv, client, args);
+    else if (regex_match(cmd, regex_wait) && !args.empty())
+        return Cmd_Wait(srv, args);
+    else if (regex_match(cmd, regex_latency) && args.empty())
+        return Cmd_Latency(srv);
+    else if (regex_match(cmd, regex_queue) && args.empty())
+        return Cmd_Queue(srv);
+    else if (regex_match(cmd, regex_duty))
+        return Cmd_Duty(srv, client, args);
+    else if (regex_match(cmd, regex_rule))
+        return Cmd_Rule(srv, client, args);
+    else if (regex_match(cmd, regex_plans) && args.empty())
+        return Cmd_Plans(srv);
+    else if (regex_match(cmd, regex_open) && !args.empty())
+        return Cmd_Open(srv, args);
+    else if (regex_match(cmd, regex_handles) && args.empty())
+        return Cmd_Handles(srv);
+    else if (regex_match(cmd, regex_client) && args.size() == 1 && regex_match(args[0], regex_client_name))
+    {
+        client.name = args[0];
+        std::transform(client.name.begin(), client.name.end(), client.name.begin(), ::toupper);
+        client.id = Client_Id(srv, client.name);
+        return "OK " + client.name;
+    }
+    else if (regex_match(cmd, regex_quit))
+    {
+        quit = true;
+        return "OK";
+    }
+
+    return Reply_Error(ERROR_CODES::SYNTAX);
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_List
+* Arguments  : srv  = server state
+* Returns    : reply line
+* Description:
+*   This function lists the modules held by the server as sn(#channels)
+*/
+static string Cmd_List(server_t& srv)
+{
+    string reply = "OK ";
+
+    for (size_t i = 0; i < srv.devices.size(); ++i)
+    {
+        if (i)
+            reply += ",";
+        reply += srv.devices[i]->sn + "(" + to_string(srv.devices[i]->channels) + ")";
+    }
+
+    return reply;
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Query
+* Arguments  : srv   = server state
+*              args  = QUERY arguments
+* Returns    : reply line
+* Description:
+*   This function reads the state of the requested modules/channels.
+*   The output matches the command line QUERY output.
+*/
+static string Cmd_Query(server_t& srv, const vector<string>& args)
+{
+    vector<pair<string, string>> states;
+    string error_sernum = "";
+    ERROR_CODES error = Query_Modules(srv, args, states, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    string reply = "OK";
+
+    for (auto const& [sn, bits] : states)
+        reply += " " + bits;
+
+    return reply;
+}
+
+
+/*******************************************************************************
+* Function   : Query_Modules
+* Arguments  : srv           = server state
+*              args          = QUERY arguments
+*              states        = receives sernum and states of the channels asked for
+*              error_sernum  = receives the offending sernum
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads the state of the channels asked for on each module
+*   (every channel if none are given), in the order given
+*/
+static ERROR_CODES Query_Modules(server_t& srv, const vector<string>& args, vector<pair<string, string>>& states, string& error_sernum)
+{
+    MODULE_QUERIES queries;
+    ERROR_CODES error = Parse_Query(args, srv.channels, queries, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    for (queries_t Q : queries)
+    {
+        device_t* dev = Find_Device(srv, Q.sn);
+
+        if (!dev)
+        {
+            error_sernum = Q.sn;
+            return ERROR_CODES::BAD_SERNUM;
+        }
+
+        uint64_t seq = 0;
+        {
+            lock_guard<mutex> lock(dev->lock);
+            seq = dev->seq_done;
+        }
+
+        unsigned status = 0;
+        error = srv.context.Query(dev->sn, status);
+
+        if (error != ERROR_CODES::NONE)
+        {
+            error_sernum = dev->sn;
+            return error;
+        }
+
+        Device_Observe(srv, *dev, status, seq);
+
+        string q = Q.q;
+        if (q.empty())
+        {   // query all channels if empty
+            for (auto i = 1; i <= dev->channels; ++i)
+                q.append(1, '0' + i);
+        }
+
+        string bits = "";
+        for (char c : q)
+            bits += (status & (1u << (c - RELAY_IDX_MIN))) ? "1" : "0";
+
+        states.emplace_back(dev->sn, bits);
+    }
+
+    return ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Run_Once
+* Arguments  : srv       = server state
+*              client    = client issuing the request
+*              protocol  = protocol of the reply (TCP, HTTP)
+*              id        = request ID chosen by the client
+*              request   = normalized text of the request (see Plan_Key)
+*              cmd       = carries out the request, sets its error and returns the reply
+*              reply     = receives the reply (the original one for a repeat)
+* Returns    : ERROR_CODES::NONE if reply was set, DUPLICATE or BUSY if not
+* Description:
+*   This function carries out a request only the first time its ID is seen;
+*   a repeat gets the original reply. IDs belong to a client name and a
+*   protocol, so clients cannot collide and a reply is only repeated in the
+*   form it was made. An ID used again for a different request is refused
+*   with DUPLICATE. A request refused with BUSY wrote nothing, so its ID is
+*   forgotten and a repeat is tried again.
+*/
+static ERROR_CODES Run_Once(server_t& srv, const client_t& client, const string& protocol, const string& id, const string& request, const function<string(ERROR_CODES&)>& cmd, string& reply)
+{
+    size_t slot = 0;
+
+    switch (srv.requests.Begin(protocol + " " + client.name + " " + id, request, slot, reply))
+    {
+    case Request_Table::BEGIN::DONE:
+        return ERROR_CODES::NONE;
+    case Request_Table::BEGIN::FORGOTTEN:
+    case Request_Table::BEGIN::CONFLICT:
+        return ERROR_CODES::DUPLICATE;
+    case Request_Table::BEGIN::FULL:
+        return ERROR_CODES::BUSY;
+    default:
+        break;
+    }
+
+    ERROR_CODES error = ERROR_CODES::NONE;
+
+    reply = cmd(error);
+    srv.requests.Complete(slot, reply, error != ERROR_CODES::BUSY);
+
+    return ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Set
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              args    = SET arguments
+*              result  = optionally receives the error
+* Returns    : reply line
+* Description:
+*   This function sets relays on one or more modules (see Set_Modules)
+*/
+static string Cmd_Set(server_t& srv, client_t& client, const vector<string>& args, ERROR_CODES* result)
+{
+    string error_sernum = "";
+    ERROR_CODES error = Set_Modules(srv, client, args, error_sernum);
+
+    if (result)
+        *result = error;
+
+    return (error == ERROR_CODES::NONE) ? "OK" : Reply_Error(error, error_sernum);
+}
+
+
+/*******************************************************************************
+* Function   : Set_Modules
+* Arguments  : srv           = server state
+*              client        = client issuing the request
+*              args          = SET arguments
+*              error_sernum  = receives the sernums of modules that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function sets relays on one or more modules. The request is rejected
+*   as a whole if it touches any channel reserved by another client.
+*/
+static ERROR_CODES Set_Modules(server_t& srv, client_t& client, const vector<string>& args, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    vector<outcome_t> outcomes;
+    shared_ptr<const write_plan_t> plan = Write_Plan(srv, "SET", args, error, error_sernum);
+
+    if (!plan)
+        return error;
+
+    return Write_Modules(srv, client, *plan, outcomes, error_sernum);
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Rmw
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              op      = TOGGLE, OR, ANDNOT, XOR or CAS
+*              args    = arguments of the operation
+*              result  = optionally receives the error
+* Returns    : reply line
+* Description:
+*   This function applies a read-modify-write operation to one or more modules.
+*   The operation is applied to the server's copy of the state in the same pass
+*   that writes it, so no other write can come in between. The reply lists the
+*   resulting state of each module; if a CAS does not match, the error is
+*   followed by the state that was found.
+*/
+static string Cmd_Rmw(server_t& srv, client_t& client, const string& op, const vector<string>& args, ERROR_CODES* result)
+{
+    vector<outcome_t> outcomes;
+    string error_sernum = "";
+    ERROR_CODES error = ERROR_CODES::NONE;
+    shared_ptr<const write_plan_t> plan = Write_Plan(srv, op, args, error, error_sernum);
+
+    if (plan)
+        error = Write_Modules(srv, client, *plan, outcomes, error_sernum);
+
+    if (result)
+        *result = error;
+
+    if (error != ERROR_CODES::NONE && error != ERROR_CODES::MISMATCH)
+        return Reply_Error(error, error_sernum);
+
+    string reply = (error == ERROR_CODES::NONE) ? "OK" : Reply_Error(error, error_sernum);
+
+    for (size_t i = 0; i < plan->devs.size(); ++i)
+        reply += " " + Mask_Bits(outcomes[i].state, srv.devices[plan->devs[i]]->channels);
+
+    return reply;
+}
+
+
+/*******************************************************************************
+* Function   : Write_Plan
+* Arguments  : srv           = server state
+*              op            = SET, TOGGLE, OR, ANDNOT, XOR or CAS
+*              args          = arguments of the request
+*              error         = receives the error if there is no plan
+*              error_sernum  = receives the offending sernum
+* Returns    : the plan, or nullptr if the request is not valid
+* Description:
+*   This function turns a write request into the operation on each module
+*   and the module's index. The plan is taken from the cache if the same
+*   request (see Plan_Key) has been seen since the aliases last changed;
+*   otherwise the request is parsed and resolved, and the plan is cached.
+*   Requests that are not valid are not cached.
+*/
+static shared_ptr<const write_plan_t> Write_Plan(server_t& srv, const string& op, const vector<string>& args, ERROR_CODES& error, string& error_sernum)
+{
+    Check_Aliases(srv);
+
+    const string key = Plan_Key(op, args);
+    uint64_t generation = 0;
+    shared_ptr<const write_plan_t> found = srv.plans.Find(key, generation);
+
+    if (found)
+        return found;
+
+    auto plan = make_shared<write_plan_t>();
+
+    if (op == "SET")
+    {   // SET is a read-modify-write that ignores the current state
+        MODULE_SET modules;
+        error = Parse_Set(args, srv.channels, modules, error_sernum);
+
+        for (auto const& [sernum, module] : modules)
+        {
+            const int num_channels = Relays_Get_NumChannels(sernum, srv.channels);
+            rmw_t r;
+
+            r.sn = sernum;
+            r.set_mask = Module_Mask(module, LOGIC::H, num_channels);
+            r.clear_mask = Module_Mask(module, LOGIC::L, num_channels);
+            plan->rmws.push_back(r);
+        }
+    }
+    else
+    {
+        error = Parse_Rmw(op, args, srv.channels, plan->rmws, error_sernum);
+    }
+
+    for (size_t i = 0; i < plan->rmws.size() && error == ERROR_CODES::NONE; ++i)
+    {
+        size_t idx = 0;
+
+        if (!Find_Device(srv, plan->rmws[i].sn, &idx))
+        {
+            error = ERROR_CODES::BAD_SERNUM;
+            error_sernum = plan->rmws[i].sn;
+        }
+
+        plan->devs.push_back(idx);
+    }
+
+    if (error != ERROR_CODES::NONE)
+        return nullptr;
+
+    srv.plans.Insert(key, plan, generation);
+
+    return plan;
+}
+
+
+/*******************************************************************************
+* Function   : Check_Aliases
+* Arguments  : srv  = server state
+*              now  = check even if checked within ALIAS_CHECK_US
+* Returns    : none
+* Description:
+*   This function empties the plan cache if the aliases have changed. They
+*   may be changed by another program at any time, so they are read again
+*   at most once every ALIAS_CHECK_US (by whichever request comes first).
+*/
+static void Check_Aliases(server_t& srv, bool now)
+{
+    const int64_t now_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t checked_us = srv.aliases_checked_us.load();
+
+    if (!now && (now_us - checked_us < ALIAS_CHECK_US || !srv.aliases_checked_us.compare_exchange_strong(checked_us, now_us)))
+        return;
+
+    lock_guard<mutex> lock(srv.alias_lock);
+    unordered_map<string, string> aliases = Alias_Index(MODULE_CHANNELS{});
+
+    if (aliases != srv.aliases)
+    {
+        srv.aliases = move(aliases);
+        srv.plans.Invalidate();
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Plans
+* Arguments  : srv  = server state
+* Returns    : reply line
+* Description:
+*   This function reports the plan cache: plans kept and room for them,
+*   lookups that found a plan and that did not, plans dropped to make room,
+*   and how many times every plan was dropped because the aliases changed:
+*     OK entries/capacity:hits:misses:evictions:invalidations
+*/
+static string Cmd_Plans(server_t& srv)
+{
+    const plan_stats_t s = srv.plans.Stats();
+
+    return "OK " + to_string(s.entries) + "/" + to_string(s.capacity) + ":" + to_string(s.hits) + ":" + to_string(s.misses)
+        + ":" + to_string(s.evictions) + ":" + to_string(s.invalidations);
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Open
+* Arguments  : srv   = server state
+*              args  = sernums (or aliases) of the modules
+* Returns    : reply line
+* Description:
+*   This function opens the modules, in parallel, so that the requests that
+*   follow do not wait for them to open. No I/O is done. Modules already open
+*   are made the most recently used, so they are the last to be closed:
+*     OK sernum ...
+*/
+static string Cmd_Open(server_t& srv, const vector<string>& args)
+{
+    MODULE_QUERIES queries;
+    string error_sernum = "";
+    ERROR_CODES error = Parse_Query(args, srv.channels, queries, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    for (queries_t const& Q : queries)
+    {
+        if (!Find_Device(srv, Q.sn))
+            return Reply_Error(ERROR_CODES::BAD_SERNUM, Q.sn);
+    }
+
+    vector<ERROR_CODES> results(queries.size(), ERROR_CODES::NONE);
+
+    Fan_Out(queries.size(), srv.fan_out, [&](size_t i) { results[i] = srv.context.Open(queries[i].sn); });
+
+    string reply = "OK";
+
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        if (results[i] != ERROR_CODES::NONE)
+            return Reply_Error(results[i], queries[i].sn);
+        reply += " " + queries[i].sn;
+    }
+
+    return reply;
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Handles
+* Arguments  : srv  = server state
+* Returns    : reply line
+* Description:
+*   This function reports the open modules and the most allowed, calls that
+*   found their module open and opens, the percentage of calls that found
+*   their module open, modules closed to make room, and the mean and longest
+*   time an open took in microseconds:
+*     OK open/max:hits:misses:hit%:evictions:mean_us/max_us
+*/
+static string Cmd_Handles(server_t& srv)
+{
+    const handle_stats_t s = srv.context.Handle_Stats();
+    const uint64_t calls = s.hits + s.misses;
+
+    return "OK " + to_string(s.open) + "/" + to_string(s.max_open) + ":" + to_string(s.hits) + ":" + to_string(s.misses)
+        + ":" + to_string(calls ? s.hits * 100 / calls : 0) + "%:" + to_string(s.evictions)
+        + ":" + to_string(s.misses ? s.open_us_total / s.misses : 0) + "/" + to_string(s.open_us_max);
+}
+
+
+/*******************************************************************************
+* Function   : Write_Modules
+* Arguments  : srv           = server state
+*              client        = client issuing the request
+*              plan          = read-modify-write operation for each module
+*              outcomes      = receives the outcome for each module
+*              error_sernum  = receives the sernums of modules that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function writes one or more modules. The request is rejected as a
+*   whole if it could change any channel reserved by another client, or if
+*   any module cannot take it (see Device_Admit). Modules are written in
+*   parallel (up to srv.fan_out at once), so a slow module does not delay
+*   the others.
+*/
+static ERROR_CODES Write_Modules(server_t& srv, client_t& client, const write_plan_t& plan, vector<outcome_t>& outcomes, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    const MODULE_RMW& rmws = plan.rmws;
+    vector<device_t*> devs;
+
+    shared_lock<shared_mutex> lock(srv.reserve_lock);
+
+    for (size_t i = 0; i < rmws.size(); ++i)
+    {
+        const rmw_t& r = rmws[i];
+        const size_t idx = plan.devs[i];
+        device_t* dev = srv.devices[idx].get();
+
+        if ((r.set_mask | r.clear_mask | r.toggle_mask) & Deny_Mask(srv, client.name, idx))
+            return ERROR_CODES::RESERVED;
+
+        devs.push_back(dev);
+    }
+
+    for (device_t* dev : devs)
+    {
+        error = Device_Admit(srv, *dev, client.deadline);
+
+        if (error != ERROR_CODES::NONE)
+        {
+            error_sernum = dev->sn;
+            return error;
+        }
+    }
+
+    outcomes.assign(rmws.size(), outcome_t{});
+
+    vector<ERROR_CODES> results(rmws.size(), ERROR_CODES::NONE);
+
+    Fan_Out(rmws.size(), srv.fan_out, [&](size_t i) { results[i] = Device_Write(*devs[i], client.id, rmws[i], &outcomes[i], client.deadline); });
+
+    for (size_t i = 0; i < rmws.size(); ++i)
+    {
+        ERROR_CODES result = results[i];
+
+        if (result == ERROR_CODES::NONE && !outcomes[i].matched)
+            result = ERROR_CODES::MISMATCH;
+
+        if (result != ERROR_CODES::NONE)
+        {
+            error = result;
+            error_sernum += (error_sernum.empty() ? "" : ",") + devs[i]->sn;
+        }
+    }
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Reserve
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              args    = list of sernum{@chlist}
+* Returns    : reply line
+* Description:
+*   This function reserves channels for the client. Either all of the requested
+*   channels are reserved, or none are (if any are owned by another client).
+*/
+static string Cmd_Reserve(server_t& srv, client_t& client, const vector<string>& args)
+{
+    MODULE_QUERIES queries;
+    string error_sernum = "";
+    ERROR_CODES error = Parse_Query(args, srv.channels, queries, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    unique_lock<shared_mutex> lock(srv.reserve_lock);
+    owner_t& owner = Get_Owner(srv, client.name);
+    vector<unsigned> request(srv.devices.size(), 0);
+
+    for (queries_t Q : queries)
+    {
+        size_t idx = 0;
+        device_t* dev = Find_Device(srv, Q.sn, &idx);
+
+        if (!dev)
+            return Reply_Error(ERROR_CODES::BAD_SERNUM, Q.sn);
+
+        request[idx] |= Query_Mask(Q.q, dev->channels);
+
+        if (request[idx] & owner.deny[idx])
+            return Reply_Error(ERROR_CODES::RESERVED);
+    }
+
+    for (size_t idx = 0; idx < request.size(); ++idx)
+    {
+        if (request[idx])
+        {
+            owner.owned[idx] |= request[idx];
+            srv.reserved[idx] |= request[idx];
+            Update_Deny(srv, idx);
+        }
+    }
+
+    return "OK";
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Release
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              args    = list of sernum{@chlist}, or empty to release everything
+* Returns    : reply line
+* Description:
+*   This function releases channels reserved by the client
+*/
+static string Cmd_Release(server_t& srv, client_t& client, const vector<string>& args)
+{
+    MODULE_QUERIES queries;
+    string error_sernum = "";
+    ERROR_CODES error = Parse_Query(args, srv.channels, queries, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    unique_lock<shared_mutex> lock(srv.reserve_lock);
+    auto it = srv.owners.find(client.name);
+
+    if (it == srv.owners.end())
+        return "OK";  // nothing reserved
+
+    owner_t& owner = it->second;
+    vector<unsigned> request(srv.devices.size(), 0);
+
+    if (args.empty())
+    {
+        request = owner.owned;
+    }
+    else
+    {
+        for (queries_t Q : queries)
+        {
+            size_t idx = 0;
+            device_t* dev = Find_Device(srv, Q.sn, &idx);
+
+            if (dev)
+                request[idx] |= Query_Mask(Q.q, dev->channels) & owner.owned[idx];
+        }
+    }
+
+    for (size_t idx = 0; idx < request.size(); ++idx)
+    {
+        if (request[idx])
+        {
+            owner.owned[idx] &= ~request[idx];
+            srv.reserved[idx] &= ~request[idx];
+            Update_Deny(srv, idx);
+        }
+    }
+
+    return "OK";
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_History
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              args    = sernum{@chlist} or * (all modules), optionally followed
+*                        by a time in microseconds since 1970-01-01 UTC
+* Returns    : reply line
+* Description:
+*   This function sends the recent transitions that change any of the selected
+*   channels, oldest first, one line per transition:
+*     H sernum time_us old_pattern new_pattern client
+*   Reading the history never blocks writers.
+*/
+static string Cmd_History(server_t& srv, client_t& client, const vector<string>& args)
+{
+    uint64_t since_us = 0;
+    MODULE_QUERIES queries;
+    string error_sernum = "";
+
+    if (args.size() == 2)
+    {
+        if (!regex_match(args[1], regex_since))
+            return Reply_Error(ERROR_CODES::SYNTAX);
+        since_us = stoull(args[1]);
+    }
+
+    if (args[0] == "*")
+    {
+        for (auto const& dev : srv.devices)
+            queries.push_back(queries_t{ dev->sn, "" });
+    }
+    else
+    {
+        ERROR_CODES error = Parse_Query({ args[0] }, srv.channels, queries, error_sernum);
+
+        if (error != ERROR_CODES::NONE)
+            return Reply_Error(error, error_sernum);
+    }
+
+    size_t count = 0;
+
+    for (queries_t Q : queries)
+    {
+        device_t* dev = Find_Device(srv, Q.sn);
+
+        if (!dev)
+            return Reply_Error(ERROR_CODES::BAD_SERNUM, Q.sn);
+
+        const unsigned mask = Query_Mask(Q.q, dev->channels);
+        vector<transition_t> transitions;
+        string lines;
+
+        dev->history.Snapshot(since_us, transitions);
+
+        for (auto const& t : transitions)
+        {
+            if ((t.old_mask ^ t.new_mask) & mask)
+            {
+                if (!lines.empty())
+                    lines += "\r\n";
+                lines += "H " + dev->sn + " " + to_string(t.time_us) + " " + Mask_Bits(t.old_mask, dev->channels)
+                    + " " + Mask_Bits(t.new_mask, dev->channels) + " " + Client_Name(srv, t.client);
+                ++count;
+            }
+        }
+
+        if (!lines.empty() && !Send_Line(client.sock, lines))
+            return "";
+    }
+
+    return "OK " + to_string(count);
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Wait
+* Arguments  : srv   = server state
+*              args  = sernum:pattern, optionally followed by a timeout in ms
+* Returns    : reply line
+* Description:
+*   This function blocks until the module matches the pattern (X = any state)
+*   and replies with the time the match was established and the state:
+*     OK time_us pattern
+*   The client thread sleeps on the module's write notifications, so nothing
+*   is polled. On timeout the error is followed by the current state.
+*/
+static string Cmd_Wait(server_t& srv, const vector<string>& args)
+{
+    wait_t wait;
+    string error_sernum = "";
+    ERROR_CODES error = Parse_Wait(args, srv.channels, wait, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    device_t* dev = Find_Device(srv, wait.sn);
+
+    if (!dev)
+        return Reply_Error(ERROR_CODES::BAD_SERNUM, wait.sn);
+
+    auto matches = [dev, &wait] { return (dev->mask & wait.care_mask) == wait.expect_mask; };
+    unique_lock<mutex> lock(dev->lock);
+    uint64_t time_us = History_Now();
+
+    if (!matches())
+    {
+        bool matched = true;
+
+        if (wait.timeout_ms < 0)
+            dev->flushed.wait(lock, matches);
+        else
+            matched = dev->flushed.wait_for(lock, chrono::milliseconds(wait.timeout_ms), matches);
+
+        if (!matched)
+            return Reply_Error(ERROR_CODES::TIMEOUT, dev->sn) + " " + Mask_Bits(dev->mask, dev->channels);
+
+        time_us = dev->changed_us;
+    }
+
+    return "OK " + to_string(time_us) + " " + Mask_Bits(dev->mask, dev->channels);
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Latency
+* Arguments  : srv  = server state
+* Returns    : reply line
+* Description:
+*   This function reports, for each module, the smoothed I/O latency and the
+*   current deadline in microseconds, and whether the module is isolated:
+*     OK sernum:latency/deadline{:STUCK} ...
+*/
+static string Cmd_Latency(server_t& srv)
+{
+    string reply = "OK";
+
+    for (auto const& dev : srv.devices)
+    {
+        latency_t latency;
+        bool stuck = false;
+
+        if (!srv.context.Latency(dev->sn, latency, stuck))
+            continue;
+
+        reply += " " + dev->sn + ":" + to_string(int64_t(latency.mean_us)) + "/" + to_string(latency.Timeout(DEVICE_OP::IO).count());
+        if (stuck)
+            reply += ":STUCK";
+    }
+
+    return reply;
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Queue
+* Arguments  : srv  = server state
+* Returns    : reply line
+* Description:
+*   This function reports, for each module, the writes waiting now, the most
+*   ever waiting at once, the writes admitted, and the writes refused because
+*   the module was busy or dropped because their deadline passed:
+*     OK sernum:depth/peak:queued:busy:expired ...
+*/
+static string Cmd_Queue(server_t& srv)
+{
+    string reply = "OK";
+
+    for (auto const& dev : srv.devices)
+    {
+        lock_guard<mutex> lock(dev->lock);
+
+        reply += " " + dev->sn + ":" + to_string(dev->pending.size()) + "/" + to_string(dev->peak) + ":" + to_string(dev->queued)
+               + ":" + to_string(dev->rejected_busy) + ":" + to_string(dev->rejected_expired);
+    }
+
+    return reply;
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Duty
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              args    = sernum{@chlist} ... followed by period_ms duty% or OFF;
+*                        empty to list the channels being duty-cycled
+* Returns    : reply line
+* Description:
+*   This function starts, changes or stops duty-cycling channels. Each
+*   channel is on for duty% of every period (period in milliseconds). A
+*   channel already running with the same period takes a new duty without
+*   restarting its cycle. Channels reserved by another client are refused.
+*   The list is "sernum@ch:period/duty%" for each channel.
+*/
+static string Cmd_Duty(server_t& srv, client_t& client, const vector<string>& args)
+{
+    if (args.empty())
+    {
+        string reply = "OK";
+        ostringstream percent;
+
+        for (duty_t const& d : srv.duty->List())
+        {
+            percent.str("");
+            percent << d.duty * 100;
+            reply += " " + srv.devices[d.dev]->sn + "@" + to_string(d.channel) + ":" + to_string(d.period_ms) + "/" + percent.str() + "%";
+        }
+
+        return reply;
+    }
+
+    const bool is_off = regex_match(args.back(), regex_off);
+    smatch match;
+    uint32_t period_ms = 0;
+    double duty = 0;
+
+    if (args.size() < (is_off ? 2u : 3u))
+        return Reply_Error(ERROR_CODES::SYNTAX);
+
+    const size_t num_modules = args.size() - (is_off ? 1 : 2);
+
+    if (!is_off)
+    {
+        const string& period = args[args.size() - 2];
+
+        if (!regex_match(period, regex_period) || !regex_match(args.back(), match, regex_percent))
+            return Reply_Error(ERROR_CODES::SYNTAX);
+
+        period_ms = uint32_t(stoul(period));
+        duty = stod(match[1].str()) / 100;
+
+        if (period_ms < DUTY_PERIOD_MIN_MS || period_ms > DUTY_PERIOD_MAX_MS || duty > 1)
+            return Reply_Error(ERROR_CODES::SYNTAX);
+    }
+
+    MODULE_QUERIES queries;
+    string error_sernum = "";
+    ERROR_CODES error = Parse_Query(vector<string>(args.begin(), args.begin() + num_modules), srv.channels, queries, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    vector<unsigned> masks(srv.devices.size(), 0);
+    {
+        shared_lock<shared_mutex> lock(srv.reserve_lock);
+
+        for (queries_t const& Q : queries)
+        {
+            size_t idx = 0;
+            device_t* dev = Find_Device(srv, Q.sn, &idx);
+
+            if (!dev)
+                return Reply_Error(ERROR_CODES::BAD_SERNUM, Q.sn);
+
+            masks[idx] |= Query_Mask(Q.q, dev->channels);
+
+            if (masks[idx] & Deny_Mask(srv, client.name, idx))
+                return Reply_Error(ERROR_CODES::RESERVED);
+        }
+    }
+
+    vector<duty_t> duties;
+
+    for (size_t idx = 0; idx < masks.size(); ++idx)
+    {
+        if (is_off && masks[idx])
+            srv.duty->Stop(idx, masks[idx], client.id);
+
+        for (int ch = 1; !is_off && ch <= srv.devices[idx]->channels; ++ch)
+        {
+            if (masks[idx] & (1u << (ch - 1)))
+                duties.push_back(duty_t{ idx, ch, period_ms, duty, client.id });
+        }
+    }
+
+    if (!duties.empty())
+        srv.duty->Set(duties);
+
+    return "OK";
+}
+
+
+/*******************************************************************************
+* Function   : Cmd_Rule
+* Arguments  : srv     = server state
+*              client  = client issuing the request
+*              args    = name trigger THEN actions to add (or replace) a rule,
+*                        name OFF to remove one, empty to list them
+* Returns    : reply line
+* Description:
+*   This function manages the rules. A rule fires when its module changes
+*   into the trigger state (same syntax as WAIT, X = any state) and sets
+*   the channels of its actions (same syntax as SET, on any modules). A
+*   rule's writes are made on behalf of the client that defined it, and may
+*   not touch channels another client has reserved at that time. Each rule
+*   is listed on one line, followed by the OK line with the count:
+*     R name fired last_us/mean_us/max_us trigger THEN actions
+*/
+static string Cmd_Rule(server_t& srv, client_t& client, const vector<string>& args)
+{
+    if (args.empty())
+    {
+        vector<rule_t> rules = srv.rules->List();
+        string lines = "";
+
+        for (rule_t const& rule : rules)
+        {
+            const device_t& dev = *srv.devices[rule.dev];
+            const uint64_t mean_us = rule.fired ? rule.total_us / rule.fired : 0;
+
+            if (!lines.empty())
+                lines += "\r\n";
+            lines += "R " + rule.name + " " + to_string(rule.fired) + " " + to_string(rule.last_us) + "/" + to_string(mean_us)
+                + "/" + to_string(rule.max_us) + " " + dev.sn + ":" + Pattern_Bits(rule.care, rule.expect, dev.channels) + " THEN";
+
+            for (rule_write_t const& a : rule.actions)
+            {
+                const device_t& target = *srv.devices[a.dev];
+                lines += " " + target.sn + ":" + Pattern_Bits(a.on | a.off, a.on, target.channels);
+            }
+        }
+
+        if (!lines.empty() && !Send_Line(client.sock, lines))
+            return "";
+
+        return "OK " + to_string(rules.size());
+    }
+
+    if (!regex_match(args[0], regex_rule_name))
+        return Reply_Error(ERROR_CODES::SYNTAX);
+
+    string name = args[0];
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+    if (args.size() == 2 && regex_match(args[1], regex_off))
+        return srv.rules->Remove(name) ? "OK" : Reply_Error(ERROR_CODES::SYNTAX);
+
+    auto then = find_if(args.begin() + 1, args.end(), [&](const string& arg) { return regex_match(arg, regex_then); });
+
+    if (then == args.begin() + 1 || then == args.end() || then + 1 == args.end())
+        return Reply_Error(ERROR_CODES::SYNTAX);
+
+    wait_t trigger;
+    MODULE_SET modules;
+    string error_sernum = "";
+    ERROR_CODES error = Parse_Wait(vector<string>(args.begin() + 1, then), srv.channels, trigger, error_sernum);
+
+    if (error == ERROR_CODES::NONE && (trigger.timeout_ms >= 0 || trigger.care_mask == 0))
+        error = ERROR_CODES::SYNTAX;    // no timeout, and some channel to watch
+
+    if (error == ERROR_CODES::NONE)
+        error = Parse_Set(vector<string>(then + 1, args.end()), srv.channels, modules, error_sernum);
+
+    if (error != ERROR_CODES::NONE)
+        return Reply_Error(error, error_sernum);
+
+    rule_t rule;
+    rule.name = name;
+    rule.care = trigger.care_mask;
+    rule.expect = trigger.expect_mask;
+    rule.client = client.id;
+
+    if (!Find_Device(srv, trigger.sn, &rule.dev))
+        return Reply_Error(ERROR_CODES::BAD_SERNUM, trigger.sn);
+
+    {
+        shared_lock<shared_mutex> lock(srv.reserve_lock);
+
+        for (auto const& [sernum, module] : modules)
+        {
+            rule_write_t a;
+            device_t* dev = Find_Device(srv, sernum, &a.dev);
+
+            if (!dev)
+                return Reply_Error(ERROR_CODES::BAD_SERNUM, sernum);
+
+            const unsigned deny = Deny_Mask(srv, client.name, a.dev);
+
+            a.on = Module_Mask(module, LOGIC::H, dev->channels);
+            a.off = Module_Mask(module, LOGIC::L, dev->channels);
+            a.client = client.id;
+
+            if ((a.on | a.off) & deny)
+                return Reply_Error(ERROR_CODES::RESERVED);
+
+            rule.actions.push_back(a);
+        }
+    }
+
+    srv.rules->Set(rule);
+
+    return "OK";
+}
+
+
+/*******************************************************************************
+* Function   : Device_Admit
+* Arguments  : srv       = server state
+*              dev       = module to write
+*              deadline  = time by which the write must be made
+* Returns    : ERROR_CODES::NONE if the write can be queued, BUSY or EXPIRED if not
+* Description:
+*   This function decides, without waiting, whether the module can take
+*   another write: its queue must not be full, and the write must be able to
+*   finish by the deadline. Queued writes go out together in the next pass,
+*   so the write takes about one I/O time, or two if a pass is under way.
+*/
+static ERROR_CODES Device_Admit(server_t& srv, device_t& dev, deadline_t deadline)
+{
+    const auto now = chrono::steady_clock::now();
+    latency_t latency;
+    bool stuck = false;
+    bool in_pass = false;
+
+    if (now >= deadline)
+    {
+        lock_guard<mutex> lock(dev.lock);
+        ++dev.rejected_expired;
+        return ERROR_CODES::EXPIRED;
+    }
+
+    {
+        lock_guard<mutex> lock(dev.lock);
+
+        if (dev.pending.size() >= DEVICE_QUEUE_MAX)
+        {
+            ++dev.rejected_busy;
+            return ERROR_CODES::BUSY;
+        }
+
+        in_pass = dev.busy;
+    }
+
+    if (deadline != NO_DEADLINE && srv.context.Latency(dev.sn, latency, stuck) && latency.samples > 0)
+    {
+        const auto expected = chrono::microseconds(int64_t(latency.mean_us * (in_pass ? 2 : 1)));
+
+        if (stuck || now + expected > deadline)
+        {
+            lock_guard<mutex> lock(dev.lock);
+            ++dev.rejected_busy;
+            return ERROR_CODES::BUSY;
+        }
+    }
+
+    return ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Device_Write
+* Arguments  : dev         = module to write
+*              client_id   = client making the change
+*              op          = change to make (applied to the state at the time of the write)
+*              outcome     = optionally receives the resulting state
+*              deadline    = the change is dropped if not written by then
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function queues the change for the module and waits until it has
+*   been written. Whichever caller finds the module idle writes every change
+*   queued at that moment in one pass, so concurrent writes from different
+*   clients to the same module are combined. Changes whose deadline has
+*   passed by then are left out (EXPIRED). The changes are applied to the
+*   state read from the module in the same hold as the write (not to the
+*   server's copy, which another process may have made stale), so CAS
+*   compares against what the module holds. A difference found is recorded
+*   as made by ~EXTERNAL, and each client's part of the combined write as a
+*   separate transition in the history.
+*/
+static ERROR_CODES Device_Write(device_t& dev, uint32_t client_id, const rmw_t& op, outcome_t* outcome, deadline_t deadline)
+{
+    ERROR_CODES result = ERROR_CODES::NONE;
+    unique_lock<mutex> lock(dev.lock);
+
+    if (dev.pending.size() >= DEVICE_QUEUE_MAX)
+    {   // filled up since Device_Admit
+        ++dev.rejected_busy;
+        return ERROR_CODES::BUSY;
+    }
+
+    dev.pending.push_back(pending_t{ client_id, op, outcome, &result, deadline });
+    dev.peak = max(dev.peak, dev.pending.size());
+    ++dev.queued;
+    const uint64_t ticket = ++dev.seq_submit;
+
+    while (dev.seq_done < ticket)
+    {
+        if (dev.busy)
+        {
+            dev.flushed.wait(lock);
+            continue;
+        }
+
+        // this thread writes everything pending, applied in the order
+        // submitted, except what has expired
+        const auto now_steady = chrono::steady_clock::now();
+        vector<pending_t> batch;
+
+        for (auto& p : dev.pending)
+        {
+            if (now_steady < p.deadline)
+                batch.push_back(p);
+            else
+            {
+                *p.result = ERROR_CODES::EXPIRED;
+                ++dev.rejected_expired;
+            }
+        }
+
+        dev.pending.clear();
+        const uint64_t batch_to = dev.seq_submit;
+
+        if (batch.empty())
+        {
+            dev.seq_done = batch_to;
+            dev.flushed.notify_all();
+            continue;
+        }
+
+        const unsigned cached = dev.mask;
+        unsigned old_mask = cached;
+        unsigned new_mask = cached;
+        vector<outcome_t> outcomes(batch.size());
+        dev.busy = true;
+        lock.unlock();
+
+        ERROR_CODES rc = dev.context->Update(dev.sn, [&](unsigned fresh) {
+            unsigned mask = fresh;
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                mask = Rmw_Apply(batch[i].op, mask, &outcomes[i].matched);
+                outcomes[i].state = mask;
+            }
+            return mask;
+        }, &new_mask, &old_mask);
+
+        unsigned status = old_mask;
+
+        if (rc == ERROR_CODES::DEVICE_IO && dev.context->Query(dev.sn, status) != ERROR_CODES::NONE)
+            status = old_mask;
+
+        const uint64_t now = History_Now();
+        const unsigned actual = (rc == ERROR_CODES::NONE) ? new_mask : status;
+
+        if (old_mask != cached)
+        {   // changed outside the server since it was last seen
+            dev.history.Record(transition_t{ now, dev.external_id, cached, old_mask });
+
+            if (dev.recorder)
+                dev.recorder->Record(now, dev.idx, old_mask);
+
+            if (dev.rules)
+                dev.rules->Changed(dev.idx, cached, old_mask, now);
+        }
+
+        if (rc == ERROR_CODES::NONE)
+        {   // record each client's part of the write
+            unsigned mask = old_mask;
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                if (outcomes[i].state != mask)
+                    dev.history.Record(transition_t{ now, batch[i].client, mask, outcomes[i].state });
+                mask = outcomes[i].state;
+            }
+        }
+        else if (actual != old_mask)
+        {   // partial write: record what actually happened
+            dev.history.Record(transition_t{ now, batch.back().client, old_mask, actual });
+        }
+
+        if (dev.recorder && actual != old_mask)
+            dev.recorder->Record(now, dev.idx, actual);
+
+        if (dev.rules && actual != old_mask)
+            dev.rules->Changed(dev.idx, old_mask, actual, now);
+
+        lock.lock();
+        if (actual != dev.mask)
+            dev.changed_us = now;
+        dev.mask = actual;
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (batch[i].outcome)
+                *batch[i].outcome = (rc == ERROR_CODES::NONE) ? outcomes[i] : outcome_t{ actual, outcomes[i].matched };
+            *batch[i].result = rc;
+        }
+        dev.seq_done = batch_to;
+        dev.busy = false;
+        dev.flushed.notify_all();
+    }
+
+    return result;
+}
+
+
+/*******************************************************************************
+* Function   : Device_Observe
+* Arguments  : srv     = server state
+*              dev     = module that was read
+*              status  = state read from it
+*              seq     = dev.seq_done before it was read
+* Returns    : none
+* Description:
+*   This function takes note of a state read from the module that differs
+*   from the server's copy, i.e., a change made outside the server (e.g., by
+*   another process). It is recorded like any other change, as made by
+*   ~EXTERNAL, wakes WAIT and is passed to the rules. A read made while the
+*   server was writing the module is ignored, since it may be out of date.
+*/
+static void Device_Observe(server_t& srv, device_t& dev, unsigned status, uint64_t seq)
+{
+    unique_lock<mutex> lock(dev.lock);
+
+    if (dev.busy || dev.seq_done != seq || status == dev.mask)
+        return;
+
+    const uint64_t now = History_Now();
+    const unsigned old_mask = dev.mask;
+
+    dev.history.Record(transition_t{ now, srv.external_id, old_mask, status });
+    dev.mask = status;
+    dev.changed_us = now;
+    dev.flushed.notify_all();
+    lock.unlock();
+
+    if (dev.recorder)
+        dev.recorder->Record(now, dev.idx, status);
+
+    if (dev.rules)
+        dev.rules->Changed(dev.idx, old_mask, status, now);
+}
+
+
+/*******************************************************************************
+* Function   : Http_Session
+* Arguments  : srv     = server state
+*              client  = client connection
+*              buffer  = data received so far (starts with a request)
+* Returns    : none
+* Description:
+*   This function serves an HTTP connection until the client closes it or
+*   asks for it to be closed. Every complete request in the buffer is
+*   answered before anything more is read, and the responses go out in one
+*   send, so pipelined requests cost one round trip.
+*/
+static void Http_Session(server_t& srv, client_t& client, string& buffer)
+{
+    char chunk[16384];
+    bool open = true;
+
+    while (open)
+    {
+        string out;
+        size_t used = 0;
+
+        for (;;)
+        {
+            http_request_t req;
+            const int n = Http_Parse(string_view(buffer).substr(used), req);
+
+            if (n == HTTP_INCOMPLETE)
+                break;
+
+            if (n == HTTP_MALFORMED)
+            {
+                int status = 400;
+                Http_Response(out, status, Http_Error(ERROR_CODES::SYNTAX, "", status), false);
+                open = false;
+                break;
+            }
+
+            int status = 200;
+            const string json = Http_Route(srv, client, req, status);
+
+            Http_Response(out, status, json, req.keep_alive);
+            used += size_t(n);
+
+            if (!req.keep_alive)
+            {
+                open = false;
+                break;
+            }
+        }
+
+        buffer.erase(0, used);
+
+        if (!out.empty() && !Send_Data(client.sock, out))
+            break;
+
+        if (open)
+        {
+            const int n = recv(client.sock, chunk, sizeof(chunk), 0);
+
+            if (n <= 0)
+                break;
+
+            buffer.append(chunk, n);
+        }
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Http_Route
+* Arguments  : srv     = server state
+*              client  = client connection
+*              req     = parsed request
+*              status  = receives the HTTP status
+* Returns    : JSON body of the response
+* Description:
+*   This function carries out one HTTP request:
+*     GET /list                  {"modules": [{"sn": ..., "channels": n, "state": bits}, ...]}
+*     GET /query?m=sernum{@chlist}&...   {"modules": [{"sn": ..., "state": bits}, ...]}
+*     POST /set                  see Http_Set
+*     GET /alias                 {"aliases": {alias: sernum, ...}}
+*     POST /alias                body {alias: sernum, ...}, replies like GET
+*     DELETE /alias/name         replies like GET
+*   Errors reply {"error": {"code": n, "message": text}}.
+*/
+static string Http_Route(server_t& srv, client_t& client, const http_request_t& req, int& status)
+{
+    const bool is_get = (req.method == "GET");
+    const bool is_post = (req.method == "POST");
+    const string_view alias_prefix = "/alias/";
+
+    status = 200;
+
+    if (req.path == "/list" && is_get)
+    {
+        string json = "{\"modules\":[";
+
+        for (size_t i = 0; i < srv.devices.size(); ++i)
+        {
+            device_t& dev = *srv.devices[i];
+            unsigned mask = 0;
+            {
+                lock_guard<mutex> lock(dev.lock);
+                mask = dev.mask;
+            }
+
+            json += (i ? "," : "") + string("{\"sn\":") + Json_String(dev.sn) + ",\"channels\":" + to_string(dev.channels)
+                  + ",\"state\":" + Json_String(Mask_Bits(mask, dev.channels)) + "}";
+        }
+
+        return json + "]}";
+    }
+    else if (req.path == "/query" && is_get)
+    {
+        vector<string> args;
+        vector<pair<string, string>> states;
+        string_view query = req.query, name;
+        string value, error_sernum = "";
+
+        while (Http_Query_Next(query, name, value))
+        {
+            if (name != "m")
+                return Http_Error(ERROR_CODES::SYNTAX, "", status);
+            args.push_back(value);
+        }
+
+        ERROR_CODES error = args.empty() ? ERROR_CODES::SYNTAX : Query_Modules(srv, args, states, error_sernum);
+
+        if (error != ERROR_CODES::NONE)
+            return Http_Error(error, error_sernum, status);
+
+        string json = "{\"modules\":[";
+
+        for (size_t i = 0; i < states.size(); ++i)
+            json += (i ? "," : "") + string("{\"sn\":") + Json_String(states[i].first) + ",\"state\":" + Json_String(states[i].second) + "}";
+
+        return json + "]}";
+    }
+    else if (req.path == "/set" && is_post)
+    {
+        return Http_Set(srv, client, req, status);
+    }
+    else if (req.path == "/alias" && (is_get || is_post))
+    {
+        if (is_post)
+        {
+            vector<pair<string, string>> members;
+
+            if (!Json_Object(req.body, members) || members.empty())
+                return Http_Error(ERROR_CODES::SYNTAX, "", status);
+
+            for (auto const& [alias, sernum] : members)
+            {
+                if (!regex_match(alias, regex_alias_only) || !regex_match(sernum, regex_sernum_only))
+                    return Http_Error(ERROR_CODES::SYNTAX, "", status);
+            }
+
+            {
+                lock_guard<mutex> lock(srv.alias_lock);
+                for (auto const& [alias, sernum] : members)
+                    AssignAlias(alias, sernum);
+            }
+
+            Check_Aliases(srv, true);
+        }
+
+        return Http_Aliases(srv);
+    }
+    else if (req.path.substr(0, alias_prefix.size()) == alias_prefix && req.method == "DELETE")
+    {
+        const string alias(req.path.substr(alias_prefix.size()));
+
+        if (!regex_match(alias, regex_alias_only))
+            return Http_Error(ERROR_CODES::SYNTAX, "", status);
+
+        {
+            lock_guard<mutex> lock(srv.alias_lock);
+            RemoveAlias(alias);
+        }
+
+        Check_Aliases(srv, true);
+
+        return Http_Aliases(srv);
+    }
+
+    const bool known = (req.path == "/list" || req.path == "/query" || req.path == "/set" || req.path == "/alias"
+                     || req.path.substr(0, alias_prefix.size()) == alias_prefix);
+
+    status = known ? 405 : 404;
+
+    return "{\"error\":{\"code\":" + to_string(int(ERROR_CODES::SYNTAX)) + ",\"message\":"
+         + Json_String(known ? "Method not allowed" : "No such resource") + "}}";
+}
+
+
+/*******************************************************************************
+* Function   : Http_Set
+* Arguments  : srv     = server state
+*              client  = client connection
+*              req     = parsed request
+*              status  = receives the HTTP status
+* Returns    : JSON body of the response
+* Description:
+*   This function handles POST /set{?id=token&deadline=ms} with a body of
+*   {"sernum or alias": "011XX0" or "1=0 2=1", ...}, as SET would take them.
+*   The ID and deadline work as ID= and DEADLINE= do for the line protocol;
+*   client=name names the client, as CLIENT does, so that a request retried
+*   on a new connection is recognized. Replies {"ok": true}.
+*/
+static string Http_Set(server_t& srv, client_t& client, const http_request_t& req, int& status)
+{
+    vector<pair<string, string>> members;
+    vector<string> args;
+    string_view query = req.query, name;
+    string value, id = "";
+
+    client.deadline = NO_DEADLINE;
+
+    while (Http_Query_Next(query, name, value))
+    {
+        if (name == "id" && regex_match(value, regex_request_id))
+        {
+            id = value;
+        }
+        else if (name == "client" && regex_match(value, regex_client_name))
+        {
+            client.name = value;
+            std::transform(client.name.begin(), client.name.end(), client.name.begin(), ::toupper);
+            client.id = Client_Id(srv, client.name);
+        }
+        else if (name == "deadline" && !value.empty() && value.size() <= 7 && all_of(value.begin(), value.end(), ::isdigit) && stoi(value) <= DEADLINE_MAX_MS)
+        {
+            client.deadline = chrono::steady_clock::now() + chrono::milliseconds(stoi(value));
+        }
+        else
+        {
+            return Http_Error(ERROR_CODES::SYNTAX, "", status);
+        }
+    }
+
+    if (!Json_Object(req.body, members) || members.empty())
+        return Http_Error(ERROR_CODES::SYNTAX, "", status);
+
+    for (auto const& [module, pattern] : members)
+    {   // "011XX0" or "1=0 2=1 ..."
+        istringstream tokens(pattern);
+        string token;
+
+        if (pattern.find_first_of("=:") == string::npos)
+            args.push_back(module + ":" + pattern);
+        else
+        {
+            args.push_back(module);
+            while (tokens >> token)
+                args.push_back(token);
+        }
+    }
+
+    // the reply is kept as "status json" so a repeat gets the same status
+    auto set = [&](ERROR_CODES& error) {
+        string error_sernum = "";
+        int code = 200;
+
+        error = Set_Modules(srv, client, args, error_sernum);
+
+        return to_string(code) + " " + ((error == ERROR_CODES::NONE) ? "{\"ok\":true}" : Http_Error(error, error_sernum, code));
+    };
+
+    string reply = "";
+    ERROR_CODES error = ERROR_CODES::NONE;
+
+    if (id.empty())
+        reply = set(error);
+    else if ((error = Run_Once(srv, client, "HTTP", id, Plan_Key("SET", args), set, reply)) != ERROR_CODES::NONE)
+        return Http_Error(error, id, status);
+
+    status = atoi(reply.c_str());
+
+    return reply.substr(reply.find(' ') + 1);
+}
+
+
+/*******************************************************************************
+* Function   : Http_Aliases
+* Arguments  : srv  = server state
+* Returns    : JSON body: {"aliases": {"alias": "sernum", ...}}
+* Description:
+*   This function lists the aliases, sorted by name
+*/
+static string Http_Aliases(server_t& srv)
+{
+    lock_guard<mutex> lock(srv.alias_lock);
+    auto index = Alias_Index(MODULE_CHANNELS{});
+    map<string, string> aliases(index.begin(), index.end());
+    string json = "{\"aliases\":{";
+    bool first = true;
+
+    for (auto const& [alias, sernum] : aliases)
+    {
+        json += (first ? "" : ",") + Json_String(alias) + ":" + Json_String(sernum);
+        first = false;
+    }
+
+    return json + "}}";
+}
+
+
+/*******************************************************************************
+* Function   : Http_Error
+* Arguments  : error         = error code
+*              error_sernum  = offending sernum
+*              status        = receives the HTTP status for the error
+* Returns    : JSON body: {"error": {"code": n, "message": text}}
+* Description:
+*   This function formats an error for an HTTP client
+*/
+static string Http_Error(ERROR_CODES error, const string& error_sernum, int& status)
+{
+    switch (error)
+    {
+    case ERROR_CODES::BAD_SERNUM:
+        status = 404;
+        break;
+    case ERROR_CODES::RESERVED:
+    case ERROR_CODES::MISMATCH:
+    case ERROR_CODES::DUPLICATE:
+        status = 409;
+        break;
+    case ERROR_CODES::BUSY:
+    case ERROR_CODES::EXPIRED:
+    case ERROR_CODES::DEVICE_IO:
+    case ERROR_CODES::NO_DEVICES:
+        status = 503;
+        break;
+    case ERROR_CODES::TIMEOUT:
+        status = 504;
+        break;
+    default:
+        status = 400;
+        break;
+    }
+
+    return "{\"error\":{\"code\":" + to_string(int(error)) + ",\"message\":" + Json_String(Error_Message(error, error_sernum)) + "}}";
+}
+
+
+/*******************************************************************************
+* Function   : Find_Device
+* Arguments  : srv     = server state
+*              sernum  = serial number of the module
+*              pidx    = optionally receives the index into srv.devices
+* Returns    : pointer to the module, or nullptr if the server does not hold it
+* Description:
+*   This function looks up a module held by the server
+*/
+static device_t* Find_Device(server_t& srv, const string& sernum, size_t* pidx)
+{
+    auto it = srv.index.find(sernum);
+
+    if (it == srv.index.end())
+        return nullptr;
+
+    if (pidx)
+        *pidx = it->second;
+
+    return srv.devices[it->second].get();
+}
+
+
+/*******************************************************************************
+* Function   : Get_Owner
+* Arguments  : srv   = server state
+*              name  = client name
+* Returns    : reservations of the client (created if necessary)
+* Description:
+*   This function returns the reservation masks of a client.
+*   Must be called with srv.reserve_lock held exclusively.
+*/
+static owner_t& Get_Owner(server_t& srv, const string& name)
+{
+    auto it = srv.owners.find(name);
+
+    if (it == srv.owners.end())
+    {
+        owner_t owner;
+        owner.owned.assign(srv.devices.size(), 0);
+        owner.deny = srv.reserved;
+        it = srv.owners.emplace(name, owner).first;
+    }
+
+    return it->second;
+}
+
+
+/*******************************************************************************
+* Function   : Update_Deny
+* Arguments  : srv  = server state
+*              idx  = index of the module whose reservations changed
+* Returns    : none
+* Description:
+*   This function recomputes, for every client, the channels of one module
+*   reserved by someone else. Reservations change rarely, so the work is done
+*   here and the write path only needs a single AND against the deny mask.
+*   Must be called with srv.reserve_lock held exclusively.
+*/
+static void Update_Deny(server_t& srv, size_t idx)
+{
+    for (auto& [name, owner] : srv.owners)
+        owner.deny[idx] = srv.reserved[idx] & ~owner.owned[idx];
+}
+
+
+/*******************************************************************************
+* Function   : Deny_Mask
+* Arguments  : srv   = server state
+*              name  = client name
+*              idx   = index of the module
+* Returns    : channels of the module the client may not change
+* Description:
+*   This function returns the channels of a module reserved by clients other
+*   than this one (every reserved channel, for a client with none of its own).
+*   Must be called with srv.reserve_lock held.
+*/
+static unsigned Deny_Mask(server_t& srv, const string& name, size_t idx)
+{
+    auto owner = srv.owners.find(name);
+
+    return (owner != srv.owners.end()) ? owner->second.deny[idx] : srv.reserved[idx];
+}
+
+
+/*******************************************************************************
+* Function   : Write_Checked
+* Arguments  : srv        = server state
+*              idx        = index of the module
+*              client_id  = client the write is made for
+*              on         = channels to turn on
+*              off        = channels to turn off
+* Returns    : ERROR_CODES::NONE for success, RESERVED if channels reserved
+*              by another client were left out, otherwise failure
+* Description:
+*   This function makes a write the server decided on by itself (a rule or a
+*   duty cycle) for a client, checked against the reservations like a
+*   client's own write. The write may merge independent actions, so instead
+*   of refusing it as a whole, the channels reserved by another client are
+*   left out and the rest is written. Clients without a CLIENT name share one
+*   id, so their writes are checked against every reservation.
+*/
+static ERROR_CODES Write_Checked(server_t& srv, size_t idx, uint32_t client_id, unsigned on, unsigned off)
+{
+    device_t& dev = *srv.devices[idx];
+    const string name = Client_Name(srv, client_id);
+
+    shared_lock<shared_mutex> lock(srv.reserve_lock);
+    const unsigned deny = Deny_Mask(srv, name, idx);
+
+    if ((on | off) & ~deny)
+    {
+        ERROR_CODES rc = Device_Write(dev, client_id, rmw_t{ dev.sn, on & ~deny, off & ~deny, 0, 0, 0 });
+
+        if (rc != ERROR_CODES::NONE)
+            return rc;
+    }
+
+    return ((on | off) & deny) ? ERROR_CODES::RESERVED : ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Drop_Owner
+* Arguments  : srv   = server state
+*              name  = client name
+* Returns    : none
+* Description:
+*   This function releases every channel reserved by a client and forgets
+*   the client
+*/
+static void Drop_Owner(server_t& srv, const string& name)
+{
+    unique_lock<shared_mutex> lock(srv.reserve_lock);
+    auto it = srv.owners.find(name);
+
+    if (it == srv.owners.end())
+        return;
+
+    const vector<unsigned> owned = it->second.owned;
+
+    srv.owners.erase(it);
+
+    for (size_t idx = 0; idx < owned.size(); ++idx)
+    {
+        if (owned[idx])
+        {
+            srv.reserved[idx] &= ~owned[idx];
+            Update_Deny(srv, idx);
+        }
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Client_Id
+* Arguments  : srv   = server state
+*              name  = client name
+* Returns    : numeric id of the client
+* Description:
+*   This function maps a client name to a small id (assigned on first use)
+*   that is stored in the history instead of the name
+*/
+static uint32_t Client_Id(server_t& srv, const string& name)
+{
+    lock_guard<mutex> lock(srv.clients_lock);
+
+    auto it = srv.client_ids.find(name);
+    if (it != srv.client_ids.end())
+        return it->second;
+
+    srv.client_names.push_back(name);
+    return srv.client_ids[name] = uint32_t(srv.client_names.size() - 1);
+}
+
+
+/*******************************************************************************
+* Function   : Client_Name
+* Arguments  : srv  = server state
+*              id   = numeric id of the client
+* Returns    : client name
+* Description:
+*   This function maps a client id back to its name
+*/
+static string Client_Name(server_t& srv, uint32_t id)
+{
+    lock_guard<mutex> lock(srv.clients_lock);
+
+    return (id < srv.client_names.size()) ? srv.client_names[id] : "?";
+}
+
+
+/*******************************************************************************
+* Function   : Reply_Error
+* Arguments  : error         = error code
+*              error_sernum  = offending sernum (for BAD_SERNUM)
+* Returns    : reply line
+* Description:
+*   This function formats an error reply: "ERR code message"
+*/
+static string Reply_Error(ERROR_CODES error, const string& error_sernum)
+{
+    return "ERR " + to_string(int(error)) + " " + Error_Message(error, error_sernum);
+}
+
+
+/*******************************************************************************
+* Function   : Send_Line
+* Arguments  : sock  = client socket
+*              line  = reply line (without line terminator)
+* Returns    : true = success, false = connection lost
+* Description:
+*   This function sends one reply line terminated by CR LF
+*/
+static bool Send_Line(SOCKET sock, const string& line)
+{
+    return Send_Data(sock, line + "\r\n");
+}
+
+
+/*******************************************************************************
+* Function   : Send_Data
+* Arguments  : sock  = client socket
+*              data  = bytes to send
+* Returns    : true = success, false = connection lost
+* Description:
+*   This function sends all of data
+*/
+static bool Send_Data(SOCKET sock, const string& data)
+{
+    size_t sent = 0;
+
+    while (sent < data.length())
+    {
+        int n = send(sock, data.data() + sent, int(data.length() - sent), 0);
+
+        if (n <= 0)
+            return false;
+
+        sent += n;
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,28 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayServer.h
+* Description:
+*   Long-running server mode: holds the relay modules open and accepts
+*   line-oriented requests from any number of local clients
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include "Relay.h"
+
+// default TCP port (the server only listens on localhost)
+constexpr unsigned short RELAY_SERVER_PORT = 7337;
+
+// run the server until the process is terminated
+// (recording every state change to record_file if it is not empty)
+ERROR_CODES Relays_Serve(unsigned short port, const MODULE_CHANNELS& channels, const std::string& record_file);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
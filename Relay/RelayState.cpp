@@ -0,0 +1,339 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayState.cpp
+* Description:
+*   Last commanded state of every module, kept in a small file so it can be
+*   restored after the modules lose power
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+#include "RelayState.h"
+#include "RelayLock.h"
+
+// file layout
+constexpr char STATE_MAGIC[] = "RLYSTAT1";     // 8-byte header
+constexpr size_t STATE_HEADER_SIZE = 8;
+constexpr size_t STATE_SN_SIZE = 12;
+constexpr size_t STATE_RECORD_SIZE = 16;        // sernum, mask
+
+// name of the cross-process lock that serializes access to the file
+constexpr char STATE_LOCK_NAME[] = "~STATE";
+
+#ifdef _WIN32
+constexpr char STATE_FILE_NAME[] = "\\WWES_Relay.state";
+#else
+constexpr char STATE_FILE_DEFAULT[] = "/var/tmp/WWES_Relay.state";
+#endif
+
+
+/*******************************************************************************
+* Function   : State_Path
+* Arguments  : none
+* Returns    : path of the state file (empty = keep no state)
+* Description:
+*   RELAY_STATE_FILE if it is set, otherwise a file that survives a reboot
+*/
+string State_Path()
+{
+    const char* env = getenv("RELAY_STATE_FILE");
+
+    if (env)
+        return env;
+
+#ifdef _WIN32
+    const char* dir = getenv("ProgramData");
+
+    return string(dir ? dir : ".") + STATE_FILE_NAME;
+#else
+    return STATE_FILE_DEFAULT;
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::State_Store
+* Arguments  : path  = state file (empty = keep no state)
+* Returns    : none
+* Description:
+*   The file is opened on first use
+*/
+State_Store::State_Store(const string& path) : enabled(!path.empty()), path(path)
+{
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::~State_Store
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Writes the states still queued and stops the thread
+*/
+State_Store::~State_Store()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+
+    queued.notify_all();
+
+    if (saver.joinable())
+        saver.join();
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::Load
+* Arguments  : masks  = receives the saved state of each module
+* Returns    : true = success, false = the state file cannot be used
+* Description:
+*   Reads every record in the file. States queued but not written yet are
+*   newer, so they take the place of the file's.
+*/
+bool State_Store::Load(map<string, unsigned>& masks)
+{
+    lock_guard<mutex> io_guard(io);
+
+    if (!Open())
+        return false;
+
+    {
+        Device_Lock file_lock(STATE_LOCK_NAME);
+        Scan();
+
+        for (auto const& [sn, offset] : offsets)
+        {
+            unsigned char record[STATE_RECORD_SIZE] = {};
+
+            file.seekg(offset);
+            if (file.read(reinterpret_cast<char*>(record), STATE_RECORD_SIZE))
+                masks[sn] = record[12] | (record[13] << 8) | (record[14] << 16) | (unsigned(record[15]) << 24);
+        }
+
+        file.clear();
+    }
+
+    lock_guard<mutex> guard(lock);
+
+    for (auto const& [sn, mask] : pending)
+        masks[sn] = mask;
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::Save
+* Arguments  : sernum  = serial number of the module
+*              mask    = state written to it
+* Returns    : none
+* Description:
+*   Queues the module's state for the save thread, unless that state is
+*   already queued. This is called on every write, so it does nothing slower
+*   than a map lookup; whether the file already holds the state (which
+*   another process may have changed since) is left to Write.
+*/
+void State_Store::Save(const string& sernum, unsigned mask)
+{
+    if (!enabled)
+        return;
+
+    const string sn = sernum.substr(0, STATE_SN_SIZE);
+    lock_guard<mutex> guard(lock);
+    auto it = pending.find(sn);
+
+    if (it != pending.end() && it->second == mask)
+        return;
+
+    pending[sn] = mask;
+
+    if (!saver.joinable())
+        saver = thread(&State_Store::Save_Thread, this);
+
+    queued.notify_all();
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::Save_Thread
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Waits for a state to be queued, lets more gather for STATE_SAVE_MS (so
+*   a burst of writes is saved together) and writes them. Once the store is
+*   being destroyed it writes what is left at once.
+*/
+void State_Store::Save_Thread()
+{
+    unique_lock<mutex> guard(lock);
+
+    while (running || !pending.empty())
+    {
+        if (pending.empty())
+        {
+            queued.wait(guard);
+            continue;
+        }
+
+        queued.wait_for(guard, chrono::milliseconds(STATE_SAVE_MS), [this] { return !running; });
+
+        map<string, unsigned> batch;
+        batch.swap(pending);
+
+        guard.unlock();
+        Write(batch);
+        guard.lock();
+    }
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::Write
+* Arguments  : masks  = state of each module to save
+* Returns    : none
+* Description:
+*   Rewrites the records that do not hold the modules' states already, or
+*   appends one the first time a module is saved, then flushes once. Other
+*   processes saving at the same time are held off by a cross-process lock,
+*   so a record is compared with what is in the file at the time.
+*/
+void State_Store::Write(const map<string, unsigned>& masks)
+{
+    lock_guard<mutex> io_guard(io);
+
+    if (!Open())
+        return;
+
+    Device_Lock file_lock(STATE_LOCK_NAME);
+    bool written = false;
+
+    for (auto const& [sn, mask] : masks)
+    {
+        auto it = offsets.find(sn);
+
+        if (it == offsets.end())
+        {   // another process may have added it
+            const streamoff end = Scan();
+
+            it = offsets.find(sn);
+            if (it == offsets.end())
+                it = offsets.emplace(sn, end).first;
+        }
+
+        char record[STATE_RECORD_SIZE] = {};
+        memcpy(record, sn.data(), sn.size());
+        for (int i = 0; i < 4; ++i)
+            record[12 + i] = char(mask >> (8 * i));
+
+        char current[STATE_RECORD_SIZE];
+
+        file.seekg(it->second);
+        if (file.read(current, STATE_RECORD_SIZE) && memcmp(current, record, STATE_RECORD_SIZE) == 0)
+            continue;
+
+        file.clear();
+        file.seekp(it->second);
+        file.write(record, STATE_RECORD_SIZE);
+        written = true;
+    }
+
+    if (written)
+        file.flush();
+
+    file.clear();
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::Open
+* Arguments  : none
+* Returns    : true = the file is open
+* Description:
+*   Opens the file, creating it if it does not exist. A file that is not a
+*   state file is left alone.
+*/
+bool State_Store::Open()
+{
+    if (file.is_open())
+        return true;
+
+    if (path.empty())
+        return false;
+
+    Device_Lock file_lock(STATE_LOCK_NAME);
+
+    file.open(path, ios::in | ios::out | ios::binary);
+    if (!file.is_open())
+    {
+        ofstream create(path, ios::binary);
+        create.write(STATE_MAGIC, STATE_HEADER_SIZE);
+        create.close();
+
+        file.open(path, ios::in | ios::out | ios::binary);
+        if (!file.is_open())
+            return false;
+    }
+
+    char header[STATE_HEADER_SIZE] = {};
+    file.read(header, STATE_HEADER_SIZE);
+
+    if (file.gcount() == 0)
+    {   // created empty by an earlier attempt
+        file.clear();
+        file.seekp(0);
+        file.write(STATE_MAGIC, STATE_HEADER_SIZE);
+        file.flush();
+    }
+    else if (memcmp(header, STATE_MAGIC, STATE_HEADER_SIZE) != 0)
+    {
+        file.close();
+        path.clear();   // not ours: do not try again
+        return false;
+    }
+
+    file.clear();
+
+    return true;
+}
+
+
+/*******************************************************************************
+* Function   : State_Store::Scan
+* Arguments  : none
+* Returns    : offset just past the last whole record
+* Description:
+*   Reads the position of every record (the caller holds the file lock)
+*/
+streamoff State_Store::Scan()
+{
+    char record[STATE_RECORD_SIZE];
+    streamoff offset = STATE_HEADER_SIZE;
+
+    offsets.clear();
+    file.seekg(offset);
+
+    while (file.read(record, STATE_RECORD_SIZE))
+    {
+        offsets[string(record, strnlen(record, STATE_SN_SIZE))] = offset;
+        offset += STATE_RECORD_SIZE;
+    }
+
+    file.clear();
+
+    return offset;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
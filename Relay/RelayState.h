@@ -0,0 +1,75 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayState.h
+* Description:
+*   Last commanded state of every module, kept in a small file so it can be
+*   restored after the modules lose power
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// states saved within this long of each other are written to the file together
+constexpr int STATE_SAVE_MS = 100;
+
+// The file is an 8-byte header followed by one 16-byte record per module
+// (sernum padded with NULs to 12 bytes, then the mask, little-endian). A
+// record is rewritten in place when its module's state changes, so the file
+// stays the same size however many writes are made. Save() only queues the
+// state: a thread of its own writes the states queued within STATE_SAVE_MS
+// under one cross-process lock and one flush, and the rest are written when
+// the store is destroyed. A record that already holds the state queued is
+// not rewritten.
+class State_Store
+{
+public:
+    explicit State_Store(const std::string& path);
+    ~State_Store();
+    State_Store(const State_Store&) = delete;
+    State_Store& operator=(const State_Store&) = delete;
+
+    // last saved state of every module; false if the file cannot be used
+    bool Load(std::map<std::string, unsigned>& masks);
+
+    // save the state of a module (does nothing if the path is empty)
+    void Save(const std::string& sernum, unsigned mask);
+
+private:
+    void Save_Thread();
+    void Write(const std::map<std::string, unsigned>& masks);
+    bool Open();
+    std::streamoff Scan();
+
+    const bool enabled;                     // the path was not empty
+
+    std::mutex lock;                        // guards the members up to saver
+    std::condition_variable queued;         // a state was queued, or shutting down
+    bool running = true;
+    std::map<std::string, unsigned> pending;    // sernum -> state not yet written
+    std::thread saver;                      // started by the first Save()
+
+    std::mutex io;                          // guards everything below
+    std::string path;
+    std::fstream file;
+    std::map<std::string, std::streamoff> offsets;  // sernum -> record
+};
+
+// the state file: RELAY_STATE_FILE if set (empty to keep no state), otherwise
+// %ProgramData%\WWES_Relay.state (Windows) or /var/tmp/WWES_Relay.state
+std::string State_Path();
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
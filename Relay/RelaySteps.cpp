@@ -0,0 +1,370 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelaySteps.cpp
+* Description:
+*   Runs a graph of dependent steps (A before B, E 50 ms after B and D),
+*   each step as soon as the steps it comes after allow. Steps on different
+*   modules run at the same time; steps on the same module that are ready
+*   together are made in one write.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "RelaySteps.h"
+#include "RelayContext.h"
+#include "RelayTune.h"
+
+// support function declarations
+static vector<int64_t> Plan_Steps(const STEP_GRAPH& steps, map<string, unsigned> states, const map<string, int64_t>& report_us, vector<int64_t>& finish_us, vector<size_t>& critical);
+
+
+/*******************************************************************************
+* Function   : Relays_Steps
+* Arguments  : context       = open modules
+*              steps         = graph of steps
+*              channels      = structure of enumerated channels
+*              plan_only     = print the plan without running the steps
+*              error_sernum  = receives the sernum of a module that failed
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   This function reads every module in the graph (which also measures how
+*   long one report to it takes), and plans when each step would start and
+*   the critical path. Unless plan_only, it then runs the steps: a step is ready
+*   once every step it comes after is done and that step's delay has passed,
+*   counted from when it was actually done. Whenever steps are ready, those
+*   on each idle module are made in one write, on a thread per module. No
+*   step is started after a write fails. Every step is then printed, with
+*   its planned start and when it was done, followed by the critical path.
+*/
+ERROR_CODES Relays_Steps(Relay_Context& context, const STEP_GRAPH& steps, const MODULE_CHANNELS& channels, bool plan_only, string& error_sernum)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    map<string, unsigned> states;
+    map<string, int64_t> report_us;
+    vector<string> sernums;
+
+    for (step_t const& step : steps)
+    {
+        if (!states.count(step.sn))
+            sernums.push_back(step.sn);
+        states[step.sn] = 0;
+        report_us[step.sn] = 0;
+    }
+
+    // read each module once, in parallel
+    vector<ERROR_CODES> results(sernums.size(), ERROR_CODES::NONE);
+
+    Fan_Out(sernums.size(), (sernums.size() > 1) ? Fan_Out_Width(context, channels) : 1, [&](size_t i) {
+        latency_t latency;
+        bool stuck = false;
+
+        results[i] = context.Query(sernums[i], states[sernums[i]]);
+
+        if (context.Latency(sernums[i], latency, stuck))
+            report_us[sernums[i]] = int64_t(latency.mean_us);
+    });
+
+    for (size_t i = 0; i < sernums.size() && error == ERROR_CODES::NONE; ++i)
+    {
+        error = results[i];
+        error_sernum = sernums[i];
+    }
+
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    error_sernum = "";
+
+    vector<size_t> critical;
+    vector<int64_t> plan_finish_us;
+    const vector<int64_t> plan_us = Plan_Steps(steps, states, report_us, plan_finish_us, critical);
+    vector<int64_t> done_us(steps.size(), -1);
+
+    if (!plan_only)
+    {
+        const auto start = chrono::steady_clock::now();
+        auto elapsed_us = [start] { return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count(); };
+
+        mutex lock;                 // guards everything below
+        condition_variable finished;
+        vector<bool> started(steps.size(), false);
+        map<string, bool> busy;     // sernum -> a write is under way
+        size_t num_started = 0;
+        size_t in_flight = 0;
+        vector<thread> writers;
+
+        unique_lock<mutex> guard(lock);
+
+        while (in_flight > 0 || (error == ERROR_CODES::NONE && num_started < steps.size()))
+        {
+            const int64_t now = elapsed_us();
+            int64_t wake_us = INT64_MAX;
+            map<string, vector<size_t>> batches;    // sernum -> steps ready on it
+
+            for (size_t i = 0; i < steps.size() && error == ERROR_CODES::NONE; ++i)
+            {
+                bool ready = !started[i];
+                int64_t ready_us = 0;
+
+                for (auto const& [after, delay_ms] : steps[i].after)
+                {
+                    if (!ready || done_us[after] < 0)
+                    {
+                        ready = false;
+                        break;
+                    }
+                    ready_us = max(ready_us, done_us[after] + int64_t(delay_ms) * 1000);
+                }
+
+                if (!ready)
+                    continue;
+
+                if (ready_us > now)
+                    wake_us = min(wake_us, ready_us);
+                else if (!busy[steps[i].sn])
+                    batches[steps[i].sn].push_back(i);
+            }
+
+            for (auto const& [sn, batch] : batches)
+            {
+                busy[sn] = true;
+                for (size_t i : batch)
+                    started[i] = true;
+                num_started += batch.size();
+                ++in_flight;
+
+                writers.emplace_back([&, sn = sn, batch = batch] {
+                    unsigned old_mask = states[sn];
+                    unsigned new_mask = old_mask;
+
+                    for (size_t i : batch)
+                        new_mask = (new_mask & ~steps[i].clear_mask) | steps[i].set_mask;
+
+                    const ERROR_CODES rc = context.Write(sn, old_mask, new_mask);
+                    const int64_t when_us = elapsed_us();
+
+                    lock_guard<mutex> done_guard(lock);
+
+                    if (rc == ERROR_CODES::NONE)
+                    {
+                        states[sn] = new_mask;
+                        for (size_t i : batch)
+                            done_us[i] = when_us;
+                    }
+                    else if (error == ERROR_CODES::NONE)
+                    {
+                        error = rc;
+                        error_sernum = sn;
+                    }
+
+                    busy[sn] = false;
+                    --in_flight;
+                    finished.notify_all();
+                });
+            }
+
+            if (!batches.empty())
+                continue;
+
+            if (wake_us == INT64_MAX)
+            {
+                finished.wait(guard);
+            }
+            else if (wake_us - now > STEPS_SPIN_US)
+            {
+                finished.wait_until(guard, start + chrono::microseconds(wake_us - STEPS_SPIN_US));
+            }
+            else
+            {   // spin out the last stretch
+                guard.unlock();
+                while (elapsed_us() < wake_us)
+                    this_thread::yield();
+                guard.lock();
+            }
+        }
+
+        guard.unlock();
+
+        for (thread& t : writers)
+            t.join();
+    }
+
+    // the plan (and what happened)
+    std::cout << "step        sernum  set         plan ms" << (plan_only ? "" : "    done ms") << endl;
+
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        const step_t& step = steps[i];
+
+        std::cout << left << setw(10) << step.name << right << "  " << step.sn << "   " << left << setw(8)
+            << Pattern_Bits(step.set_mask | step.clear_mask, step.set_mask, Relays_Get_NumChannels(step.sn, channels)) << right
+            << fixed << setprecision(3) << setw(10) << plan_us[i] / 1000.0;
+
+        if (!plan_only && done_us[i] >= 0)
+            std::cout << setw(11) << done_us[i] / 1000.0;
+        else if (!plan_only)
+            std::cout << setw(11) << "-";
+
+        std::cout << endl;
+    }
+
+    string path = "";
+
+    for (size_t i : critical)
+        path += (path.empty() ? "" : " > ") + steps[i].name;
+
+    const size_t last = critical.back();
+
+    std::cout << "Critical path " << path << ": " << plan_finish_us[last] / 1000.0 << " ms planned";
+    if (!plan_only && done_us[last] >= 0)
+        std::cout << ", " << done_us[last] / 1000.0 << " ms actual";
+    std::cout << endl;
+
+    return error;
+}
+
+
+/*******************************************************************************
+* Function   : Plan_Steps
+* Arguments  : steps      = graph of steps
+*              states     = state read from each module
+*              report_us  = time one report to each module takes
+*              finish_us  = receives the planned end of each step's write
+*              critical   = receives the critical path, first step first
+* Returns    : planned start of each step (us from the start)
+* Description:
+*   Plans the steps the way Relays_Steps runs them. A step is ready once
+*   every step it comes after has been written and the delay has passed,
+*   but a module takes one write at a time: a ready step waits until its
+*   module is free, and the steps ready on a module when it is written go
+*   in the same write. A write takes one report per channel it changes
+*   (Relay_Write_Mask writes channels one at a time). The critical path ends at the step that finishes
+*   last, and runs back through whichever step held up each step on it (a
+*   step it comes after, or the one in the write its module was busy with).
+*/
+static vector<int64_t> Plan_Steps(const STEP_GRAPH& steps, map<string, unsigned> states, const map<string, int64_t>& report_us, vector<int64_t>& finish_us, vector<size_t>& critical)
+{
+    vector<int64_t> start_us(steps.size(), -1);
+    vector<size_t> held_by(steps.size(), SIZE_MAX);
+    map<string, int64_t> free_us;   // sernum -> when the module can be written
+    map<string, size_t> last_on;    // sernum -> a step of the module's last write
+
+    finish_us.assign(steps.size(), -1);
+
+    // when a step is ready (-1 until every step it comes after is planned),
+    // and which of those steps holds it up
+    auto ready_us = [&](size_t i, size_t& by) {
+        int64_t t = 0;
+
+        by = SIZE_MAX;
+
+        for (auto const& [after, delay_ms] : steps[i].after)
+        {
+            if (start_us[after] < 0)
+                return int64_t(-1);
+
+            if (finish_us[after] + int64_t(delay_ms) * 1000 >= t)
+            {
+                t = finish_us[after] + int64_t(delay_ms) * 1000;
+                by = after;
+            }
+        }
+
+        return t;
+    };
+
+    // the graph has no cycles (see Parse_Steps_File), so every pass plans
+    // at least one write
+    for (size_t planned = 0; planned < steps.size(); )
+    {
+        size_t best = SIZE_MAX;
+        int64_t best_us = 0;
+
+        for (size_t i = 0; i < steps.size(); ++i)
+        {
+            size_t by = SIZE_MAX;
+            const int64_t ready = (start_us[i] < 0) ? ready_us(i, by) : -1;
+
+            if (ready < 0)
+                continue;
+
+            const int64_t t = max(ready, free_us[steps[i].sn]);
+
+            if (best == SIZE_MAX || t < best_us)
+            {
+                best = i;
+                best_us = t;
+            }
+        }
+
+        // the write: every step ready on the module by then
+        const string sn = steps[best].sn;
+        vector<size_t> batch;
+
+        for (size_t i = 0; i < steps.size(); ++i)
+        {
+            size_t by = SIZE_MAX;
+            const int64_t ready = (start_us[i] < 0 && steps[i].sn == sn) ? ready_us(i, by) : -1;
+
+            if (ready < 0 || ready > best_us)
+                continue;
+
+            held_by[i] = (last_on.count(sn) && free_us[sn] > ready) ? last_on[sn] : by;
+            batch.push_back(i);
+        }
+
+        unsigned new_mask = states[sn];
+
+        for (size_t i : batch)
+            new_mask = (new_mask & ~steps[i].clear_mask) | steps[i].set_mask;
+
+        free_us[sn] = best_us + report_us.at(sn) * popcount(states[sn] ^ new_mask);
+        states[sn] = new_mask;
+
+        for (size_t i : batch)
+        {
+            start_us[i] = best_us;
+            finish_us[i] = free_us[sn];
+        }
+
+        last_on[sn] = best;
+        planned += batch.size();
+    }
+
+    size_t last = 0;
+
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        if (finish_us[i] > finish_us[last])
+            last = i;
+    }
+
+    critical.clear();
+
+    for (size_t i = last; i != SIZE_MAX; i = held_by[i])
+        critical.insert(critical.begin(), i);
+
+    return start_us;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
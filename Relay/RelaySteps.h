@@ -0,0 +1,32 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelaySteps.h
+* Description:
+*   Runs a graph of dependent steps (A before B, E 50 ms after B and D),
+*   each step as soon as the steps it comes after allow
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <string>
+#include "Relay.h"
+
+class Relay_Context;
+
+// the last stretch of a wait for a step to fall due is spun rather than
+// slept (a sleep ends on an OS timer tick)
+constexpr int64_t STEPS_SPIN_US = 1500;
+
+// prints the planned start of each step and the critical path; runs the
+// steps unless plan_only, printing when each was done
+ERROR_CODES Relays_Steps(Relay_Context& context, const STEP_GRAPH& steps, const MODULE_CHANNELS& channels, bool plan_only, std::string& error_sernum);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,252 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayTune.cpp
+* Description:
+*   Fan-out of one operation over many modules, with the number of modules
+*   handled at once tuned to the host's USB topology. Whether modules on the
+*   same hub or controller can be driven in parallel depends on the hardware,
+*   so the width is measured: every module is queried at widths 1, 2, 4, ...
+*   and the smallest width within TUNE_TOLERANCE of the fastest is kept. It
+*   is saved with a signature of the modules and their device paths (which
+*   name the ports), and measured again when the signature changes. The
+*   signature is taken from the inventory, so finding the saved width does
+*   not enumerate the bus.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "EasyRegistry.h"
+#include "RelayTune.h"
+#include "RelayContext.h"
+
+// registry key (same key as the aliases): "width,signature"
+constexpr char REG_KEY_RELAY_TUNE[] = "SOFTWARE\\WWES\\Relay";
+constexpr char REG_SETTING_FAN_OUT[] = "FanOut";
+
+// measurement
+constexpr int TUNE_ROUNDS = 5;                  // fan-outs timed at each width (median is used)
+constexpr double TUNE_TOLERANCE = 0.10;         // fraction slower than the best that is still acceptable
+
+// support function declarations
+static string Topology_Signature(Relay_Context& context);
+static double Fan_Out_Time_ms(Relay_Context& context, const MODULE_CHANNELS& channels, int width, ERROR_CODES& error);
+
+
+/*******************************************************************************
+* Function   : Fan_Out
+* Arguments  : count  = number of calls
+*              width  = most calls running at once
+*              fn     = fn(i) for i = 0 .. count - 1
+* Returns    : none
+* Description:
+*   Runs the calls on up to width threads (including the calling thread),
+*   each taking the next call as it finishes one
+*/
+void Fan_Out(size_t count, int width, const function<void(size_t)>& fn)
+{
+    atomic<size_t> next{ 0 };
+    const size_t num_threads = min(count, size_t(max(width, 1)));
+    vector<thread> threads;
+
+    auto worker = [&next, count, &fn] {
+        for (size_t i = next++; i < count; i = next++)
+            fn(i);
+    };
+
+    for (size_t t = 1; t < num_threads; ++t)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+
+/*******************************************************************************
+* Function   : Fan_Out_Width
+* Arguments  : context   = open modules
+*              channels  = structure of enumerated channels
+* Returns    : number of modules to handle at once
+* Description:
+*   Returns the width saved for this host. If nothing is saved, or the modules
+*   or their ports have changed since, the width is measured and saved first.
+*   If it cannot be measured, every module is handled at once, and that width
+*   is saved instead, so the measurement is not tried again on every call
+*   (until the modules change, or TUNE is run).
+*/
+int Fan_Out_Width(Relay_Context& context, const MODULE_CHANNELS& channels)
+{
+    const int all = max(int(channels.size()), 1);
+    const string signature = Topology_Signature(context);
+    string saved = "";
+    int width = 0;
+
+    if (ReadRegSZ(REG_KEY_RELAY_TUNE, REG_SETTING_FAN_OUT, saved, ""))
+    {
+        const size_t comma = saved.find(',');
+
+        if (comma != string::npos && saved.substr(comma + 1) == signature)
+            width = atoi(saved.c_str());
+    }
+
+    if (width < 1 && Relays_Tune(context, channels, false, width) != ERROR_CODES::NONE)
+    {
+        width = all;
+        WriteRegSZ(REG_KEY_RELAY_TUNE, REG_SETTING_FAN_OUT, to_string(width) + "," + signature);
+    }
+
+    return min(width, all);
+}
+
+
+/*******************************************************************************
+* Function   : Relays_Tune
+* Arguments  : context   = open modules
+*              channels  = structure of enumerated channels
+*              verbose   = print the measurements
+*              width     = receives the chosen width
+* Returns    : ERROR_CODES::NONE for success, otherwise failure
+* Description:
+*   Times a query of every module at widths 1, 2, 4, ... (and every module at
+*   once), keeps the smallest width within TUNE_TOLERANCE of the fastest, and
+*   saves it with the topology signature
+*/
+ERROR_CODES Relays_Tune(Relay_Context& context, const MODULE_CHANNELS& channels, bool verbose, int& width)
+{
+    ERROR_CODES error = ERROR_CODES::NONE;
+    const int all = int(channels.size());
+    vector<pair<int, double>> times;
+
+    if (all < 1)
+        return ERROR_CODES::NO_DEVICES;
+
+    Fan_Out_Time_ms(context, channels, all, error);    // open every module first
+
+    for (int w = 1; error == ERROR_CODES::NONE; w = (w * 2 < all) ? w * 2 : all)
+    {
+        const double ms = Fan_Out_Time_ms(context, channels, w, error);
+
+        times.emplace_back(w, ms);
+        if (w == all)
+            break;
+    }
+
+    if (error != ERROR_CODES::NONE)
+        return error;
+
+    double best = times[0].second;
+    for (auto const& [w, ms] : times)
+        best = min(best, ms);
+
+    width = all;
+    for (auto const& [w, ms] : times)
+    {
+        if (ms <= best * (1.0 + TUNE_TOLERANCE))
+        {
+            width = w;
+            break;
+        }
+    }
+
+    if (verbose)
+    {
+        std::cout << "width  fan-out ms  per module us\n";
+        for (auto const& [w, ms] : times)
+            std::cout << setw(5) << w << fixed << setprecision(2) << setw(12) << ms
+                      << setprecision(0) << setw(15) << ms * 1000.0 / all << (w == width ? "  *" : "") << "\n";
+        std::cout << "Fan-out width " << width << " of " << all << " saved for this host\n";
+    }
+
+    WriteRegSZ(REG_KEY_RELAY_TUNE, REG_SETTING_FAN_OUT, to_string(width) + "," + Topology_Signature(context));
+
+    return ERROR_CODES::NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Topology_Signature
+* Arguments  : context  = open modules
+* Returns    : hash of every module's sernum and device path (hex)
+* Description:
+*   Identifies the set of modules and the ports they are plugged into
+*/
+static string Topology_Signature(Relay_Context& context)
+{
+    vector<string> entries;
+
+    for (auto const& [sn, device_path] : context.Topology())
+        entries.push_back(sn + "=" + device_path);
+
+    sort(entries.begin(), entries.end());
+
+    uint64_t hash = 0xcbf29ce484222325ull;      // FNV-1a
+    for (auto const& e : entries)
+    {
+        for (unsigned char c : e + "\n")
+            hash = (hash ^ c) * 0x100000001b3ull;
+    }
+
+    ostringstream out;
+    out << hex << setw(16) << setfill('0') << hash;
+
+    return out.str();
+}
+
+
+/*******************************************************************************
+* Function   : Fan_Out_Time_ms
+* Arguments  : context   = open modules
+*              channels  = structure of enumerated channels
+*              width     = most modules queried at once
+*              error     = receives the first error
+* Returns    : median time in ms to query every module, over TUNE_ROUNDS
+* Description:
+*   Times a fan-out of queries over every module at the given width
+*/
+static double Fan_Out_Time_ms(Relay_Context& context, const MODULE_CHANNELS& channels, int width, ERROR_CODES& error)
+{
+    vector<double> rounds;
+    vector<ERROR_CODES> results(channels.size(), ERROR_CODES::NONE);
+
+    for (int r = 0; r < TUNE_ROUNDS; ++r)
+    {
+        const auto start = chrono::steady_clock::now();
+
+        Fan_Out(channels.size(), width, [&context, &channels, &results](size_t i) {
+            unsigned state = 0;
+            results[i] = context.Query(channels[i].sn, state);
+        });
+
+        rounds.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+        for (ERROR_CODES e : results)
+        {
+            if (e != ERROR_CODES::NONE)
+                error = e;
+        }
+    }
+
+    sort(rounds.begin(), rounds.end());
+
+    return rounds[rounds.size() / 2];
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,38 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayTune.h
+* Description:
+*   Fan-out of one operation over many modules, with the number of modules
+*   handled at once tuned to the host's USB topology
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include "Relay.h"
+
+class Relay_Context;
+
+// calls fn(0) .. fn(count - 1) with at most width of them running at once
+// (the calling thread is one of the workers); returns when all are done
+void Fan_Out(size_t count, int width, const std::function<void(size_t)>& fn);
+
+// the fan-out width saved for this host, tuned again first if the modules
+// or the ports they are plugged into have changed since it was saved
+int Fan_Out_Width(Relay_Context& context, const MODULE_CHANNELS& channels);
+
+// measures fan-out time at increasing widths, saves the best width
+// (printing the measurements if verbose)
+ERROR_CODES Relays_Tune(Relay_Context& context, const MODULE_CHANNELS& channels, bool verbose, int& width);
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
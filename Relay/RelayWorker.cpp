@@ -0,0 +1,247 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayWorker.cpp
+* Description:
+*   Driver calls for one relay module with deadlines derived from the observed
+*   latency of that module, and bounded retries
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "RelayWorker.h"
+using namespace std;
+using namespace std::chrono;
+
+// one queued driver call
+struct job_t
+{
+    DEVICE_OP op;
+    function<int()> fn;
+    bool started = false;
+    bool cancelled = false;     // caller gave up before the call started
+    bool done = false;
+    int rc = 0;
+};
+
+struct Device_Worker::state_t
+{
+    mutex lock;
+    condition_variable wake;    // worker: new job or stop
+    condition_variable done;    // callers: a job finished
+    deque<shared_ptr<job_t>> jobs;
+    latency_t latency[2];
+    bool stuck = false;         // a call missed its deadline and has not returned
+    bool stop = false;
+    thread worker;
+};
+
+/*******************************************************************************
+* Function   : latency_t::Add
+* Arguments  : sample_us  = measured latency of one call
+* Returns    : none
+* Description:
+*   Updates the smoothed latency (gain 1/8) and mean deviation (gain 1/4)
+*/
+void latency_t::Add(double sample_us)
+{
+    if (samples++ == 0)
+    {
+        mean_us = sample_us;
+        dev_us = sample_us / 2;
+    }
+    else
+    {
+        dev_us += (fabs(sample_us - mean_us) - dev_us) / 4;
+        mean_us += (sample_us - mean_us) / 8;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : latency_t::Timeout
+* Arguments  : op  = kind of call
+* Returns    : deadline for the next call of this kind
+* Description:
+*   Smoothed latency plus four mean deviations, within fixed limits
+*/
+microseconds latency_t::Timeout(DEVICE_OP op) const
+{
+    const int k = int(op);
+
+    if (samples == 0)
+        return microseconds(RELAY_TIMEOUT_INITIAL_US[k]);
+
+    int64_t t = int64_t(mean_us + 4 * dev_us);
+    return microseconds(clamp(t, RELAY_TIMEOUT_MIN_US[k], RELAY_TIMEOUT_MAX_US));
+}
+
+
+/*******************************************************************************
+* Function   : Device_Worker::Device_Worker
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Starts the thread that makes the driver calls
+*/
+Device_Worker::Device_Worker() : state(make_shared<state_t>())
+{
+    state->worker = thread(Worker_Thread, state);
+}
+
+
+/*******************************************************************************
+* Function   : Device_Worker::~Device_Worker
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Stops the thread. A thread stuck in the driver is left to finish on its own.
+*/
+Device_Worker::~Device_Worker()
+{
+    bool stuck;
+    {
+        lock_guard<mutex> guard(state->lock);
+        state->stop = true;
+        stuck = state->stuck;
+    }
+    state->wake.notify_all();
+
+    if (stuck)
+        state->worker.detach();
+    else
+        state->worker.join();
+}
+
+
+/*******************************************************************************
+* Function   : Device_Worker::Call
+* Arguments  : op       = kind of call (selects the latency statistics)
+*              fn       = driver call, returns 0 on success
+*              retries  = number of retries after a driver error
+* Returns    : ERROR_CODES::NONE, DEVICE_IO or TIMEOUT
+* Description:
+*   Runs fn on the worker thread and waits for it until the deadline. Driver
+*   errors are retried while the deadline allows. Calls on an isolated module
+*   fail immediately.
+*/
+ERROR_CODES Device_Worker::Call(DEVICE_OP op, function<int()> fn, int retries)
+{
+    unique_lock<mutex> guard(state->lock);
+
+    if (state->stuck)
+        return ERROR_CODES::TIMEOUT;
+
+    const auto deadline = steady_clock::now() + state->latency[int(op)].Timeout(op);
+
+    for (int attempt = 0; attempt <= retries; ++attempt)
+    {
+        auto job = make_shared<job_t>();
+        job->op = op;
+        job->fn = fn;
+        state->jobs.push_back(job);
+        state->wake.notify_one();
+
+        if (!state->done.wait_until(guard, deadline, [&] { return job->done; }))
+        {
+            if (job->started)
+                state->stuck = true;    // isolated until the call returns
+            else
+                job->cancelled = true;
+            return ERROR_CODES::TIMEOUT;
+        }
+
+        if (job->rc == 0)
+            return ERROR_CODES::NONE;
+
+        if (steady_clock::now() >= deadline)
+            break;
+    }
+
+    return ERROR_CODES::DEVICE_IO;
+}
+
+
+/*******************************************************************************
+* Function   : Device_Worker::Is_Stuck
+* Arguments  : none
+* Returns    : true if a call missed its deadline and has not returned yet
+* Description:
+*   Reports whether the module is isolated
+*/
+bool Device_Worker::Is_Stuck() const
+{
+    lock_guard<mutex> guard(state->lock);
+    return state->stuck;
+}
+
+
+/*******************************************************************************
+* Function   : Device_Worker::Latency
+* Arguments  : op  = kind of call
+* Returns    : copy of the latency statistics
+* Description:
+*   Reports the observed latency of the module
+*/
+latency_t Device_Worker::Latency(DEVICE_OP op) const
+{
+    lock_guard<mutex> guard(state->lock);
+    return state->latency[int(op)];
+}
+
+
+/*******************************************************************************
+* Function   : Device_Worker::Worker_Thread
+* Arguments  : state  = state shared with the Device_Worker
+* Returns    : none
+* Description:
+*   Makes the queued driver calls one at a time and measures their latency.
+*   Calls whose caller already gave up are dropped rather than made late.
+*/
+void Device_Worker::Worker_Thread(shared_ptr<state_t> state)
+{
+    unique_lock<mutex> guard(state->lock);
+
+    for (;;)
+    {
+        state->wake.wait(guard, [&] { return state->stop || !state->jobs.empty(); });
+
+        if (state->stop)
+            break;
+
+        auto job = state->jobs.front();
+        state->jobs.pop_front();
+
+        if (job->cancelled)
+            continue;
+
+        job->started = true;
+        guard.unlock();
+
+        const auto start = steady_clock::now();
+        const int rc = job->fn();
+        const double elapsed_us = double(duration_cast<microseconds>(steady_clock::now() - start).count());
+
+        guard.lock();
+        state->latency[int(job->op)].Add(elapsed_us);
+        state->stuck = false;
+        job->rc = rc;
+        job->done = true;
+        state->done.notify_all();
+    }
+}
+
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,75 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : RelayWorker.h
+* Description:
+*   Driver calls for one relay module with deadlines derived from the observed
+*   latency of that module, and bounded retries
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include "Relay.h"
+
+// kinds of driver call (they have very different latencies)
+enum class DEVICE_OP : int { OPEN = 0, IO = 1 };
+
+// driver errors are retried this many times, within the same deadline
+constexpr int RELAY_RETRIES = 2;
+
+// deadline limits in microseconds: { OPEN, IO }
+constexpr int64_t RELAY_TIMEOUT_INITIAL_US[] = { 2000000, 1000000 };   // before any samples
+constexpr int64_t RELAY_TIMEOUT_MIN_US[] = { 200000, 50000 };
+constexpr int64_t RELAY_TIMEOUT_MAX_US = 10000000;
+
+// running latency statistics for one kind of call on one module
+struct latency_t
+{
+    double mean_us = 0;         // smoothed latency
+    double dev_us = 0;          // smoothed mean deviation
+    uint64_t samples = 0;
+
+    void Add(double sample_us);
+    std::chrono::microseconds Timeout(DEVICE_OP op) const;
+};
+
+// Runs the driver calls for one module on a thread of its own, so callers can
+// stop waiting at a deadline (the driver calls themselves cannot time out).
+// The deadline is the smoothed latency plus four deviations, as for TCP
+// retransmission. A call that misses its deadline leaves the module isolated:
+// further calls fail immediately until the late call returns, so a wedged
+// module costs other callers nothing.
+class Device_Worker
+{
+public:
+    Device_Worker();
+    ~Device_Worker();
+    Device_Worker(const Device_Worker&) = delete;
+    Device_Worker& operator=(const Device_Worker&) = delete;
+
+    // fn returns 0 on success (driver convention)
+    // returns NONE, DEVICE_IO (still failing after retries), or TIMEOUT
+    ERROR_CODES Call(DEVICE_OP op, std::function<int()> fn, int retries = RELAY_RETRIES);
+
+    bool Is_Stuck() const;
+    latency_t Latency(DEVICE_OP op) const;
+
+private:
+    struct state_t;
+    static void Worker_Thread(std::shared_ptr<state_t> state);
+
+    std::shared_ptr<state_t> state;     // shared with the thread, which may outlive us
+};
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,232 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : relay_bench.cpp
+* Description:
+*   Contention benchmark for Relay_Context. Each thread toggles one channel
+*   as fast as it can, in three arrangements:
+*
+*     spread   = thread i uses module i % modules (contends only when threads > modules)
+*     shared   = every thread uses the first module
+*     global   = like spread, but every call also takes one process-wide mutex
+*                (the cost of serializing everything, for comparison)
+*
+*   and reports calls per second and the latency of a call (mean, p50, p99).
+*
+*     relay_bench {threads} {calls per thread}
+*
+*   Build against the simulated modules (no hardware needed):
+*     g++ -std=c++20 -O2 -pthread -I../Relay relay_bench.cpp ../Relay/RelayContext.cpp ../Relay/RelayWorker.cpp ../Relay/RelayLock.cpp ../Relay/RelayState.cpp ../Relay/RelayInventory.cpp ../sim/usb_relay_device.cpp -o relay_bench
+*     RELAY_SIM_US=500 ./relay_bench 4 200
+*
+*   or link the hidraw library (or the vendor library on Windows) instead of
+*   ../sim/usb_relay_device.cpp to measure real modules. Every channel used is
+*   left as it was found (each thread makes an even number of calls). Unless
+*   RELAY_STATE_FILE and RELAY_INVENTORY_FILE are set, the state and inventory
+*   files are kept in the temporary directory.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "RelayContext.h"
+
+constexpr int DEFAULT_THREADS = 4;
+constexpr int DEFAULT_CALLS = 200;
+
+enum class MODE { SPREAD, SHARED, GLOBAL };
+
+// results of one run
+struct result_t
+{
+    double calls_per_s = 0.0;
+    double mean_us = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    int errors = 0;
+};
+
+// support function declarations
+static result_t Run(Relay_Context& context, const MODULE_CHANNELS& modules, MODE mode, int threads, int calls);
+static void Print(const char* name, const result_t& r);
+static void Temp_File(const char* variable, const char* name);
+
+
+/*******************************************************************************
+* Function   : main
+* Arguments  : argc, argv = threads, calls per thread (both optional)
+* Returns    : 0 = success, otherwise an ERROR_CODES value
+* Description:
+*   Runs the benchmark in each arrangement
+*/
+int main(int argc, char* argv[])
+{
+    const int threads = max(1, (argc > 1) ? atoi(argv[1]) : DEFAULT_THREADS);
+    const int calls = max(2, (argc > 2) ? atoi(argv[2]) : DEFAULT_CALLS) & ~1;
+
+    Temp_File("RELAY_STATE_FILE", "relay_bench.state");
+    Temp_File("RELAY_INVENTORY_FILE", "relay_bench.inventory");
+
+    Relay_Context context;
+    MODULE_CHANNELS modules;
+
+    if (!context.Is_Initialized())
+    {
+        fprintf(stderr, "Unable to initialize driver\n");
+        return int(ERROR_CODES::NO_DRIVER_INIT);
+    }
+
+    if (context.Enumerate(modules) != ERROR_CODES::NONE)
+    {
+        fprintf(stderr, "No devices\n");
+        return int(ERROR_CODES::NO_DEVICES);
+    }
+
+    printf("%d thread(s), %d call(s) each, %zu module(s)\n", threads, calls, modules.size());
+    printf("%-8s %12s %10s %10s %10s %7s\n", "", "calls/s", "mean us", "p50 us", "p99 us", "errors");
+
+    Run(context, modules, MODE::SPREAD, threads, 2);    // open the modules first
+    Print("spread", Run(context, modules, MODE::SPREAD, threads, calls));
+    Print("shared", Run(context, modules, MODE::SHARED, threads, calls));
+    Print("global", Run(context, modules, MODE::GLOBAL, threads, calls));
+
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : Run
+* Arguments  : context  = shared context
+*              modules  = modules on the bus
+*              mode     = which modules the threads use
+*              threads  = number of threads
+*              calls    = number of calls per thread
+* Returns    : results
+* Description:
+*   Starts the threads together and times every call. Threads sharing a
+*   module toggle different channels where there are enough of them.
+*/
+static result_t Run(Relay_Context& context, const MODULE_CHANNELS& modules, MODE mode, int threads, int calls)
+{
+    using clock = chrono::steady_clock;
+
+    mutex global_lock;
+    vector<vector<double>> latency(threads);
+    vector<int> errors(threads, 0);
+    vector<thread> workers;
+
+    const auto start = clock::now();
+
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t] {
+            const channels_t& module = modules[(mode == MODE::SHARED) ? 0 : t % modules.size()];
+            const int user = (mode == MODE::SHARED) ? t : int(t / modules.size());
+            rmw_t op{ module.sn, 0, 0, 1u << (user % module.channels), 0, 0 };
+
+            latency[t].reserve(calls);
+
+            for (int i = 0; i < calls; ++i)
+            {
+                const auto t0 = clock::now();
+                ERROR_CODES error;
+
+                if (mode == MODE::GLOBAL)
+                {
+                    lock_guard<mutex> lock(global_lock);
+                    error = context.Apply(op);
+                }
+                else
+                {
+                    error = context.Apply(op);
+                }
+
+                latency[t].push_back(chrono::duration<double, micro>(clock::now() - t0).count());
+                if (error != ERROR_CODES::NONE)
+                    ++errors[t];
+            }
+        });
+    }
+
+    for (auto& w : workers)
+        w.join();
+
+    const double elapsed_s = chrono::duration<double>(clock::now() - start).count();
+
+    vector<double> all;
+    result_t r;
+
+    for (int t = 0; t < threads; ++t)
+    {
+        all.insert(all.end(), latency[t].begin(), latency[t].end());
+        r.errors += errors[t];
+    }
+
+    sort(all.begin(), all.end());
+
+    for (double us : all)
+        r.mean_us += us;
+
+    r.mean_us /= all.size();
+    r.p50_us = all[all.size() / 2];
+    r.p99_us = all[min(all.size() - 1, all.size() * 99 / 100)];
+    r.calls_per_s = all.size() / elapsed_s;
+
+    return r;
+}
+
+
+/*******************************************************************************
+* Function   : Print
+* Arguments  : name  = arrangement
+*              r     = results
+* Returns    : none
+* Description:
+*   Prints one line of the results table
+*/
+static void Print(const char* name, const result_t& r)
+{
+    printf("%-8s %12.0f %10.1f %10.1f %10.1f %7d\n", name, r.calls_per_s, r.mean_us, r.p50_us, r.p99_us, r.errors);
+}
+
+
+/*******************************************************************************
+* Function   : Temp_File
+* Arguments  : variable  = environment variable naming the file
+*              name      = file name to use in the temporary directory
+* Returns    : none
+* Description:
+*   Points the variable at a file in the temporary directory unless it is
+*   already set, so a run neither reads nor overwrites the real file
+*/
+static void Temp_File(const char* variable, const char* name)
+{
+    if (getenv(variable))
+        return;
+
+#ifdef _WIN32
+    const char* dir = getenv("TEMP");
+    const string path = string(dir ? dir : ".") + "\\" + name;
+
+    _putenv_s(variable, path.c_str());
+#else
+    setenv(variable, (string("/tmp/") + name).c_str(), 1);
+#endif
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
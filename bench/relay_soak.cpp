@@ -0,0 +1,459 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : relay_soak.cpp
+* Description:
+*   Endurance test for Relay_Context against the simulated modules. Client
+*   threads make random SET, QUERY, PULSE and enumeration calls on random
+*   modules for the given time. Every interval it prints throughput, latency
+*   (p50, p99, p99.9, max), resident memory, open handles/FDs and the lists
+*   and handles the simulator has outstanding; at the end it compares the
+*   last interval with the first and flags leaks and degradation.
+*
+*     relay_soak {seconds} {threads} {modules} {interval seconds}
+*
+*   Exits with 0 if clean, 1 if a leak or degradation was flagged. Unless
+*   RELAY_SIM is set, the modules are SK000:8, SK001:8, ... Unless
+*   RELAY_STATE_FILE and RELAY_INVENTORY_FILE are set, the state and inventory
+*   files are kept in the temporary directory.
+*
+*   Build:
+*     g++ -std=c++20 -O2 -pthread -I../Relay relay_soak.cpp ../Relay/RelayContext.cpp ../Relay/RelayWorker.cpp ../Relay/RelayLock.cpp ../Relay/RelayState.cpp ../Relay/RelayInventory.cpp ../sim/usb_relay_device.cpp -o relay_soak
+*     RELAY_SIM_US=200 ./relay_soak 3600 16 32 60
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "RelayContext.h"
+
+constexpr int DEFAULT_SECONDS = 60;
+constexpr int DEFAULT_THREADS = 16;
+constexpr int DEFAULT_MODULES = 32;
+constexpr int DEFAULT_INTERVAL = 5;
+constexpr int PULSE_MAX_MS = 3;
+
+// limits for flagging the last interval against the first
+constexpr int64_t RSS_DRIFT_MIN_KB = 1024;          // and more than RSS_DRIFT_PERCENT
+constexpr int64_t RSS_DRIFT_PERCENT = 5;
+constexpr int64_t FD_DRIFT_MAX = 4;
+constexpr double THROUGHPUT_DROP_MAX = 0.8;         // last / first
+constexpr double P99_GROWTH_MAX = 2.0;              // last / first
+
+// latencies recorded by one client thread during the current interval
+struct client_t
+{
+    mutex lock;
+    vector<float> latency_us;
+    uint64_t errors = 0;
+};
+
+// one line of the report
+struct interval_t
+{
+    double t_s = 0.0;
+    double calls_per_s = 0.0;
+    double p50_us = 0.0, p99_us = 0.0, p999_us = 0.0, max_us = 0.0;
+    int64_t rss_kb = 0;
+    int64_t fds = 0;
+    int lists = 0, handles = 0;
+    uint64_t errors = 0;
+};
+
+// simulator only: resources callers still hold (sim/usb_relay_device.cpp)
+extern "C" void usb_relay_sim_outstanding(int* lists, int* handles);
+
+// support function declarations
+static void Client(Relay_Context& context, const MODULE_CHANNELS& modules, client_t& client, unsigned seed, const atomic<bool>& stop);
+static interval_t Collect(vector<client_t>& clients, double t_s, double interval_s);
+static int64_t Resident_KB();
+static int64_t Open_Handles();
+static void Print(const interval_t& r);
+static bool Check(const interval_t& first, const interval_t& last, int num_modules, int threads);
+static void Temp_File(const char* variable, const char* name);
+
+
+/*******************************************************************************
+* Function   : main
+* Arguments  : argc, argv = seconds, threads, modules, interval (all optional)
+* Returns    : 0 = clean, 1 = leak or degradation, otherwise an ERROR_CODES value
+* Description:
+*   Runs the soak test
+*/
+int main(int argc, char* argv[])
+{
+    const int seconds = max(1, (argc > 1) ? atoi(argv[1]) : DEFAULT_SECONDS);
+    const int threads = max(1, (argc > 2) ? atoi(argv[2]) : DEFAULT_THREADS);
+    const int num_modules = clamp((argc > 3) ? atoi(argv[3]) : DEFAULT_MODULES, 1, 1000);
+    const int interval = max(1, (argc > 4) ? atoi(argv[4]) : DEFAULT_INTERVAL);
+
+    if (!getenv("RELAY_SIM"))
+    {   // SK000:8,SK001:8,...
+        string list = "";
+        char sn[8];
+
+        for (int i = 0; i < num_modules; ++i)
+        {
+            snprintf(sn, sizeof(sn), "SK%03d", i);
+            list += (i ? "," : "") + string(sn) + ":8";
+        }
+#ifdef _WIN32
+        _putenv_s("RELAY_SIM", list.c_str());
+#else
+        setenv("RELAY_SIM", list.c_str(), 1);
+#endif
+    }
+
+    Temp_File("RELAY_STATE_FILE", "relay_soak.state");
+    Temp_File("RELAY_INVENTORY_FILE", "relay_soak.inventory");
+
+    vector<interval_t> report;
+    bool clean = true;
+    {
+        Relay_Context context;
+        MODULE_CHANNELS modules;
+
+        if (!context.Is_Initialized() || context.Enumerate(modules) != ERROR_CODES::NONE)
+        {
+            fprintf(stderr, "No devices\n");
+            return int(ERROR_CODES::NO_DEVICES);
+        }
+
+        printf("%d s, %d thread(s), %zu module(s), every %d s\n", seconds, threads, modules.size(), interval);
+        printf("%8s %10s %9s %9s %9s %9s %9s %6s %6s %8s %7s\n",
+            "time s", "calls/s", "p50 us", "p99 us", "p99.9 us", "max us", "RSS KB", "FDs", "lists", "handles", "errors");
+
+        vector<client_t> clients(threads);
+        vector<thread> workers;
+        atomic<bool> stop{ false };
+        const auto start = chrono::steady_clock::now();
+        auto last = start;
+
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back(Client, ref(context), cref(modules), ref(clients[t]), unsigned(t + 1), cref(stop));
+
+        for (auto next = start + chrono::seconds(interval); next <= start + chrono::seconds(seconds); next += chrono::seconds(interval))
+        {
+            this_thread::sleep_until(next);
+
+            const auto now = chrono::steady_clock::now();
+            report.push_back(Collect(clients, chrono::duration<double>(now - start).count(), chrono::duration<double>(now - last).count()));
+            Print(report.back());
+            fflush(stdout);
+            last = now;
+        }
+
+        stop = true;
+        for (auto& w : workers)
+            w.join();
+
+        if (report.size() >= 2)
+            clean = Check(report[report.size() > 2 ? 1 : 0], report.back(), int(modules.size()), threads);
+    }
+
+    int lists = 0, handles = 0;
+    usb_relay_sim_outstanding(&lists, &handles);
+
+    if (lists != 0 || handles != 0)
+    {
+        printf("LEAK: %d enumeration list(s) and %d handle(s) not released after the context closed\n", lists, handles);
+        clean = false;
+    }
+
+    printf(clean ? "PASS\n" : "FAIL\n");
+
+    return clean ? 0 : 1;
+}
+
+
+/*******************************************************************************
+* Function   : Client
+* Arguments  : context  = shared context
+*              modules  = modules on the bus
+*              client   = receives the latency of every call
+*              seed     = random seed for this thread
+*              stop     = set when the test is over
+* Returns    : none
+* Description:
+*   One client thread: 50% SET, 35% QUERY, 10% PULSE, 5% enumeration
+*/
+static void Client(Relay_Context& context, const MODULE_CHANNELS& modules, client_t& client, unsigned seed, const atomic<bool>& stop)
+{
+    mt19937 rng(seed);
+    uniform_int_distribution<size_t> pick_module(0, modules.size() - 1);
+    uniform_int_distribution<int> pick_op(0, 99);
+    uniform_int_distribution<unsigned> pick_mask(0, 0xFF);
+    uniform_int_distribution<int> pick_ms(1, PULSE_MAX_MS);
+
+    while (!stop)
+    {
+        const channels_t& module = modules[pick_module(rng)];
+        const unsigned all = (1u << module.channels) - 1;
+        const int op = pick_op(rng);
+        const auto t0 = chrono::steady_clock::now();
+        ERROR_CODES error;
+
+        if (op < 50)
+        {   // SET
+            const unsigned on = pick_mask(rng) & all;
+            const unsigned off = ~on & pick_mask(rng) & all;
+
+            error = context.Apply(rmw_t{ module.sn, on, off, 0, 0, 0 });
+        }
+        else if (op < 85)
+        {   // QUERY
+            unsigned state = 0;
+
+            error = context.Query(module.sn, state);
+        }
+        else if (op < 95)
+        {   // PULSE one channel, then put it back
+            const unsigned bit = 1u << (pick_mask(rng) % module.channels);
+            unsigned before = 0;
+
+            error = context.Apply(rmw_t{ module.sn, bit, 0, 0, 0, 0 }, nullptr, &before);
+            if (error == ERROR_CODES::NONE)
+            {
+                this_thread::sleep_for(chrono::milliseconds(pick_ms(rng)));
+                error = context.Apply(rmw_t{ module.sn, before & bit, ~before & bit, 0, 0, 0 });
+            }
+        }
+        else
+        {   // enumeration
+            MODULE_CHANNELS found;
+
+            error = context.Enumerate(found);
+        }
+
+        const float us = chrono::duration<float, micro>(chrono::steady_clock::now() - t0).count();
+
+        lock_guard<mutex> lock(client.lock);
+        client.latency_us.push_back(us);
+        if (error != ERROR_CODES::NONE)
+            ++client.errors;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Collect
+* Arguments  : clients     = client threads
+*              t_s         = time since the start
+*              interval_s  = length of this interval
+* Returns    : results for the interval
+* Description:
+*   Takes the latencies recorded since the last interval and samples memory,
+*   handles and the simulator's outstanding resources
+*/
+static interval_t Collect(vector<client_t>& clients, double t_s, double interval_s)
+{
+    vector<float> all;
+    interval_t r;
+
+    for (auto& c : clients)
+    {
+        vector<float> latency;
+        {
+            lock_guard<mutex> lock(c.lock);
+            latency.swap(c.latency_us);
+            r.errors += c.errors;
+            c.errors = 0;
+        }
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+
+    r.t_s = t_s;
+    r.calls_per_s = all.size() / interval_s;
+
+    if (!all.empty())
+    {
+        sort(all.begin(), all.end());
+        r.p50_us = all[all.size() / 2];
+        r.p99_us = all[all.size() * 99 / 100];
+        r.p999_us = all[all.size() * 999 / 1000];
+        r.max_us = all.back();
+    }
+
+    r.rss_kb = Resident_KB();
+    r.fds = Open_Handles();
+    usb_relay_sim_outstanding(&r.lists, &r.handles);
+
+    return r;
+}
+
+
+/*******************************************************************************
+* Function   : Resident_KB
+* Arguments  : none
+* Returns    : resident memory of the process in KB, or -1 if unknown
+* Description:
+*   Reads the resident set (working set on Windows)
+*/
+static int64_t Resident_KB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return -1;
+
+    return int64_t(pmc.WorkingSetSize / 1024);
+#else
+    long pages_total = 0, pages_resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+
+    if (!f)
+        return -1;
+
+    if (fscanf(f, "%ld %ld", &pages_total, &pages_resident) != 2)
+        pages_resident = -1;
+    fclose(f);
+
+    return (pages_resident < 0) ? -1 : int64_t(pages_resident) * sysconf(_SC_PAGESIZE) / 1024;
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Open_Handles
+* Arguments  : none
+* Returns    : open handles (Windows) or file descriptors, or -1 if unknown
+* Description:
+*   Counts the process's open handles or file descriptors
+*/
+static int64_t Open_Handles()
+{
+#ifdef _WIN32
+    DWORD count = 0;
+
+    return GetProcessHandleCount(GetCurrentProcess(), &count) ? int64_t(count) : -1;
+#else
+    DIR* dir = opendir("/proc/self/fd");
+    int64_t count = 0;
+
+    if (!dir)
+        return -1;
+
+    while (readdir(dir))
+        ++count;
+    closedir(dir);
+
+    return count - 3;   // ".", ".." and dir itself
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Print
+* Arguments  : r  = results for one interval
+* Returns    : none
+* Description:
+*   Prints one line of the report
+*/
+static void Print(const interval_t& r)
+{
+    printf("%8.0f %10.0f %9.0f %9.0f %9.0f %9.0f %9lld %6lld %6d %8d %7llu\n",
+        r.t_s, r.calls_per_s, r.p50_us, r.p99_us, r.p999_us, r.max_us,
+        (long long)r.rss_kb, (long long)r.fds, r.lists, r.handles, (unsigned long long)r.errors);
+}
+
+
+/*******************************************************************************
+* Function   : Check
+* Arguments  : first        = first interval after warm-up
+*              last         = last interval
+*              num_modules  = number of modules (the context holds one handle each)
+*              threads      = client threads (each may hold a lock file open)
+* Returns    : true = clean, false = something was flagged
+* Description:
+*   Compares the end of the run with the start, printing what is flagged
+*/
+static bool Check(const interval_t& first, const interval_t& last, int num_modules, int threads)
+{
+    bool clean = true;
+    const int64_t rss_drift = last.rss_kb - first.rss_kb;
+
+    if (rss_drift > RSS_DRIFT_MIN_KB && rss_drift * 100 > first.rss_kb * RSS_DRIFT_PERCENT)
+    {
+        printf("LEAK: resident memory grew %lld KB (%lld -> %lld)\n", (long long)rss_drift, (long long)first.rss_kb, (long long)last.rss_kb);
+        clean = false;
+    }
+
+    if (last.fds - first.fds > FD_DRIFT_MAX + threads)
+    {
+        printf("LEAK: open handles/FDs grew %lld -> %lld\n", (long long)first.fds, (long long)last.fds);
+        clean = false;
+    }
+
+    if (last.handles > num_modules)
+    {
+        printf("LEAK: %d handle(s) open for %d module(s)\n", last.handles, num_modules);
+        clean = false;
+    }
+
+    if (last.calls_per_s < first.calls_per_s * THROUGHPUT_DROP_MAX)
+    {
+        printf("DEGRADED: throughput fell %.0f -> %.0f calls/s\n", first.calls_per_s, last.calls_per_s);
+        clean = false;
+    }
+
+    if (last.p99_us > first.p99_us * P99_GROWTH_MAX)
+    {
+        printf("DEGRADED: p99 latency grew %.0f -> %.0f us\n", first.p99_us, last.p99_us);
+        clean = false;
+    }
+
+    return clean;
+}
+
+
+/*******************************************************************************
+* Function   : Temp_File
+* Arguments  : variable  = environment variable naming the file
+*              name      = file name to use in the temporary directory
+* Returns    : none
+* Description:
+*   Points the variable at a file in the temporary directory unless it is
+*   already set, so a run neither reads nor overwrites the real file
+*/
+static void Temp_File(const char* variable, const char* name)
+{
+    if (getenv(variable))
+        return;
+
+#ifdef _WIN32
+    const char* dir = getenv("TEMP");
+    const string path = string(dir ? dir : ".") + "\\" + name;
+
+    _putenv_s(variable, path.c_str());
+#else
+    setenv(variable, (string("/tmp/") + name).c_str(), 1);
+#endif
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,89 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : report_test.cpp
+* Description:
+*   Checks how the hidraw library asks for and decodes the modules' feature
+*   reports, against reports as HIDIOCGFEATURE returns them (no hardware
+*   needed). Prints each failure and returns the number of failures.
+*
+*   Build and run:
+*     g++ -std=c++20 -I../Relay report_test.cpp -o report_test && ./report_test
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+// the library's support functions are static
+#include "usb_relay_device.cpp"
+
+#include <cstdio>
+
+// support function declarations
+static int Check(bool ok, const char* what);
+
+
+/*******************************************************************************
+* Function   : main
+* Arguments  : none
+* Returns    : number of checks that failed
+* Description:
+*   Runs every check
+*/
+int main()
+{
+    // report 1 of a USBRelay4 "6QMBS" with channels 1 and 3 on
+    const unsigned char relay4[REPORT_LENGTH] = { '6', 'Q', 'M', 'B', 'S', 0x00, 0x00, 0x05, 0x00 };
+
+    // report 1 of a USBRelay2 with a short sernum and stray high state bits
+    const unsigned char relay2[REPORT_LENGTH] = { 'A', 'B', 'C', 0x00, 0x00, 0x00, 0x00, 0xFE, 0x00 };
+
+    // the report of the USBRelay4 asked for as report 0: one byte off
+    const unsigned char shifted[REPORT_LENGTH] = { 0x00, '6', 'Q', 'M', 'B', 'S', 0x00, 0x00, 0x05 };
+
+    int failures = 0;
+
+    failures += Check(Report_Sernum(relay4) == "6QMBS", "sernum of USBRelay4");
+    failures += Check(Report_State(relay4, 4) == 0x05, "state of USBRelay4");
+    failures += Check(Report_Sernum(relay2) == "ABC", "short sernum");
+    failures += Check(Report_State(relay2, 2) == 0x02, "state bits beyond the channels");
+    failures += Check(Report_Sernum(shifted) != "6QMBS", "report 0 layout is not decoded as report 1");
+
+    // the report number is set before the ioctl (which fails on a non-hidraw fd)
+    unsigned char report[REPORT_LENGTH];
+    const int fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+    failures += Check(fd >= 0 && !Read_Report(fd, report) && report[0] == REPORT_ID_READ, "Read_Report asks for report 1");
+
+    if (fd >= 0)
+        close(fd);
+
+    if (failures == 0)
+        printf("All checks passed\n");
+
+    return failures;
+}
+
+
+/*******************************************************************************
+* Function   : Check
+* Arguments  : ok    = result of the check
+*              what  = description of the check
+* Returns    : 0 if ok, 1 if not
+* Description:
+*   Prints a check that failed
+*/
+static int Check(bool ok, const char* what)
+{
+    if (!ok)
+        printf("FAILED: %s\n", what);
+
+    return ok ? 0 : 1;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
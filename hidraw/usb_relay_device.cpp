@@ -0,0 +1,675 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : usb_relay_device.cpp
+* Description:
+*   Linux (hidraw) implementation of the usb_relay_device library interface
+*   (usb_relay_device.h) for the USB-HID relay modules (16C0:05DF "USBRelayN").
+*   A table of sernum -> /dev/hidrawN is kept up to date from inotify events
+*   on /dev, so opening a module by its serial number does not scan the bus.
+*
+*   Build (no dependencies other than the kernel headers):
+*     g++ -std=c++20 -O2 -shared -fPIC -I../Relay usb_relay_device.cpp -o libusb_relay_device.so
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/hidraw.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+using namespace std;
+
+#include "usb_relay_device.h"
+
+// USB IDs and product name prefix of the relay modules
+constexpr char HID_ID_RELAY[] = "0003:000016C0:000005DF";
+constexpr char HID_NAME_RELAY[] = "USBRelay";
+
+// feature report: 8 bytes after the report number
+//   read:  asked for as report 1; returned without the report number, so
+//          sernum (bytes 0-4, NUL-padded) ... state (byte 7)
+//   write: report 0, command, channel
+constexpr int REPORT_LENGTH = 9;
+constexpr unsigned char REPORT_ID_READ = 1;
+constexpr int REPORT_SERNUM_LENGTH = 5;
+constexpr int REPORT_STATE = 7;
+constexpr unsigned char CMD_ON_ALL = 0xFE;
+constexpr unsigned char CMD_OFF_ALL = 0xFC;
+constexpr unsigned char CMD_ON_ONE = 0xFF;
+constexpr unsigned char CMD_OFF_ONE = 0xFD;
+
+constexpr char DEV_DIR[] = "/dev";
+constexpr char SYS_HIDRAW_DIR[] = "/sys/class/hidraw";
+
+// one relay module found on the bus
+struct module_t
+{
+    string path = "";           // /dev/hidrawN
+    int channels = 0;
+};
+
+// an open module (the handle returned to the caller)
+struct handle_t
+{
+    int fd = -1;
+    int channels = 0;
+};
+
+// library state
+static mutex lib_lock;                              // guards everything below
+static int lib_refs = 0;                            // usb_relay_init() calls not yet matched by usb_relay_exit()
+static int inotify_fd = -1;                         // hidraw nodes added/removed in /dev
+static bool table_stale = true;
+static unordered_map<string, module_t> table;       // sernum -> module
+
+// support function declarations
+static void Refresh_Table();
+static void Check_Hotplug();
+static int Hidraw_Channels(const string& node);
+static bool Read_Report(int fd, unsigned char* report);
+static string Report_Sernum(const unsigned char* report);
+static unsigned Report_State(const unsigned char* report, int channels);
+static int Write_Command(intptr_t hHandle, unsigned char cmd, int index);
+static intptr_t Open_Path(const string& path, int channels, const string& sernum);
+
+
+/*******************************************************************************
+* Function   : usb_relay_init
+* Arguments  : none
+* Returns    : 0 on success, -1 on error
+* Description:
+*   Starts watching /dev for hidraw nodes. Calls may be nested.
+*/
+int USBRL_API usb_relay_init(void)
+{
+    lock_guard<mutex> lock(lib_lock);
+
+    if (lib_refs++ == 0)
+    {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, DEV_DIR, IN_CREATE | IN_DELETE | IN_ATTRIB) < 0)
+        {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+
+        table_stale = true;
+    }
+
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_exit
+* Arguments  : none
+* Returns    : 0 on success, -1 on error
+* Description:
+*   Frees the table when the last usb_relay_init() is matched
+*/
+int USBRL_API usb_relay_exit(void)
+{
+    lock_guard<mutex> lock(lib_lock);
+
+    if (lib_refs == 0)
+        return -1;
+
+    if (--lib_refs == 0)
+    {
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        inotify_fd = -1;
+        table.clear();
+        table_stale = true;
+    }
+
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_enumerate
+* Arguments  : none
+* Returns    : list of modules (free with usb_relay_device_free_enumerate), or NULL
+* Description:
+*   Lists the relay modules, refreshing the table if anything was plugged in or
+*   removed since the last call
+*/
+pusb_relay_device_info_t USBRL_API usb_relay_device_enumerate(void)
+{
+    lock_guard<mutex> lock(lib_lock);
+    pusb_relay_device_info_t head = nullptr;
+
+    Check_Hotplug();
+
+    for (auto const& [sernum, module] : table)
+    {
+        auto info = (pusb_relay_device_info_t)calloc(1, sizeof(usb_relay_device_info));
+
+        if (!info)
+            break;
+
+        info->serial_number = strdup(sernum.c_str());
+        info->device_path = strdup(module.path.c_str());
+        info->type = module.channels;
+        info->next = head;
+        head = info;
+    }
+
+    return head;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_free_enumerate
+* Arguments  : info  = list returned by usb_relay_device_enumerate
+* Returns    : none
+* Description:
+*   Frees a list returned by usb_relay_device_enumerate
+*/
+void USBRL_API usb_relay_device_free_enumerate(struct usb_relay_device_info* info)
+{
+    while (info)
+    {
+        pusb_relay_device_info_t next = info->next;
+        free(info->serial_number);
+        free(info->device_path);
+        free(info);
+        info = next;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open_with_serial_number
+* Arguments  : serial_number  = sernum of the module
+*              len            = length of serial_number
+* Returns    : handle of the open module, or 0 on failure
+* Description:
+*   Opens a module by looking its sernum up in the table. The bus is only
+*   scanned after a hotplug event, or once if the sernum is not in the table
+*   or its node turns out to be another module's (nodes are renumbered when
+*   modules are replugged, and an event can be missed).
+*/
+intptr_t USBRL_API usb_relay_device_open_with_serial_number(const char* serial_number, unsigned len)
+{
+    if (!serial_number)
+        return 0;
+
+    const string sernum(serial_number, strnlen(serial_number, len));
+    module_t module;
+
+    {
+        lock_guard<mutex> lock(lib_lock);
+
+        Check_Hotplug();
+
+        auto it = table.find(sernum);
+
+        if (it == table.end())
+        {   // possibly missed an event (no inotify, permissions changed)
+            Refresh_Table();
+            it = table.find(sernum);
+        }
+
+        if (it == table.end())
+            return 0;
+
+        module = it->second;
+    }
+
+    intptr_t hHandle = Open_Path(module.path, module.channels, sernum);
+
+    if (!hHandle)
+    {
+        {
+            lock_guard<mutex> lock(lib_lock);
+
+            Refresh_Table();
+
+            auto it = table.find(sernum);
+
+            if (it == table.end())
+                return 0;
+
+            module = it->second;
+        }
+
+        hHandle = Open_Path(module.path, module.channels, sernum);
+    }
+
+    return hHandle;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open
+* Arguments  : device_info  = one entry from usb_relay_device_enumerate
+* Returns    : handle of the open module, or 0 on failure
+* Description:
+*   Opens a module from an enumeration entry
+*/
+intptr_t USBRL_API usb_relay_device_open(struct usb_relay_device_info* device_info)
+{
+    if (!device_info || !device_info->device_path || !device_info->serial_number)
+        return 0;
+
+    return Open_Path(device_info->device_path, int(device_info->type), device_info->serial_number);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_close
+* Arguments  : hHandle  = handle of an open module
+* Returns    : none
+* Description:
+*   Closes a module
+*/
+void USBRL_API usb_relay_device_close(intptr_t hHandle)
+{
+    auto h = (handle_t*)hHandle;
+
+    if (h)
+    {
+        close(h->fd);
+        delete h;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open_one_relay_channel
+* Arguments  : hHandle  = handle of an open module
+*              index    = channel (1..channels)
+* Returns    : 0 = success, 1 = error, 2 = invalid channel
+* Description:
+*   Turns on one channel
+*/
+int USBRL_API usb_relay_device_open_one_relay_channel(intptr_t hHandle, int index)
+{
+    return Write_Command(hHandle, CMD_ON_ONE, index);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open_all_relay_channel
+* Arguments  : hHandle  = handle of an open module
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Turns on every channel
+*/
+int USBRL_API usb_relay_device_open_all_relay_channel(intptr_t hHandle)
+{
+    return Write_Command(hHandle, CMD_ON_ALL, 0);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_close_one_relay_channel
+* Arguments  : hHandle  = handle of an open module
+*              index    = channel (1..channels)
+* Returns    : 0 = success, 1 = error, 2 = invalid channel
+* Description:
+*   Turns off one channel
+*/
+int USBRL_API usb_relay_device_close_one_relay_channel(intptr_t hHandle, int index)
+{
+    return Write_Command(hHandle, CMD_OFF_ONE, index);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_close_all_relay_channel
+* Arguments  : hHandle  = handle of an open module
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Turns off every channel
+*/
+int USBRL_API usb_relay_device_close_all_relay_channel(intptr_t hHandle)
+{
+    return Write_Command(hHandle, CMD_OFF_ALL, 0);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_status
+* Arguments  : hHandle  = handle of an open module
+*              status   = receives the state (bit 0 = channel 1, 1 = on)
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Reads the state of every channel
+*/
+int USBRL_API usb_relay_device_get_status(intptr_t hHandle, unsigned int* status)
+{
+    int bitmap = usb_relay_device_get_status_bitmap(hHandle);
+
+    if (bitmap < 0 || !status)
+        return 1;
+
+    *status = (unsigned int)bitmap;
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_lib_version
+* Arguments  : none
+* Returns    : library version
+* Description:
+*   Returns the version of the library interface implemented
+*/
+int USBRL_API usb_relay_device_lib_version(void)
+{
+    return USBRELAY_LIB_VER;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_next_dev
+* Arguments  : ptr_usb_relay_device_info  = entry from usb_relay_device_enumerate
+* Returns    : next entry, or 0 at the end of the list
+* Description:
+*   Walks the enumeration list without touching the structure (non-native callers)
+*/
+intptr_t USBRL_API usb_relay_device_next_dev(intptr_t ptr_usb_relay_device_info)
+{
+    auto info = (pusb_relay_device_info_t)ptr_usb_relay_device_info;
+
+    return info ? (intptr_t)info->next : 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_num_relays
+* Arguments  : ptr_usb_relay_device_info  = entry from usb_relay_device_enumerate
+* Returns    : number of channels, or 0 on error
+* Description:
+*   Returns the number of channels of an enumerated module (non-native callers)
+*/
+int USBRL_API usb_relay_device_get_num_relays(intptr_t ptr_usb_relay_device_info)
+{
+    auto info = (pusb_relay_device_info_t)ptr_usb_relay_device_info;
+
+    return info ? int(info->type) : 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_id_string
+* Arguments  : ptr_usb_relay_device_info  = entry from usb_relay_device_enumerate
+* Returns    : pointer to the sernum (C string), or 0 on error
+* Description:
+*   Returns the sernum of an enumerated module (non-native callers)
+*/
+intptr_t USBRL_API usb_relay_device_get_id_string(intptr_t ptr_usb_relay_device_info)
+{
+    auto info = (pusb_relay_device_info_t)ptr_usb_relay_device_info;
+
+    return info ? (intptr_t)info->serial_number : 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_status_bitmap
+* Arguments  : hHandle  = handle of an open module
+* Returns    : state (bit 0 = channel 1, 1 = on), negative on error
+* Description:
+*   Reads the state of every channel (non-native callers)
+*/
+int USBRL_API usb_relay_device_get_status_bitmap(intptr_t hHandle)
+{
+    auto h = (handle_t*)hHandle;
+    unsigned char report[REPORT_LENGTH];
+
+    if (!h || !Read_Report(h->fd, report))
+        return -1;
+
+    return int(Report_State(report, h->channels));
+}
+
+
+/*******************************************************************************
+* Function   : Refresh_Table
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Rebuilds the sernum -> module table from /sys/class/hidraw. Each relay
+*   module is opened once to read its sernum (it is not in the USB descriptors).
+*   Must be called with lib_lock held.
+*/
+static void Refresh_Table()
+{
+    table.clear();
+    table_stale = false;
+
+    DIR* dir = opendir(SYS_HIDRAW_DIR);
+
+    if (!dir)
+        return;
+
+    while (dirent* entry = readdir(dir))
+    {
+        const string node = entry->d_name;
+
+        if (node.rfind("hidraw", 0) != 0)
+            continue;
+
+        const int channels = Hidraw_Channels(node);
+
+        if (channels == 0)
+            continue;
+
+        const string path = string(DEV_DIR) + "/" + node;
+        const int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        unsigned char report[REPORT_LENGTH];
+
+        if (fd < 0)
+            continue;
+
+        if (Read_Report(fd, report))
+            table[Report_Sernum(report)] = module_t{ path, channels };
+
+        close(fd);
+    }
+
+    closedir(dir);
+}
+
+
+/*******************************************************************************
+* Function   : Check_Hotplug
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Drains the inotify events (never blocks) and refreshes the table if a
+*   hidraw node was added, removed or had its permissions changed.
+*   Without inotify, the table is refreshed on every call.
+*   Must be called with lib_lock held.
+*/
+static void Check_Hotplug()
+{
+    alignas(inotify_event) char events[4096];
+    ssize_t n;
+
+    if (inotify_fd < 0)
+        table_stale = true;
+
+    while (inotify_fd >= 0 && (n = read(inotify_fd, events, sizeof(events))) > 0)
+    {
+        for (char* p = events; p < events + n; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+        {
+            auto event = (inotify_event*)p;
+
+            if ((event->mask & IN_Q_OVERFLOW) || (event->len && strncmp(event->name, "hidraw", 6) == 0))
+                table_stale = true;
+        }
+    }
+
+    if (table_stale)
+        Refresh_Table();
+}
+
+
+/*******************************************************************************
+* Function   : Hidraw_Channels
+* Arguments  : node  = hidraw node name (e.g., "hidraw3")
+* Returns    : number of channels if the node is a relay module, otherwise 0
+* Description:
+*   Identifies a relay module from its HID uevent (IDs and "USBRelayN" name)
+*/
+static int Hidraw_Channels(const string& node)
+{
+    ifstream uevent(string(SYS_HIDRAW_DIR) + "/" + node + "/device/uevent");
+    string line;
+    bool is_relay = false;
+    int channels = 0;
+
+    while (getline(uevent, line))
+    {
+        if (line == string("HID_ID=") + HID_ID_RELAY)
+        {
+            is_relay = true;
+        }
+        else if (line.rfind("HID_NAME=", 0) == 0)
+        {
+            size_t pos = line.find(HID_NAME_RELAY);
+            if (pos != string::npos && pos + strlen(HID_NAME_RELAY) < line.length())
+                channels = line[pos + strlen(HID_NAME_RELAY)] - '0';
+        }
+    }
+
+    if (!is_relay)
+        return 0;
+
+    switch (channels)
+    {
+    case USB_RELAY_DEVICE_ONE_CHANNEL:
+    case USB_RELAY_DEVICE_TWO_CHANNEL:
+    case USB_RELAY_DEVICE_FOUR_CHANNEL:
+    case USB_RELAY_DEVICE_EIGHT_CHANNEL:
+        return channels;
+    default:
+        return 0;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : Read_Report
+* Arguments  : fd      = open hidraw node
+*              report  = receives REPORT_LENGTH bytes
+* Returns    : true = success, false = failure
+* Description:
+*   Reads the feature report (sernum and state) of a module. The modules
+*   answer report 1; asked for report 0, hidraw returns the data one byte
+*   off, and the sernum and state are read from the wrong bytes.
+*/
+static bool Read_Report(int fd, unsigned char* report)
+{
+    memset(report, 0, REPORT_LENGTH);
+    report[0] = REPORT_ID_READ;
+
+    return ioctl(fd, HIDIOCGFEATURE(REPORT_LENGTH), report) >= REPORT_STATE + 1;
+}
+
+
+/*******************************************************************************
+* Function   : Report_Sernum
+* Arguments  : report  = feature report read by Read_Report
+* Returns    : the module's sernum
+* Description:
+*   Takes the sernum (up to 5 characters, NUL-padded) from a feature report
+*/
+static string Report_Sernum(const unsigned char* report)
+{
+    return string((const char*)report, strnlen((const char*)report, REPORT_SERNUM_LENGTH));
+}
+
+
+/*******************************************************************************
+* Function   : Report_State
+* Arguments  : report    = feature report read by Read_Report
+*              channels  = number of channels on the module
+* Returns    : state (bit 0 = channel 1, 1 = on)
+* Description:
+*   Takes the state of the module's channels from a feature report
+*/
+static unsigned Report_State(const unsigned char* report, int channels)
+{
+    return report[REPORT_STATE] & ((1u << channels) - 1);
+}
+
+
+/*******************************************************************************
+* Function   : Write_Command
+* Arguments  : hHandle  = handle of an open module
+*              cmd      = CMD_xxx
+*              index    = channel (1..channels) for CMD_ON_ONE/CMD_OFF_ONE
+* Returns    : 0 = success, 1 = error, 2 = invalid channel
+* Description:
+*   Sends one command to a module as a feature report
+*/
+static int Write_Command(intptr_t hHandle, unsigned char cmd, int index)
+{
+    auto h = (handle_t*)hHandle;
+    unsigned char report[REPORT_LENGTH] = { 0 };
+
+    if (!h)
+        return 1;
+
+    if ((cmd == CMD_ON_ONE || cmd == CMD_OFF_ONE) && (index < 1 || index > h->channels))
+        return 2;
+
+    report[1] = cmd;
+    report[2] = (unsigned char)index;
+
+    return (ioctl(h->fd, HIDIOCSFEATURE(REPORT_LENGTH), report) == REPORT_LENGTH) ? 0 : 1;
+}
+
+
+/*******************************************************************************
+* Function   : Open_Path
+* Arguments  : path      = /dev/hidrawN
+*              channels  = number of channels on the module
+*              sernum    = sernum of the module expected at the node
+* Returns    : handle of the open module, or 0 on failure
+* Description:
+*   Opens a hidraw node and wraps it in a handle, once its feature report
+*   shows the node is still the module expected there
+*/
+static intptr_t Open_Path(const string& path, int channels, const string& sernum)
+{
+    const int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    unsigned char report[REPORT_LENGTH];
+
+    if (fd < 0)
+        return 0;
+
+    if (!Read_Report(fd, report) || Report_Sernum(report) != sernum)
+    {
+        close(fd);
+        return 0;
+    }
+
+    return (intptr_t)new handle_t{ fd, channels };
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
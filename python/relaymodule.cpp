@@ -0,0 +1,527 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : relaymodule.cpp
+* Description:
+*   Python extension module "relay". Modules are opened on first use and
+*   held open for the life of the interpreter (by a Relay_Context, up to
+*   RELAY_MAX_OPEN of them, the least recently used closed first). The GIL
+*   is released during device I/O, so threads driving different modules run
+*   concurrently (calls on the same module are serialized).
+*
+*     relay.enumerate()                   -> [(sernum, channels), ...]
+*     relay.query(sernum)                 -> state
+*     relay.set(sernum, on=0, off=0)      -> state
+*     relay.pulse(sernum, mask, ms)       -> state
+*     relay.aliases()                     -> {alias: sernum, ...}
+*     relay.alias(alias, sernum)
+*     relay.unalias(alias)
+*
+*   sernum may be an alias; states and masks are ints (bit 0 = channel 1).
+*   Errors raise relay.RelayError(code, message) with the command line's
+*   error codes.
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "Relay.h"
+#include "RelayContext.h"
+
+#ifdef _WIN32
+#include "EasyRegistry.h"
+
+// registry key (same as the command line)
+constexpr char REG_KEY_RELAY_ALIAS[] = "SOFTWARE\\WWES\\Relay";
+constexpr char REG_SETTING_ALIASES[] = "Aliases";
+#else
+// alias file in the home directory (same format as the registry setting)
+constexpr char ALIAS_FILE[] = "/.wwes_relay_aliases";
+#endif
+
+// driver and open modules, created on first use (see Get_Context)
+static mutex context_lock;
+static unique_ptr<Relay_Context> context;
+static PyObject* RelayError = nullptr;
+
+// regex patterns (same as the command line)
+static const regex regex_sernum("^(" T_SERNUM ")$", regex::icase);
+static const regex regex_alias_name("^(" T_ALIAS_NAME ")$", regex::icase);
+static const regex regex_alias_registry("(" T_ALIAS_NAME ")[=:](" T_SERNUM "),?", regex::icase);
+
+// support function declarations
+static Relay_Context* Get_Context();
+static bool Read_Aliases(string& list);
+static bool Write_Aliases(const string& list);
+static map<string, string> Alias_Map();
+static string Alias_Sernum(string alias_or_sernum);
+static PyObject* Raise(ERROR_CODES error, const string& sernum = "");
+
+
+/*******************************************************************************
+* Function   : relay_enumerate
+* Arguments  : none (Python)
+* Returns    : list of (sernum, channels)
+* Description:
+*   Lists every relay module on the bus (an empty list if there are none)
+*/
+static PyObject* relay_enumerate(PyObject* self, PyObject* args)
+{
+    MODULE_CHANNELS modules;
+    ERROR_CODES error = ERROR_CODES::NONE;
+
+    Py_BEGIN_ALLOW_THREADS
+    {
+        Relay_Context* ctx = Get_Context();
+
+        error = ctx ? ctx->Enumerate(modules) : ERROR_CODES::NO_DRIVER_INIT;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (error != ERROR_CODES::NONE && error != ERROR_CODES::NO_DEVICES)
+        return Raise(error);
+
+    PyObject* result = PyList_New(0);
+
+    for (channels_t const& m : modules)
+    {
+        PyObject* item = Py_BuildValue("(si)", m.sn.c_str(), m.channels);
+        PyList_Append(result, item);
+        Py_DECREF(item);
+    }
+
+    return result;
+}
+
+
+/*******************************************************************************
+* Function   : relay_query
+* Arguments  : sernum (Python)
+* Returns    : state of the module
+* Description:
+*   Reads the state of every channel of a module
+*/
+static PyObject* relay_query(PyObject* self, PyObject* args)
+{
+    const char* name;
+
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return nullptr;
+
+    const string sernum = Alias_Sernum(name);
+    ERROR_CODES error = ERROR_CODES::NONE;
+    unsigned state = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    {
+        Relay_Context* ctx = Get_Context();
+
+        error = ctx ? ctx->Query(sernum, state) : ERROR_CODES::NO_DRIVER_INIT;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (error != ERROR_CODES::NONE)
+        return Raise(error, name);
+
+    return PyLong_FromUnsignedLong(state);
+}
+
+
+/*******************************************************************************
+* Function   : relay_set
+* Arguments  : sernum, on = channels to turn on, off = channels to turn off (Python)
+* Returns    : new state of the module
+* Description:
+*   Turns channels on and off, writing only the channels that change
+*/
+static PyObject* relay_set(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = { "sernum", "on", "off", nullptr };
+    const char* name;
+    unsigned int on = 0, off = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|II", (char**)keywords, &name, &on, &off))
+        return nullptr;
+
+    const string sernum = Alias_Sernum(name);
+    ERROR_CODES error = ERROR_CODES::NONE;
+    unsigned state = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    {
+        Relay_Context* ctx = Get_Context();
+        rmw_t op{ sernum, on, off, 0, 0, 0 };
+
+        error = ctx ? ctx->Apply(op, &state) : ERROR_CODES::NO_DRIVER_INIT;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (error != ERROR_CODES::NONE)
+        return Raise(error, name);
+
+    return PyLong_FromUnsignedLong(state);
+}
+
+
+/*******************************************************************************
+* Function   : relay_pulse
+* Arguments  : sernum, mask = channels to pulse, ms = duration (Python)
+* Returns    : state of the module after the pulse
+* Description:
+*   Turns channels on for a number of milliseconds, then returns them to the
+*   state they had before. Other threads may use the module during the pulse.
+*/
+static PyObject* relay_pulse(PyObject* self, PyObject* args)
+{
+    const char* name;
+    unsigned int mask = 0, ms = 0;
+
+    if (!PyArg_ParseTuple(args, "sII", &name, &mask, &ms))
+        return nullptr;
+
+    const string sernum = Alias_Sernum(name);
+    ERROR_CODES error = ERROR_CODES::NONE;
+    unsigned state = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    {
+        Relay_Context* ctx = Get_Context();
+        unsigned before = 0;
+
+        error = ctx ? ctx->Apply(rmw_t{ sernum, mask, 0, 0, 0, 0 }, nullptr, &before) : ERROR_CODES::NO_DRIVER_INIT;
+
+        if (error == ERROR_CODES::NONE)
+        {
+            this_thread::sleep_for(chrono::milliseconds(ms));
+
+            // return the pulsed channels to their state before the pulse
+            error = ctx->Apply(rmw_t{ sernum, before & mask, ~before & mask, 0, 0, 0 }, &state);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (error != ERROR_CODES::NONE)
+        return Raise(error, name);
+
+    return PyLong_FromUnsignedLong(state);
+}
+
+
+/*******************************************************************************
+* Function   : relay_aliases
+* Arguments  : none (Python)
+* Returns    : dict of alias -> sernum
+* Description:
+*   Lists the alias assignments
+*/
+static PyObject* relay_aliases(PyObject* self, PyObject* args)
+{
+    PyObject* result = PyDict_New();
+
+    for (auto const& [alias, sernum] : Alias_Map())
+    {
+        PyObject* value = PyUnicode_FromString(sernum.c_str());
+        PyDict_SetItemString(result, alias.c_str(), value);
+        Py_DECREF(value);
+    }
+
+    return result;
+}
+
+
+/*******************************************************************************
+* Function   : relay_alias
+* Arguments  : alias, sernum (Python)
+* Returns    : None
+* Description:
+*   Assigns an alias (replacing any previous assignment of the alias)
+*/
+static PyObject* relay_alias(PyObject* self, PyObject* args)
+{
+    const char* alias_arg;
+    const char* sernum_arg;
+
+    if (!PyArg_ParseTuple(args, "ss", &alias_arg, &sernum_arg))
+        return nullptr;
+
+    string alias = alias_arg, sernum = sernum_arg;
+
+    if (!regex_match(alias, regex_alias_name) || alias[0] == '-' || !regex_match(sernum, regex_sernum))
+        return Raise(ERROR_CODES::SYNTAX);
+
+    std::transform(alias.begin(), alias.end(), alias.begin(), ::toupper);
+    std::transform(sernum.begin(), sernum.end(), sernum.begin(), ::toupper);
+
+    string list = alias + "=" + sernum;
+
+    for (auto const& [a, sn] : Alias_Map())
+    {
+        if (a != alias)
+            list += "," + a + "=" + sn;
+    }
+
+    if (!Write_Aliases(list))
+        return Raise(ERROR_CODES::BAD_FILE);
+
+    Py_RETURN_NONE;
+}
+
+
+/*******************************************************************************
+* Function   : relay_unalias
+* Arguments  : alias (Python)
+* Returns    : None
+* Description:
+*   Removes an alias assignment
+*/
+static PyObject* relay_unalias(PyObject* self, PyObject* args)
+{
+    const char* alias_arg;
+
+    if (!PyArg_ParseTuple(args, "s", &alias_arg))
+        return nullptr;
+
+    string alias = alias_arg;
+    string list = "";
+    bool found = false;
+
+    std::transform(alias.begin(), alias.end(), alias.begin(), ::toupper);
+
+    for (auto const& [a, sn] : Alias_Map())
+    {
+        if (a == alias)
+            found = true;
+        else
+            list += (list.empty() ? "" : ",") + a + "=" + sn;
+    }
+
+    if (found && !Write_Aliases(list))
+        return Raise(ERROR_CODES::BAD_FILE);
+
+    Py_RETURN_NONE;
+}
+
+
+/*******************************************************************************
+* Function   : Get_Context
+* Arguments  : none
+* Returns    : the context, or nullptr if the driver could not be initialized
+* Description:
+*   Returns the context, creating it on first use (an attempt that fails is
+*   repeated on the next call)
+*/
+static Relay_Context* Get_Context()
+{
+    lock_guard<mutex> lock(context_lock);
+
+    if (!context)
+    {
+        context = make_unique<Relay_Context>();
+
+        if (!context->Is_Initialized())
+            context.reset();
+    }
+
+    return context.get();
+}
+
+
+/*******************************************************************************
+* Function   : Read_Aliases
+* Arguments  : list  = receives alias=sernum,alias=sernum,...
+* Returns    : true = success, false = failure
+* Description:
+*   Reads the alias assignments (registry on Windows, a file in $HOME elsewhere)
+*/
+static bool Read_Aliases(string& list)
+{
+#ifdef _WIN32
+    return ReadRegSZ(REG_KEY_RELAY_ALIAS, REG_SETTING_ALIASES, list, "");
+#else
+    const char* home = getenv("HOME");
+    ifstream file(string(home ? home : ".") + ALIAS_FILE);
+
+    list = "";
+    getline(file, list);
+
+    return true;
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Write_Aliases
+* Arguments  : list  = alias=sernum,alias=sernum,...
+* Returns    : true = success, false = failure
+* Description:
+*   Writes the alias assignments (registry on Windows, a file in $HOME elsewhere)
+*/
+static bool Write_Aliases(const string& list)
+{
+#ifdef _WIN32
+    return WriteRegSZ(REG_KEY_RELAY_ALIAS, REG_SETTING_ALIASES, list);
+#else
+    const char* home = getenv("HOME");
+    ofstream file(string(home ? home : ".") + ALIAS_FILE, ios::trunc);
+
+    file << list << "\n";
+
+    return bool(file);
+#endif
+}
+
+
+/*******************************************************************************
+* Function   : Alias_Map
+* Arguments  : none
+* Returns    : alias -> sernum
+* Description:
+*   Parses the alias assignments
+*/
+static map<string, string> Alias_Map()
+{
+    map<string, string> aliases;
+    string list;
+    smatch smMatch;
+
+    if (Read_Aliases(list))
+    {   // format is alias=sernum,alias=sernum,alias=sernum
+        while (regex_search(list, smMatch, regex_alias_registry))
+        {
+            aliases.emplace(smMatch[1], smMatch[2]);
+            list = smMatch.suffix().str();
+        }
+    }
+
+    return aliases;
+}
+
+
+/*******************************************************************************
+* Function   : Alias_Sernum
+* Arguments  : alias_or_sernum  = alias or sernum from the caller
+* Returns    : sernum assigned to the alias, the argument if it is a valid
+*              sernum, otherwise blank
+* Description:
+*   This function tries to identify the sernum associated with an alias
+*/
+static string Alias_Sernum(string alias_or_sernum)
+{
+    std::transform(alias_or_sernum.begin(), alias_or_sernum.end(), alias_or_sernum.begin(), ::toupper);
+
+    auto aliases = Alias_Map();
+    auto it = aliases.find(alias_or_sernum);
+
+    if (it != aliases.end())
+        return it->second;
+
+    return regex_match(alias_or_sernum, regex_sernum) ? alias_or_sernum : "";
+}
+
+
+/*******************************************************************************
+* Function   : Raise
+* Arguments  : error   = error code
+*              sernum  = module the error refers to, as the caller named it
+* Returns    : nullptr (for returning from the Python function)
+* Description:
+*   Raises relay.RelayError(code, message), with the message the command line
+*   gives (the only file the module writes is the aliases)
+*/
+static PyObject* Raise(ERROR_CODES error, const string& sernum)
+{
+    string message = (error == ERROR_CODES::BAD_FILE) ? "Unable to write aliases" : Error_Message(error, sernum);
+
+    if (message.empty())
+        message = "Error";
+
+    PyObject* value = Py_BuildValue("(is)", int(error), message.c_str());
+    PyErr_SetObject(RelayError, value);
+    Py_XDECREF(value);
+
+    return nullptr;
+}
+
+
+/*******************************************************************************
+* Function   : relay_free
+* Arguments  : module object (Python)
+* Returns    : none
+* Description:
+*   Closes every module when the interpreter unloads the extension
+*/
+static void relay_free(void* module)
+{
+    lock_guard<mutex> lock(context_lock);
+
+    context.reset();
+}
+
+
+// module definition
+static PyMethodDef relay_methods[] = {
+    { "enumerate", relay_enumerate, METH_NOARGS, "enumerate() -> [(sernum, channels), ...]" },
+    { "query", relay_query, METH_VARARGS, "query(sernum) -> state (bit 0 = channel 1)" },
+    { "set", (PyCFunction)(void(*)(void))relay_set, METH_VARARGS | METH_KEYWORDS, "set(sernum, on=0, off=0) -> state" },
+    { "pulse", relay_pulse, METH_VARARGS, "pulse(sernum, mask, ms) -> state; turn channels on for ms, then restore them" },
+    { "aliases", relay_aliases, METH_NOARGS, "aliases() -> {alias: sernum, ...}" },
+    { "alias", relay_alias, METH_VARARGS, "alias(alias, sernum); assign an alias" },
+    { "unalias", relay_unalias, METH_VARARGS, "unalias(alias); remove an alias" },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+static struct PyModuleDef relay_module = {
+    PyModuleDef_HEAD_INIT, "relay", "USB HID relay modules", -1, relay_methods,
+    nullptr, nullptr, nullptr, relay_free
+};
+
+
+/*******************************************************************************
+* Function   : PyInit_relay
+* Arguments  : none
+* Returns    : the module object
+* Description:
+*   Extension module entry point
+*/
+PyMODINIT_FUNC PyInit_relay(void)
+{
+    PyObject* module = PyModule_Create(&relay_module);
+
+    if (!module)
+        return nullptr;
+
+    RelayError = PyErr_NewException("relay.RelayError", PyExc_Exception, nullptr);
+    Py_XINCREF(RelayError);
+
+    if (PyModule_AddObject(module, "RelayError", RelayError) < 0)
+    {
+        Py_XDECREF(RelayError);
+        Py_CLEAR(RelayError);
+        Py_DECREF(module);
+        return nullptr;
+    }
+
+    return module;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/
@@ -0,0 +1,40 @@
+# Build the "relay" Python extension module
+#   pip install .            (or: python setup.py build_ext --inplace)
+#
+# Windows links the vendor usb_relay_device library (Relay/x64); elsewhere the
+# hidraw implementation (hidraw/usb_relay_device.cpp) is compiled in.
+
+import sys
+from setuptools import setup, Extension
+
+sources = ["relaymodule.cpp", "../Relay/RelayContext.cpp", "../Relay/RelayWorker.cpp", "../Relay/RelayLock.cpp", "../Relay/RelayState.cpp", "../Relay/RelayInventory.cpp"]
+library_dirs = []
+libraries = []
+
+if sys.platform == "win32":
+    sources += ["../Relay/EasyRegistry.cpp"]
+    library_dirs += ["../Relay/x64"]
+    libraries += ["usb_relay_device", "advapi32"]
+    compile_args = ["/std:c++20", "/EHsc"]
+else:
+    sources += ["../hidraw/usb_relay_device.cpp"]
+    compile_args = ["-std=c++20"]
+
+setup(
+    name="relay",
+    version="1.2",
+    description="USB HID relay modules",
+    author="Kerry S. Martin",
+    author_email="martin@wild-wood.net",
+    ext_modules=[
+        Extension(
+            "relay",
+            sources=sources,
+            include_dirs=["../Relay"],
+            library_dirs=library_dirs,
+            libraries=libraries,
+            extra_compile_args=compile_args,
+            language="c++",
+        )
+    ],
+)
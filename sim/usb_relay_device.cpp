@@ -0,0 +1,472 @@
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*
+* Filename   : usb_relay_device.cpp
+* Description:
+*   Simulated implementation of the usb_relay_device library interface
+*   (usb_relay_device.h), for benchmarks and tests without hardware.
+*   The modules exist in memory for the life of the process:
+*
+*     RELAY_SIM     = sernum:channels,sernum:channels,...
+*                     (default SIM01:8,SIM02:8,SIM03:8,SIM04:8)
+*     RELAY_SIM_US  = time each report takes, in microseconds (default 0)
+*
+*   Like the hardware, a module handles one report at a time. Enumeration
+*   lists and open handles are counted (usb_relay_sim_outstanding), so tests
+*   can tell when a caller does not free or close them.
+*
+*   Build (in place of the vendor library):
+*     g++ -std=c++20 -O2 -shared -fPIC -I../Relay usb_relay_device.cpp -o libusb_relay_device.so
+*
+* Created    : 10/18/2026
+* Modified   : 10/18/2026
+* Author     : Kerry S. Martin, martin@wild-wood.net
+*******************************************************************************/
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "usb_relay_device.h"
+
+constexpr char ENV_MODULES[] = "RELAY_SIM";
+constexpr char ENV_REPORT_US[] = "RELAY_SIM_US";
+constexpr char DEFAULT_MODULES[] = "SIM01:8,SIM02:8,SIM03:8,SIM04:8";
+constexpr int SERNUM_LENGTH = 5;
+
+// one simulated relay module
+struct module_t
+{
+    string sn = "";
+    int channels = 0;
+    unsigned state = 0;         // bit 0 = channel 1
+    mutex lock;                 // one report at a time
+};
+
+// one open handle
+struct handle_t
+{
+    module_t* module = nullptr;
+};
+
+static mutex lib_lock;                              // guards modules while they are created
+static vector<unique_ptr<module_t>> modules;        // never shrinks, so handles stay valid
+static chrono::microseconds report_time{ 0 };
+static atomic<int> lists_outstanding{ 0 };          // enumerations not yet freed
+static atomic<int> handles_outstanding{ 0 };        // handles not yet closed
+
+// support function declarations
+static void Create_Modules();
+static int Report(intptr_t hHandle, unsigned on, unsigned off, unsigned* status);
+
+// not part of the library interface: resources the caller still holds
+extern "C" void usb_relay_sim_outstanding(int* lists, int* handles);
+
+
+/*******************************************************************************
+* Function   : usb_relay_init
+* Arguments  : none
+* Returns    : 0 on success, -1 on error
+* Description:
+*   Creates the simulated modules on the first call
+*/
+int USBRL_API usb_relay_init(void)
+{
+    lock_guard<mutex> lock(lib_lock);
+
+    if (modules.empty())
+        Create_Modules();
+
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_exit
+* Arguments  : none
+* Returns    : 0 on success, -1 on error
+* Description:
+*   Nothing to do (the modules keep their state until the process exits)
+*/
+int USBRL_API usb_relay_exit(void)
+{
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_enumerate
+* Arguments  : none
+* Returns    : list of modules (free with usb_relay_device_free_enumerate)
+* Description:
+*   Lists the simulated modules
+*/
+pusb_relay_device_info_t USBRL_API usb_relay_device_enumerate(void)
+{
+    lock_guard<mutex> lock(lib_lock);
+    pusb_relay_device_info_t head = nullptr;
+    pusb_relay_device_info_t* tail = &head;
+
+    for (auto const& m : modules)
+    {
+        auto info = new usb_relay_device_info;
+
+        info->serial_number = strdup(m->sn.c_str());
+        info->device_path = strdup(("sim:" + m->sn).c_str());
+        info->type = m->channels;
+        info->next = nullptr;
+
+        *tail = info;
+        tail = &info->next;
+    }
+
+    if (head)
+        ++lists_outstanding;
+
+    return head;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_free_enumerate
+* Arguments  : info  = list from usb_relay_device_enumerate
+* Returns    : none
+* Description:
+*   Frees an enumeration list
+*/
+void USBRL_API usb_relay_device_free_enumerate(struct usb_relay_device_info* info)
+{
+    if (info)
+        --lists_outstanding;
+
+    while (info)
+    {
+        auto next = info->next;
+
+        free(info->serial_number);
+        free(info->device_path);
+        delete info;
+
+        info = next;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open_with_serial_number
+* Arguments  : serial_number  = sernum (not necessarily terminated)
+*              len            = length of serial_number
+* Returns    : handle, or 0 if the module does not exist
+* Description:
+*   Opens a module by its serial number
+*/
+intptr_t USBRL_API usb_relay_device_open_with_serial_number(const char* serial_number, unsigned len)
+{
+    lock_guard<mutex> lock(lib_lock);
+    const string sn(serial_number, len);
+
+    for (auto const& m : modules)
+    {
+        if (m->sn == sn)
+        {
+            ++handles_outstanding;
+            return (intptr_t)new handle_t{ m.get() };
+        }
+    }
+
+    return 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open
+* Arguments  : device_info  = entry from usb_relay_device_enumerate
+* Returns    : handle, or 0 on error
+* Description:
+*   Opens an enumerated module
+*/
+intptr_t USBRL_API usb_relay_device_open(struct usb_relay_device_info* device_info)
+{
+    if (!device_info)
+        return 0;
+
+    const char* sn = device_info->serial_number;
+
+    return usb_relay_device_open_with_serial_number(sn, (unsigned)strlen(sn));
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_close
+* Arguments  : hHandle  = handle of an open module
+* Returns    : none
+* Description:
+*   Closes a module
+*/
+void USBRL_API usb_relay_device_close(intptr_t hHandle)
+{
+    if (hHandle)
+    {
+        --handles_outstanding;
+        delete (handle_t*)hHandle;
+    }
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open_one_relay_channel
+* Arguments  : hHandle  = handle of an open module
+*              index    = channel (1..channels)
+* Returns    : 0 = success, 1 = error, 2 = invalid channel
+* Description:
+*   Turns on one channel
+*/
+int USBRL_API usb_relay_device_open_one_relay_channel(intptr_t hHandle, int index)
+{
+    auto h = (handle_t*)hHandle;
+
+    if (h && (index < 1 || index > h->module->channels))
+        return 2;
+
+    return Report(hHandle, 1u << (index - 1), 0, nullptr);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_open_all_relay_channel
+* Arguments  : hHandle  = handle of an open module
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Turns on every channel
+*/
+int USBRL_API usb_relay_device_open_all_relay_channel(intptr_t hHandle)
+{
+    return Report(hHandle, ~0u, 0, nullptr);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_close_one_relay_channel
+* Arguments  : hHandle  = handle of an open module
+*              index    = channel (1..channels)
+* Returns    : 0 = success, 1 = error, 2 = invalid channel
+* Description:
+*   Turns off one channel
+*/
+int USBRL_API usb_relay_device_close_one_relay_channel(intptr_t hHandle, int index)
+{
+    auto h = (handle_t*)hHandle;
+
+    if (h && (index < 1 || index > h->module->channels))
+        return 2;
+
+    return Report(hHandle, 0, 1u << (index - 1), nullptr);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_close_all_relay_channel
+* Arguments  : hHandle  = handle of an open module
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Turns off every channel
+*/
+int USBRL_API usb_relay_device_close_all_relay_channel(intptr_t hHandle)
+{
+    return Report(hHandle, 0, ~0u, nullptr);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_status
+* Arguments  : hHandle  = handle of an open module
+*              status   = receives the state (bit 0 = channel 1, 1 = on)
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Reads the state of every channel
+*/
+int USBRL_API usb_relay_device_get_status(intptr_t hHandle, unsigned int* status)
+{
+    if (!status)
+        return 1;
+
+    return Report(hHandle, 0, 0, status);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_lib_version
+* Arguments  : none
+* Returns    : version of the library interface
+* Description:
+*   Returns the interface version this library implements
+*/
+int USBRL_API usb_relay_device_lib_version(void)
+{
+    return USBRELAY_LIB_VER;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_next_dev
+* Arguments  : ptr_usb_relay_device_info  = entry from usb_relay_device_enumerate
+* Returns    : next entry, or 0 at the end of the list
+* Description:
+*   Walks the enumeration list without touching the structure (non-native callers)
+*/
+intptr_t USBRL_API usb_relay_device_next_dev(intptr_t ptr_usb_relay_device_info)
+{
+    auto info = (pusb_relay_device_info_t)ptr_usb_relay_device_info;
+
+    return info ? (intptr_t)info->next : 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_num_relays
+* Arguments  : ptr_usb_relay_device_info  = entry from usb_relay_device_enumerate
+* Returns    : number of channels, or 0 on error
+* Description:
+*   Returns the number of channels of an enumerated module (non-native callers)
+*/
+int USBRL_API usb_relay_device_get_num_relays(intptr_t ptr_usb_relay_device_info)
+{
+    auto info = (pusb_relay_device_info_t)ptr_usb_relay_device_info;
+
+    return info ? int(info->type) : 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_id_string
+* Arguments  : ptr_usb_relay_device_info  = entry from usb_relay_device_enumerate
+* Returns    : pointer to the sernum (C string), or 0 on error
+* Description:
+*   Returns the sernum of an enumerated module (non-native callers)
+*/
+intptr_t USBRL_API usb_relay_device_get_id_string(intptr_t ptr_usb_relay_device_info)
+{
+    auto info = (pusb_relay_device_info_t)ptr_usb_relay_device_info;
+
+    return info ? (intptr_t)info->serial_number : 0;
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_device_get_status_bitmap
+* Arguments  : hHandle  = handle of an open module
+* Returns    : state (bit 0 = channel 1, 1 = on), negative on error
+* Description:
+*   Reads the state of every channel (non-native callers)
+*/
+int USBRL_API usb_relay_device_get_status_bitmap(intptr_t hHandle)
+{
+    unsigned int status = 0;
+
+    if (Report(hHandle, 0, 0, &status) != 0)
+        return -1;
+
+    return int(status);
+}
+
+
+/*******************************************************************************
+* Function   : usb_relay_sim_outstanding
+* Arguments  : lists    = receives the number of enumerations not yet freed
+*              handles  = receives the number of handles not yet closed
+* Returns    : none
+* Description:
+*   Reports the resources callers still hold (simulator only)
+*/
+extern "C" void usb_relay_sim_outstanding(int* lists, int* handles)
+{
+    if (lists)
+        *lists = lists_outstanding;
+    if (handles)
+        *handles = handles_outstanding;
+}
+
+
+/*******************************************************************************
+* Function   : Create_Modules
+* Arguments  : none
+* Returns    : none
+* Description:
+*   Creates the modules listed in RELAY_SIM (sernum:channels,...), and reads
+*   the report time from RELAY_SIM_US. Must be called with lib_lock held.
+*/
+static void Create_Modules()
+{
+    const char* env = getenv(ENV_MODULES);
+    string list = (env && *env) ? env : DEFAULT_MODULES;
+    size_t pos = 0;
+
+    while (pos < list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == string::npos)
+            end = list.size();
+
+        const string item = list.substr(pos, end - pos);
+        const size_t colon = item.find(':');
+
+        if (colon == SERNUM_LENGTH)
+        {
+            auto m = make_unique<module_t>();
+
+            m->sn = item.substr(0, colon);
+            m->channels = atoi(item.c_str() + colon + 1);
+            if (m->channels >= 1 && m->channels <= 8)
+                modules.push_back(move(m));
+        }
+
+        pos = end + 1;
+    }
+
+    const char* us = getenv(ENV_REPORT_US);
+    report_time = chrono::microseconds(us ? atoi(us) : 0);
+}
+
+
+/*******************************************************************************
+* Function   : Report
+* Arguments  : hHandle  = handle of an open module
+*              on       = channels to turn on
+*              off      = channels to turn off
+*              status   = optionally receives the state
+* Returns    : 0 = success, 1 = error
+* Description:
+*   Simulates one feature report: the module is busy for RELAY_SIM_US
+*/
+static int Report(intptr_t hHandle, unsigned on, unsigned off, unsigned* status)
+{
+    if (!hHandle)
+        return 1;
+
+    module_t* m = ((handle_t*)hHandle)->module;
+
+    lock_guard<mutex> lock(m->lock);
+
+    if (report_time.count() > 0)
+        this_thread::sleep_for(report_time);
+
+    m->state = ((m->state & ~off) | on) & ((1u << m->channels) - 1);
+
+    if (status)
+        *status = m->state;
+
+    return 0;
+}
+
+/*******************************************************************************
+* Copyright © 2022 Kerry S. Martin, martin@wild-wood.net
+* Free for usage without warranty, expressed or implied; attribution required
+*******************************************************************************/